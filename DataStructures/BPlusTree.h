@@ -0,0 +1,620 @@
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+#include "IDictionary.h"
+#include "UnqPtr.h"
+#include "KeySearch.h"
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+// B+ tree: every element lives in a leaf, and the leaves are chained in key order, so a
+// full scan is a walk along the chain with no trips back up the tree. Internal nodes hold
+// only separator keys and child pointers. Their capacity is picked so that an internal
+// node takes about as many bytes as a leaf, which gives them a higher fanout than BTree
+// nodes of the same size, since BTree nodes carry an element next to every key.
+template<typename TKey, typename TElement>
+class BPlusTree : public IDictionary<TKey, TElement> {
+public:
+    // leafCapacity is the most entries a leaf holds; values below 3 are raised to 3.
+    BPlusTree(int leafCapacity = DefaultLeafCapacity);
+
+    virtual ~BPlusTree();
+
+    virtual size_t GetCount() const override;
+
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    virtual bool TryRemove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    // Splits full nodes on the way down and inserts or overwrites in the same descent.
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    virtual void Add(const TKey &key, TElement &&element) override;
+
+    virtual void Update(const TKey &key, TElement &&element) override;
+
+    virtual bool Upsert(const TKey &key, TElement &&element) override;
+
+    template<typename... Args>
+    void Emplace(const TKey &key, Args &&... args);
+
+    // Iterates over lower <= key < upper in ascending order; positioning costs one descent.
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetRange(const TKey &lower, const TKey &upper) const override;
+
+    // The smallest key that is not less than key, or nullopt if there is none.
+    std::optional<TKey> LowerBound(const TKey &key) const;
+
+    // Iterates in ascending order from the first key that is not less than key.
+    UnqPtr<IDictionaryIterator<TKey, TElement>> SeekIterator(const TKey &key) const;
+
+    int GetLeafCapacity() const;
+
+    int GetInnerCapacity() const;
+
+    int GetHeight() const;
+
+private:
+    static constexpr int DefaultLeafCapacity = 32;
+    static constexpr int MinimumCapacity = 3;
+
+    struct Node {
+        bool isLeaf;
+        int numKeys;
+        UnqPtr<TKey[]> keys;
+        // Leaves only: the elements and the next leaf in key order (not owned).
+        UnqPtr<TElement[]> values;
+        Node *next;
+        // Internal nodes only: numKeys + 1 children, child i holding the keys in
+        // [keys[i - 1], keys[i]).
+        UnqPtr<UnqPtr<Node>[]> children;
+
+        Node(bool leaf, int capacity);
+    };
+
+    UnqPtr<Node> root;
+    int leafCapacity;
+    int innerCapacity;
+    size_t count;
+
+    bool IsFull(const Node *node) const;
+
+    // Fewest keys a node other than the root keeps after a removal.
+    int MinimumKeys(const Node *node) const;
+
+    // Position of the first key in node that is not less than key.
+    static int LowerBound(const Node *node, const TKey &key);
+
+    // Index of the child of an internal node whose range contains key.
+    static int ChildIndex(const Node *node, const TKey &key);
+
+    // Returns the leaf that would hold key.
+    Node *FindLeaf(const TKey &key) const;
+
+    // Returns the element stored under key, or nullptr if it is absent.
+    TElement *FindValue(const TKey &key) const;
+
+    // Splits the full child i of x in two and inserts the separator into x.
+    void SplitChild(Node *x, int i);
+
+    template<typename TValue>
+    bool UpsertValue(const TKey &key, TValue &&element);
+
+    template<typename TValue>
+    void UpdateValue(const TKey &key, TValue &&element);
+
+    // Removes key from the subtree under x and returns false if it is absent; the caller
+    // repairs x if it underflows.
+    bool RemoveFromNode(Node *x, const TKey &key);
+
+    // Refills child i of x that fell below its minimum, from a sibling or by merging.
+    void Rebalance(Node *x, int i);
+
+    void BorrowFromPrev(Node *x, int i);
+
+    void BorrowFromNext(Node *x, int i);
+
+    // Merges child i + 1 of x into child i.
+    void Merge(Node *x, int i);
+
+    class BPlusTreeIterator : public IDictionaryIterator<TKey, TElement> {
+    public:
+        // Without bounds the iterator covers the whole tree.
+        BPlusTreeIterator(const BPlusTree *tree, std::optional<TKey> lower = std::nullopt,
+                          std::optional<TKey> upper = std::nullopt);
+
+        virtual ~BPlusTreeIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual TKey GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        const BPlusTree *tree;
+        std::optional<TKey> lower;
+        std::optional<TKey> upper;
+        const Node *leaf;
+        int index;
+        bool started;
+    };
+};
+
+template<typename TKey, typename TElement>
+BPlusTree<TKey, TElement>::Node::Node(bool leaf, int capacity)
+        : isLeaf(leaf), numKeys(0), keys(new TKey[capacity]), values(nullptr), next(nullptr), children(nullptr) {
+    if (leaf)
+        values.reset(new TElement[capacity]);
+    else
+        children.reset(new UnqPtr<Node>[capacity + 1]);
+}
+
+template<typename TKey, typename TElement>
+BPlusTree<TKey, TElement>::BPlusTree(int leafCapacity)
+        : root(nullptr), leafCapacity(std::max(leafCapacity, MinimumCapacity)), innerCapacity(0), count(0) {
+    // An internal entry is a key and a child pointer, a leaf entry a key and an element.
+    size_t leafBytes = static_cast<size_t>(this->leafCapacity) * (sizeof(TKey) + sizeof(TElement));
+    innerCapacity = static_cast<int>(leafBytes / (sizeof(TKey) + sizeof(UnqPtr<Node>)));
+    innerCapacity = std::max(innerCapacity, MinimumCapacity);
+    root.reset(new Node(true, this->leafCapacity));
+}
+
+template<typename TKey, typename TElement>
+BPlusTree<TKey, TElement>::~BPlusTree() {
+}
+
+template<typename TKey, typename TElement>
+size_t BPlusTree<TKey, TElement>::GetCount() const {
+    return count;
+}
+
+template<typename TKey, typename TElement>
+size_t BPlusTree<TKey, TElement>::GetCapacity() const {
+    return count;
+}
+
+template<typename TKey, typename TElement>
+int BPlusTree<TKey, TElement>::GetLeafCapacity() const {
+    return leafCapacity;
+}
+
+template<typename TKey, typename TElement>
+int BPlusTree<TKey, TElement>::GetInnerCapacity() const {
+    return innerCapacity;
+}
+
+template<typename TKey, typename TElement>
+int BPlusTree<TKey, TElement>::GetHeight() const {
+    int height = 1;
+    for (const Node *x = root.get(); !x->isLeaf; x = x->children[0].get())
+        ++height;
+    return height;
+}
+
+template<typename TKey, typename TElement>
+bool BPlusTree<TKey, TElement>::IsFull(const Node *node) const {
+    return node->numKeys == (node->isLeaf ? leafCapacity : innerCapacity);
+}
+
+template<typename TKey, typename TElement>
+int BPlusTree<TKey, TElement>::MinimumKeys(const Node *node) const {
+    return (node->isLeaf ? leafCapacity : innerCapacity) / 2;
+}
+
+template<typename TKey, typename TElement>
+int BPlusTree<TKey, TElement>::LowerBound(const Node *node, const TKey &key) {
+    return KeySearch<TKey>::Rank(node->keys.get(), node->numKeys, key);
+}
+
+template<typename TKey, typename TElement>
+int BPlusTree<TKey, TElement>::ChildIndex(const Node *node, const TKey &key) {
+    // A key equal to a separator belongs to the right child, where the separator came from.
+    // Separators are distinct, so at most one key can be equal.
+    int i = KeySearch<TKey>::Rank(node->keys.get(), node->numKeys, key);
+    return i < node->numKeys && node->keys[i] == key ? i + 1 : i;
+}
+
+template<typename TKey, typename TElement>
+typename BPlusTree<TKey, TElement>::Node *BPlusTree<TKey, TElement>::FindLeaf(const TKey &key) const {
+    Node *x = root.get();
+    while (!x->isLeaf)
+        x = x->children[ChildIndex(x, key)].get();
+    return x;
+}
+
+template<typename TKey, typename TElement>
+TElement *BPlusTree<TKey, TElement>::FindValue(const TKey &key) const {
+    Node *leaf = FindLeaf(key);
+    int i = LowerBound(leaf, key);
+    if (i < leaf->numKeys && leaf->keys[i] == key)
+        return &leaf->values[i];
+    return nullptr;
+}
+
+template<typename TKey, typename TElement>
+TElement BPlusTree<TKey, TElement>::Get(const TKey &key) const {
+    TElement *value = FindValue(key);
+    if (!value)
+        throw std::runtime_error("Key not found.");
+    return *value;
+}
+
+template<typename TKey, typename TElement>
+bool BPlusTree<TKey, TElement>::ContainsKey(const TKey &key) const {
+    return FindValue(key) != nullptr;
+}
+
+template<typename TKey, typename TElement>
+std::optional<TElement> BPlusTree<TKey, TElement>::TryGet(const TKey &key) const {
+    TElement *value = FindValue(key);
+    if (!value)
+        return std::nullopt;
+    return *value;
+}
+
+template<typename TKey, typename TElement>
+TElement BPlusTree<TKey, TElement>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    TElement *value = FindValue(key);
+    return value ? *value : defaultValue;
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::Add(const TKey &key, const TElement &element) {
+    UpsertValue(key, element);
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::Add(const TKey &key, TElement &&element) {
+    UpsertValue(key, std::move(element));
+}
+
+template<typename TKey, typename TElement>
+bool BPlusTree<TKey, TElement>::Upsert(const TKey &key, const TElement &element) {
+    return UpsertValue(key, element);
+}
+
+template<typename TKey, typename TElement>
+bool BPlusTree<TKey, TElement>::Upsert(const TKey &key, TElement &&element) {
+    return UpsertValue(key, std::move(element));
+}
+
+template<typename TKey, typename TElement>
+template<typename... Args>
+void BPlusTree<TKey, TElement>::Emplace(const TKey &key, Args &&... args) {
+    UpsertValue(key, TElement(std::forward<Args>(args)...));
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::Update(const TKey &key, const TElement &element) {
+    UpdateValue(key, element);
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::Update(const TKey &key, TElement &&element) {
+    UpdateValue(key, std::move(element));
+}
+
+template<typename TKey, typename TElement>
+template<typename TValue>
+void BPlusTree<TKey, TElement>::UpdateValue(const TKey &key, TValue &&element) {
+    TElement *value = FindValue(key);
+    if (!value)
+        throw std::runtime_error("Key not found.");
+    *value = std::forward<TValue>(element);
+}
+
+template<typename TKey, typename TElement>
+template<typename TValue>
+bool BPlusTree<TKey, TElement>::UpsertValue(const TKey &key, TValue &&element) {
+    // As in BTree, full nodes are split on the way down even if the key exists already.
+    if (IsFull(root.get())) {
+        UnqPtr<Node> s(new Node(false, innerCapacity));
+        s->children[0] = std::move(root);
+        root = std::move(s);
+        SplitChild(root.get(), 0);
+    }
+
+    Node *x = root.get();
+    while (!x->isLeaf) {
+        int i = ChildIndex(x, key);
+        if (IsFull(x->children[i].get())) {
+            SplitChild(x, i);
+            if (!(key < x->keys[i]))
+                ++i;
+        }
+        x = x->children[i].get();
+    }
+
+    int i = LowerBound(x, key);
+    if (i < x->numKeys && x->keys[i] == key) {
+        x->values[i] = std::forward<TValue>(element);
+        return false;
+    }
+
+    for (int j = x->numKeys; j > i; --j) {
+        x->keys[j] = std::move(x->keys[j - 1]);
+        x->values[j] = std::move(x->values[j - 1]);
+    }
+    x->keys[i] = key;
+    x->values[i] = std::forward<TValue>(element);
+    ++x->numKeys;
+    ++count;
+    return true;
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::SplitChild(Node *x, int i) {
+    Node *y = x->children[i].get();
+    UnqPtr<Node> z(new Node(y->isLeaf, y->isLeaf ? leafCapacity : innerCapacity));
+    int mid = y->numKeys / 2;
+    TKey separator;
+
+    if (y->isLeaf) {
+        // The right half keeps its first key, which is copied up as the separator.
+        z->numKeys = y->numKeys - mid;
+        for (int j = 0; j < z->numKeys; ++j) {
+            z->keys[j] = std::move(y->keys[j + mid]);
+            z->values[j] = std::move(y->values[j + mid]);
+        }
+        z->next = y->next;
+        y->next = z.get();
+        separator = z->keys[0];
+    } else {
+        // The middle key moves up and neither half keeps it.
+        z->numKeys = y->numKeys - mid - 1;
+        for (int j = 0; j < z->numKeys; ++j)
+            z->keys[j] = std::move(y->keys[j + mid + 1]);
+        for (int j = 0; j <= z->numKeys; ++j)
+            z->children[j] = std::move(y->children[j + mid + 1]);
+        separator = std::move(y->keys[mid]);
+    }
+    y->numKeys = mid;
+
+    for (int j = x->numKeys; j > i; --j) {
+        x->keys[j] = std::move(x->keys[j - 1]);
+        x->children[j + 1] = std::move(x->children[j]);
+    }
+    x->keys[i] = std::move(separator);
+    x->children[i + 1] = std::move(z);
+    ++x->numKeys;
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::Remove(const TKey &key) {
+    if (!TryRemove(key))
+        throw std::runtime_error("Key not found.");
+}
+
+template<typename TKey, typename TElement>
+bool BPlusTree<TKey, TElement>::TryRemove(const TKey &key) {
+    if (!RemoveFromNode(root.get(), key))
+        return false;
+    --count;
+
+    if (!root->isLeaf && root->numKeys == 0) {
+        UnqPtr<Node> child = std::move(root->children[0]);
+        root = std::move(child);
+    }
+    return true;
+}
+
+template<typename TKey, typename TElement>
+bool BPlusTree<TKey, TElement>::RemoveFromNode(Node *x, const TKey &key) {
+    if (x->isLeaf) {
+        int i = LowerBound(x, key);
+        if (i == x->numKeys || !(x->keys[i] == key))
+            return false;
+        for (int j = i + 1; j < x->numKeys; ++j) {
+            x->keys[j - 1] = std::move(x->keys[j]);
+            x->values[j - 1] = std::move(x->values[j]);
+        }
+        --x->numKeys;
+        x->values[x->numKeys] = TElement();
+        return true;
+    }
+
+    // Separators are left as they are: a stale separator still routes keys correctly.
+    int i = ChildIndex(x, key);
+    if (!RemoveFromNode(x->children[i].get(), key))
+        return false;
+    if (x->children[i]->numKeys < MinimumKeys(x->children[i].get()))
+        Rebalance(x, i);
+    return true;
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::Rebalance(Node *x, int i) {
+    if (i > 0 && x->children[i - 1]->numKeys > MinimumKeys(x->children[i - 1].get()))
+        BorrowFromPrev(x, i);
+    else if (i < x->numKeys && x->children[i + 1]->numKeys > MinimumKeys(x->children[i + 1].get()))
+        BorrowFromNext(x, i);
+    else if (i < x->numKeys)
+        Merge(x, i);
+    else
+        Merge(x, i - 1);
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::BorrowFromPrev(Node *x, int i) {
+    Node *child = x->children[i].get();
+    Node *sibling = x->children[i - 1].get();
+
+    for (int j = child->numKeys; j > 0; --j)
+        child->keys[j] = std::move(child->keys[j - 1]);
+
+    if (child->isLeaf) {
+        for (int j = child->numKeys; j > 0; --j)
+            child->values[j] = std::move(child->values[j - 1]);
+        child->keys[0] = std::move(sibling->keys[sibling->numKeys - 1]);
+        child->values[0] = std::move(sibling->values[sibling->numKeys - 1]);
+        x->keys[i - 1] = child->keys[0];
+    } else {
+        for (int j = child->numKeys + 1; j > 0; --j)
+            child->children[j] = std::move(child->children[j - 1]);
+        child->keys[0] = std::move(x->keys[i - 1]);
+        child->children[0] = std::move(sibling->children[sibling->numKeys]);
+        x->keys[i - 1] = std::move(sibling->keys[sibling->numKeys - 1]);
+    }
+
+    ++child->numKeys;
+    --sibling->numKeys;
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::BorrowFromNext(Node *x, int i) {
+    Node *child = x->children[i].get();
+    Node *sibling = x->children[i + 1].get();
+
+    if (child->isLeaf) {
+        child->keys[child->numKeys] = std::move(sibling->keys[0]);
+        child->values[child->numKeys] = std::move(sibling->values[0]);
+        for (int j = 1; j < sibling->numKeys; ++j) {
+            sibling->keys[j - 1] = std::move(sibling->keys[j]);
+            sibling->values[j - 1] = std::move(sibling->values[j]);
+        }
+        x->keys[i] = sibling->keys[0];
+    } else {
+        child->keys[child->numKeys] = std::move(x->keys[i]);
+        child->children[child->numKeys + 1] = std::move(sibling->children[0]);
+        x->keys[i] = std::move(sibling->keys[0]);
+        for (int j = 1; j < sibling->numKeys; ++j)
+            sibling->keys[j - 1] = std::move(sibling->keys[j]);
+        for (int j = 1; j <= sibling->numKeys; ++j)
+            sibling->children[j - 1] = std::move(sibling->children[j]);
+    }
+
+    ++child->numKeys;
+    --sibling->numKeys;
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::Merge(Node *x, int i) {
+    Node *child = x->children[i].get();
+    Node *sibling = x->children[i + 1].get();
+
+    if (child->isLeaf) {
+        for (int j = 0; j < sibling->numKeys; ++j) {
+            child->keys[child->numKeys + j] = std::move(sibling->keys[j]);
+            child->values[child->numKeys + j] = std::move(sibling->values[j]);
+        }
+        child->numKeys += sibling->numKeys;
+        child->next = sibling->next;
+    } else {
+        // The separator comes down between the two halves.
+        child->keys[child->numKeys] = std::move(x->keys[i]);
+        for (int j = 0; j < sibling->numKeys; ++j)
+            child->keys[child->numKeys + 1 + j] = std::move(sibling->keys[j]);
+        for (int j = 0; j <= sibling->numKeys; ++j)
+            child->children[child->numKeys + 1 + j] = std::move(sibling->children[j]);
+        child->numKeys += sibling->numKeys + 1;
+    }
+
+    for (int j = i + 1; j < x->numKeys; ++j)
+        x->keys[j - 1] = std::move(x->keys[j]);
+    for (int j = i + 2; j <= x->numKeys; ++j)
+        x->children[j - 1] = std::move(x->children[j]);
+    x->children[x->numKeys].reset();
+    --x->numKeys;
+}
+
+template<typename TKey, typename TElement>
+BPlusTree<TKey, TElement>::BPlusTreeIterator::BPlusTreeIterator(const BPlusTree *tree, std::optional<TKey> lower,
+                                                             std::optional<TKey> upper)
+        : tree(tree), lower(std::move(lower)), upper(std::move(upper)), leaf(nullptr), index(0), started(false) {
+    Reset();
+}
+
+template<typename TKey, typename TElement>
+void BPlusTree<TKey, TElement>::BPlusTreeIterator::Reset() {
+    started = false;
+    if (lower) {
+        // The first key may be in a later leaf; MoveNext walks there along next.
+        leaf = tree->FindLeaf(*lower);
+        index = LowerBound(leaf, *lower);
+        return;
+    }
+    leaf = tree->root.get();
+    while (!leaf->isLeaf)
+        leaf = leaf->children[0].get();
+    index = 0;
+}
+
+template<typename TKey, typename TElement>
+bool BPlusTree<TKey, TElement>::BPlusTreeIterator::MoveNext() {
+    if (started && leaf)
+        ++index;
+    started = true;
+
+    while (leaf && index >= leaf->numKeys) {
+        leaf = leaf->next;
+        index = 0;
+    }
+    if (leaf && upper && !(leaf->keys[index] < *upper))
+        leaf = nullptr;
+    return leaf != nullptr;
+}
+
+template<typename TKey, typename TElement>
+TKey BPlusTree<TKey, TElement>::BPlusTreeIterator::GetCurrentKey() const {
+    if (!started || !leaf)
+        throw std::out_of_range("Iterator out of range");
+    return leaf->keys[index];
+}
+
+template<typename TKey, typename TElement>
+TElement BPlusTree<TKey, TElement>::BPlusTreeIterator::GetCurrentValue() const {
+    if (!started || !leaf)
+        throw std::out_of_range("Iterator out of range");
+    return leaf->values[index];
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> BPlusTree<TKey, TElement>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new BPlusTreeIterator(this));
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> BPlusTree<TKey, TElement>::SeekIterator(const TKey &key) const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new BPlusTreeIterator(this, key));
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> BPlusTree<TKey, TElement>::GetRange(const TKey &lower,
+                                                                                 const TKey &upper) const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new BPlusTreeIterator(this, lower, upper));
+}
+
+template<typename TKey, typename TElement>
+std::optional<TKey> BPlusTree<TKey, TElement>::LowerBound(const TKey &key) const {
+    const Node *leaf = FindLeaf(key);
+    int i = LowerBound(leaf, key);
+    while (leaf && i >= leaf->numKeys) {
+        leaf = leaf->next;
+        i = 0;
+    }
+    if (!leaf)
+        return std::nullopt;
+    return leaf->keys[i];
+}
+
+#endif // BPLUSTREE_H
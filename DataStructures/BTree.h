@@ -2,19 +2,36 @@
 #define BTREE_H
 
 #include "IDictionary.h"
-#include "ShrdPtr.h"
 #include "DynamicArraySmart.h"
 #include "UnqPtr.h"
+#include "Prefetch.h"
+#include "KeySearch.h"
+#include "NodeAllocator.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <optional>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
-template<typename TKey, typename TElement>
+// TAllocator supplies the node memory (see NodeAllocator.h); the default allocates every
+// node on the heap.
+template<typename TKey, typename TElement, typename TAllocator = HeapNodeAllocator>
 class BTree : public IDictionary<TKey, TElement> {
 public:
-    BTree(int order = 3);
+    // A node holds up to 2 * order - 1 keys. The default order is derived from the key
+    // size so that the keys of a node fill KeyLinesPerNode cache lines.
+    BTree(int order = DefaultOrder, TAllocator allocator = TAllocator());
 
     virtual ~BTree();
 
+    BTree(const BTree &) = delete;
+
+    BTree &operator=(const BTree &) = delete;
+
     virtual size_t GetCount() const override;
 
     virtual size_t GetCapacity() const override;
@@ -27,54 +44,207 @@ public:
 
     virtual void Remove(const TKey &key) override;
 
+    // Removes key in one descent, refilling nodes on the way down, and reports whether it
+    // was present. A missing key may still leave the tree rebalanced, never invalid.
+    virtual bool TryRemove(const TKey &key) override;
+
     virtual void Update(const TKey &key, const TElement &element) override;
 
     virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
 
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    // Splits full nodes on the way down and inserts or overwrites in the same descent.
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    virtual void ContainsMany(const TKey *keys, size_t count, bool *results) const override;
+
+    virtual size_t GetMany(const TKey *keys, size_t count, TElement *values, bool *found) const override;
+
+    // Inserts the pairs in key order so consecutive inserts walk the same path.
+    virtual void AddRange(const TKey *keys, const TElement *elements, size_t count) override;
+
+    // An empty tree is bulk-loaded with BuildFromSorted; otherwise the same as AddRange.
+    virtual void AddSorted(const TKey *keys, const TElement *elements, size_t count) override;
+
+    // Replaces the contents with the keys of [firstKey, lastKey), which must be strictly
+    // ascending, and the elements that start at firstElement. Leaves are packed left to
+    // right with about fillFactor * (2 * order - 1) keys each, and every upper level is
+    // built from the separators of the level below, so nothing is searched or split.
+    // A fillFactor below 1 leaves room in each node for later inserts.
+    template<typename TKeyIterator, typename TElementIterator>
+    void BuildFromSorted(TKeyIterator firstKey, TKeyIterator lastKey, TElementIterator firstElement,
+                         double fillFactor = 1.0);
+
+    virtual void Add(const TKey &key, TElement &&element) override;
+
+    virtual void Update(const TKey &key, TElement &&element) override;
+
+    virtual bool Upsert(const TKey &key, TElement &&element) override;
+
+    // Node slots already hold default-constructed elements, so the new element is built
+    // once and moved into its slot.
+    template<typename... Args>
+    void Emplace(const TKey &key, Args &&... args);
+
+    // Iterates over lower <= key < upper in ascending order; positioning costs one descent.
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetRange(const TKey &lower, const TKey &upper) const override;
+
+    // The smallest key that is not less than key, or nullopt if there is none.
+    std::optional<TKey> LowerBound(const TKey &key) const;
+
+    // Iterates in ascending order from the first key that is not less than key.
+    UnqPtr<IDictionaryIterator<TKey, TElement>> SeekIterator(const TKey &key) const;
+
+    // Returns a read-only copy of the tree in O(1): it shares every node with this tree,
+    // and from then on whichever of the two changes a shared node first copies the path
+    // from the root down to it. One thread may keep writing to this tree while others read
+    // the snapshot without locks, as long as Snapshot itself is called by the writer.
+    UnqPtr<const BTree> Snapshot() const;
+
+    // Bytes of all nodes reachable from the root, counting shared nodes in full.
+    size_t GetMemoryUsage() const;
+
+    // The part of GetMemoryUsage in nodes that are also reachable from another tree.
+    size_t GetSharedMemoryUsage() const;
+
+    // Removes every entry. With an arena allocator, keys and elements that need no
+    // destructor and no snapshot alive, the arena's chunks are freed without visiting a node.
+    void Clear();
+
+    int GetOrder() const;
+
 private:
+    static constexpr size_t KeyLinesPerNode = 4;
+    static constexpr int DefaultOrder =
+            std::max<int>(2, static_cast<int>((KeyLinesPerNode * CacheLineSize / sizeof(TKey) + 1) / 2));
+
+    // A node is one cache-line-aligned allocation: this header, then the keys, the
+    // elements and, in internal nodes only, the child pointers. Nodes are created with
+    // CreateNode and counted by the parents and trees that point to them; a count above
+    // one means a snapshot shares the node, so it is copied before it is changed.
     struct Node {
+        std::atomic<int> refCount;
         bool isLeaf;
         int numKeys;
-        UnqPtr<TKey[]> keys;
-        UnqPtr<TElement[]> values;
-        UnqPtr<ShrdPtr<Node>[]> children;
-
-        Node(bool leaf, int order);
     };
 
-    ShrdPtr<Node> root;
+    // The keys start right after the header, at an offset fixed by the types alone, so a
+    // search finds them without a dependent load. The other offsets depend on the order.
+    static constexpr size_t KeysOffset = (sizeof(Node) + alignof(TKey) - 1) / alignof(TKey) * alignof(TKey);
+
+    [[no_unique_address]] TAllocator allocator;
+    Node *root;
     int order;
     size_t count;
+    // Byte offsets of the elements and children inside a node and the sizes of both node kinds.
+    size_t valuesOffset;
+    size_t childrenOffset;
+    size_t leafSize;
+    size_t internalSize;
+
+    static TKey *Keys(Node *node) {
+        return reinterpret_cast<TKey *>(reinterpret_cast<char *>(node) + KeysOffset);
+    }
 
-    void SplitChild(ShrdPtr<Node> x, int i);
+    static const TKey *Keys(const Node *node) {
+        return reinterpret_cast<const TKey *>(reinterpret_cast<const char *>(node) + KeysOffset);
+    }
+
+    TElement *Values(Node *node) const {
+        return reinterpret_cast<TElement *>(reinterpret_cast<char *>(node) + valuesOffset);
+    }
 
-    void InsertNonFull(ShrdPtr<Node> x, const TKey &key, const TElement &value);
+    const TElement *Values(const Node *node) const {
+        return reinterpret_cast<const TElement *>(reinterpret_cast<const char *>(node) + valuesOffset);
+    }
 
-    TElement Search(ShrdPtr<Node> x, const TKey &key) const;
+    // Valid in internal nodes only.
+    Node **Children(Node *node) const {
+        return reinterpret_cast<Node **>(reinterpret_cast<char *>(node) + childrenOffset);
+    }
+
+    Node *const *Children(const Node *node) const {
+        return reinterpret_cast<Node *const *>(reinterpret_cast<const char *>(node) + childrenOffset);
+    }
 
-    bool Contains(ShrdPtr<Node> x, const TKey &key) const;
+    Node *CreateNode(bool leaf);
 
-    void RemoveFromNode(ShrdPtr<Node> x, const TKey &key);
+    void DestroyNode(Node *node);
+
+    // Drops one reference to node, freeing it and releasing its children once none is left.
+    void Release(Node *node);
+
+    // Frees the whole tree, leaving root dangling; see Clear.
+    void ReleaseTree();
+
+    // A private copy of node that shares its children, which gain a reference each.
+    Node *CloneNode(const Node *node);
+
+    // Makes the node in slot safe to change: a shared node is replaced by a private copy.
+    // Callers work top-down, so the node holding slot is already private.
+    Node *MakeWritable(Node *&slot);
+
+    struct SnapshotTag {
+    };
 
-    void RemoveFromLeaf(ShrdPtr<Node> x, int idx);
+    // Shares the nodes of source; used by Snapshot.
+    BTree(const BTree &source, SnapshotTag);
 
-    void RemoveFromNonLeaf(ShrdPtr<Node> x, int idx);
+    size_t MemoryUsage(const Node *node, bool sharedOnly, bool shared) const;
 
-    TKey GetPredecessor(ShrdPtr<Node> x, int idx);
+    // Keys descended together by the batch lookups.
+    static const size_t BatchSize = 16;
 
-    TKey GetSuccessor(ShrdPtr<Node> x, int idx);
+    // Walks a group of keys down the tree one level at a time, prefetching every next node
+    // before any of them is searched. nodes[i] ends up as the node holding keys[i] at
+    // indices[i], or nullptr if the key is absent.
+    void LocateGroup(const TKey *keys, size_t count, const Node **nodes, int *indices) const;
 
-    void Fill(ShrdPtr<Node> x, int idx);
+    void SplitChild(Node *x, int i);
 
-    void BorrowFromPrev(ShrdPtr<Node> x, int idx);
+    // Number of nodes a bulk-loaded level spreads items keys over, with one key between
+    // neighbours moving up to the next level. Nodes get targetKeys keys where that leaves
+    // every node at least order - 1 of them.
+    size_t LevelWidth(size_t items, int targetKeys) const;
 
-    void BorrowFromNext(ShrdPtr<Node> x, int idx);
+    // Shared by the copying and moving overloads; element is forwarded into its slot.
+    template<typename TValue>
+    bool UpsertValue(const TKey &key, TValue &&element);
 
-    void Merge(ShrdPtr<Node> x, int idx);
+    template<typename TValue>
+    void UpdateValue(const TKey &key, TValue &&element);
+
+    // Returns the node holding key and its position in index, or nullptr if it is absent.
+    const Node *FindNode(const TKey &key, int &index) const;
+
+    // Returns false if key is not in the subtree under x.
+    bool RemoveFromNode(Node *x, const TKey &key);
+
+    void RemoveFromLeaf(Node *x, int idx);
+
+    void RemoveFromNonLeaf(Node *x, int idx);
+
+    // The leaves holding the last key of child idx and the first key of child idx + 1.
+    Node *GetPredecessor(Node *x, int idx);
+
+    Node *GetSuccessor(Node *x, int idx);
+
+    void Fill(Node *x, int idx);
+
+    void BorrowFromPrev(Node *x, int idx);
+
+    void BorrowFromNext(Node *x, int idx);
+
+    void Merge(Node *x, int idx);
 
     class BTreeIterator : public IDictionaryIterator<TKey, TElement> {
     public:
-        BTreeIterator(const BTree *tree);
+        // Without bounds the iterator covers the whole tree.
+        BTreeIterator(const BTree *tree, std::optional<TKey> lower = std::nullopt,
+                      std::optional<TKey> upper = std::nullopt);
 
         virtual ~BTreeIterator() {}
 
@@ -88,8 +258,10 @@ private:
 
     private:
         const BTree *tree;
+        std::optional<TKey> lower;
+        std::optional<TKey> upper;
         struct StackNode {
-            ShrdPtr<Node> node;
+            const Node *node;
             int index;
         };
         DynamicArraySmart<StackNode> stack;
@@ -97,279 +269,468 @@ private:
         TElement currentValue;
         bool hasCurrent;
 
-        void PushLeftmost(ShrdPtr<Node> node);
+        void PushLeftmost(const Node *node);
+
+        // Pushes the path to the first key not less than key, as if the iterator had
+        // already yielded every smaller key.
+        void Seek(const TKey &key);
     };
 
     friend class BTreeTest;
 
 public:
-    void PrintStructure(ShrdPtr<Node> node = ShrdPtr<Node>(), int depth = 0) const {
-        auto currentNode = node ? node : root;
+    void PrintStructure(const Node *node = nullptr, int depth = 0) const {
+        const Node *currentNode = node ? node : root;
         if (!currentNode) return;
 
         for (int i = 0; i < depth; ++i) std::cout << "  ";
         std::cout << "[";
         for (int i = 0; i < currentNode->numKeys; ++i) {
             if (i > 0) std::cout << ", ";
-            std::cout << currentNode->keys[i];
+            std::cout << Keys(currentNode)[i];
         }
         std::cout << "]\n";
 
         if (!currentNode->isLeaf) {
             for (int i = 0; i <= currentNode->numKeys; ++i) {
-                PrintStructure(currentNode->children[i], depth + 1);
+                PrintStructure(Children(currentNode)[i], depth + 1);
             }
         }
     }
 };
 
-template<typename TKey, typename TElement>
-BTree<TKey, TElement>::Node::Node(bool leaf, int order)
-        : isLeaf(leaf), numKeys(0), keys(new TKey[2 * order - 1]), values(new TElement[2 * order - 1]),
-          children(new ShrdPtr<Node>[2 * order]) {
+template<typename TKey, typename TElement, typename TAllocator>
+BTree<TKey, TElement, TAllocator>::BTree(int order, TAllocator allocator)
+        : allocator(std::move(allocator)), root(nullptr), order(std::max(order, 2)), count(0), valuesOffset(0),
+          childrenOffset(0), leafSize(0), internalSize(0) {
+    auto alignUp = [](size_t offset, size_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    };
+    size_t maxKeys = 2 * this->order - 1;
+    valuesOffset = alignUp(KeysOffset + maxKeys * sizeof(TKey), alignof(TElement));
+    childrenOffset = alignUp(valuesOffset + maxKeys * sizeof(TElement), alignof(Node *));
+    leafSize = childrenOffset;
+    internalSize = childrenOffset + (maxKeys + 1) * sizeof(Node *);
+    root = CreateNode(true);
 }
 
-template<typename TKey, typename TElement>
-BTree<TKey, TElement>::BTree(int order)
-        : root(new Node(true, order)), order(order), count(0) {
+template<typename TKey, typename TElement, typename TAllocator>
+BTree<TKey, TElement, TAllocator>::BTree(const BTree &source, SnapshotTag)
+        : allocator(source.allocator.Share()), root(source.root), order(source.order), count(source.count),
+          valuesOffset(source.valuesOffset), childrenOffset(source.childrenOffset),
+          leafSize(source.leafSize), internalSize(source.internalSize) {
+    root->refCount.fetch_add(1, std::memory_order_relaxed);
 }
 
-template<typename TKey, typename TElement>
-BTree<TKey, TElement>::~BTree() {
+template<typename TKey, typename TElement, typename TAllocator>
+BTree<TKey, TElement, TAllocator>::~BTree() {
+    ReleaseTree();
 }
 
-template<typename TKey, typename TElement>
-size_t BTree<TKey, TElement>::GetCount() const {
-    return count;
+template<typename TKey, typename TElement, typename TAllocator>
+typename BTree<TKey, TElement, TAllocator>::Node *BTree<TKey, TElement, TAllocator>::CreateNode(bool leaf) {
+    size_t maxKeys = 2 * order - 1;
+    char *memory = static_cast<char *>(allocator.Allocate(leaf ? leafSize : internalSize, CacheLineSize));
+    Node *node = new(memory) Node();
+    node->refCount.store(1, std::memory_order_relaxed);
+    node->isLeaf = leaf;
+    node->numKeys = 0;
+    std::uninitialized_value_construct_n(Keys(node), maxKeys);
+    std::uninitialized_value_construct_n(Values(node), maxKeys);
+    if (!leaf) {
+        std::uninitialized_value_construct_n(Children(node), maxKeys + 1);
+    }
+    return node;
 }
 
-template<typename TKey, typename TElement>
-size_t BTree<TKey, TElement>::GetCapacity() const {
-    return count;
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::DestroyNode(Node *node) {
+    size_t maxKeys = 2 * order - 1;
+    size_t size = node->isLeaf ? leafSize : internalSize;
+    std::destroy_n(Keys(node), maxKeys);
+    std::destroy_n(Values(node), maxKeys);
+    node->~Node();
+    allocator.Deallocate(node, size, CacheLineSize);
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::Add(const TKey &key, const TElement &element) {
-    if (ContainsKey(key)) {
-        Update(key, element);
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::Release(Node *node) {
+    // acq_rel: whoever frees the node must see every change made to it by other owners.
+    if (node->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
         return;
+    if (!node->isLeaf) {
+        for (int i = 0; i <= node->numKeys; ++i)
+            Release(Children(node)[i]);
     }
+    DestroyNode(node);
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::ReleaseTree() {
+    // Nodes whose contents need no destructor can simply be dropped with their chunks.
+    bool trivial = std::is_trivially_destructible_v<TKey> && std::is_trivially_destructible_v<TElement>;
+    if (!trivial || !allocator.TryReleaseAll())
+        Release(root);
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::Clear() {
+    ReleaseTree();
+    root = CreateNode(true);
+    count = 0;
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+typename BTree<TKey, TElement, TAllocator>::Node *BTree<TKey, TElement, TAllocator>::CloneNode(const Node *node) {
+    Node *copy = CreateNode(node->isLeaf);
+    copy->numKeys = node->numKeys;
+    std::copy(Keys(node), Keys(node) + node->numKeys, Keys(copy));
+    std::copy(Values(node), Values(node) + node->numKeys, Values(copy));
+    if (!node->isLeaf) {
+        for (int i = 0; i <= node->numKeys; ++i) {
+            Children(copy)[i] = Children(node)[i];
+            Children(copy)[i]->refCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return copy;
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+typename BTree<TKey, TElement, TAllocator>::Node *BTree<TKey, TElement, TAllocator>::MakeWritable(Node *&slot) {
+    // A count of one cannot grow behind the writer's back: only this tree's owner takes
+    // snapshots. acquire pairs with the release of a snapshot that just let go.
+    if (slot->refCount.load(std::memory_order_acquire) != 1) {
+        Node *copy = CloneNode(slot);
+        Release(slot);
+        slot = copy;
+    }
+    return slot;
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+UnqPtr<const BTree<TKey, TElement, TAllocator>> BTree<TKey, TElement, TAllocator>::Snapshot() const {
+    return UnqPtr<const BTree>(new BTree(*this, SnapshotTag()));
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+size_t BTree<TKey, TElement, TAllocator>::MemoryUsage(const Node *node, bool sharedOnly, bool shared) const {
+    shared = shared || node->refCount.load(std::memory_order_relaxed) > 1;
+    size_t bytes = !sharedOnly || shared ? (node->isLeaf ? leafSize : internalSize) : 0;
+    if (!node->isLeaf) {
+        for (int i = 0; i <= node->numKeys; ++i)
+            bytes += MemoryUsage(Children(node)[i], sharedOnly, shared);
+    }
+    return bytes;
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+size_t BTree<TKey, TElement, TAllocator>::GetMemoryUsage() const {
+    return sizeof(BTree) + MemoryUsage(root, false, false);
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+size_t BTree<TKey, TElement, TAllocator>::GetSharedMemoryUsage() const {
+    return MemoryUsage(root, true, false);
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+int BTree<TKey, TElement, TAllocator>::GetOrder() const {
+    return order;
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+size_t BTree<TKey, TElement, TAllocator>::GetCount() const {
+    return count;
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+size_t BTree<TKey, TElement, TAllocator>::GetCapacity() const {
+    return count;
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::Add(const TKey &key, const TElement &element) {
+    UpsertValue(key, element);
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::Add(const TKey &key, TElement &&element) {
+    UpsertValue(key, std::move(element));
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+template<typename... Args>
+void BTree<TKey, TElement, TAllocator>::Emplace(const TKey &key, Args &&... args) {
+    UpsertValue(key, TElement(std::forward<Args>(args)...));
+}
 
+template<typename TKey, typename TElement, typename TAllocator>
+bool BTree<TKey, TElement, TAllocator>::Upsert(const TKey &key, const TElement &element) {
+    return UpsertValue(key, element);
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+bool BTree<TKey, TElement, TAllocator>::Upsert(const TKey &key, TElement &&element) {
+    return UpsertValue(key, std::move(element));
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+template<typename TValue>
+bool BTree<TKey, TElement, TAllocator>::UpsertValue(const TKey &key, TValue &&element) {
+    // A full node is split even when the key turns out to exist already; the extra split
+    // keeps the tree valid and saves a separate lookup before every insert.
+    MakeWritable(root);
     if (root->numKeys == 2 * order - 1) {
-        ShrdPtr<Node> s(new Node(false, order));
-        s->children[0] = root;
+        Node *s = CreateNode(false);
+        Children(s)[0] = root;
         SplitChild(s, 0);
         root = s;
     }
 
-    InsertNonFull(root, key, element);
-    ++count;
-}
+    Node *x = root;
+    while (true) {
+        int i = KeySearch<TKey>::Rank(Keys(x), x->numKeys, key);
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::InsertNonFull(ShrdPtr<Node> x, const TKey &key, const TElement &value) {
-    int i = x->numKeys - 1;
+        if (i < x->numKeys && key == Keys(x)[i]) {
+            Values(x)[i] = std::forward<TValue>(element);
+            return false;
+        }
 
-    if (x->isLeaf) {
-        while (i >= 0 && key < x->keys[i]) {
-            x->keys[i + 1] = x->keys[i];
-            x->values[i + 1] = x->values[i];
-            --i;
+        if (x->isLeaf) {
+            for (int j = x->numKeys; j > i; --j) {
+                Keys(x)[j] = Keys(x)[j - 1];
+                Values(x)[j] = std::move(Values(x)[j - 1]);
+            }
+            Keys(x)[i] = key;
+            Values(x)[i] = std::forward<TValue>(element);
+            ++x->numKeys;
+            ++count;
+            return true;
         }
-        x->keys[i + 1] = key;
-        x->values[i + 1] = value;
-        ++x->numKeys;
-    } else {
-        while (i >= 0 && key < x->keys[i])
-            --i;
-        ++i;
-        if (x->children[i]->numKeys == 2 * order - 1) {
+
+        if (Children(x)[i]->numKeys == 2 * order - 1) {
+            MakeWritable(Children(x)[i]);
             SplitChild(x, i);
-            if (key > x->keys[i])
+            if (key == Keys(x)[i]) {
+                Values(x)[i] = std::forward<TValue>(element);
+                return false;
+            }
+            if (key > Keys(x)[i])
                 ++i;
         }
-        InsertNonFull(x->children[i], key, value);
+        x = MakeWritable(Children(x)[i]);
     }
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::SplitChild(ShrdPtr<Node> x, int i) {
-    ShrdPtr<Node> y = x->children[i];
-    ShrdPtr<Node> z(new Node(y->isLeaf, order));
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::SplitChild(Node *x, int i) {
+    Node *y = Children(x)[i];
+    Node *z = CreateNode(y->isLeaf);
     z->numKeys = order - 1;
 
     for (int j = 0; j < order - 1; ++j) {
-        z->keys[j] = y->keys[j + order];
-        z->values[j] = y->values[j + order];
+        Keys(z)[j] = Keys(y)[j + order];
+        Values(z)[j] = std::move(Values(y)[j + order]);
     }
 
     if (!y->isLeaf) {
         for (int j = 0; j < order; ++j)
-            z->children[j] = y->children[j + order];
+            Children(z)[j] = Children(y)[j + order];
     }
 
     y->numKeys = order - 1;
 
     for (int j = x->numKeys; j >= i + 1; --j)
-        x->children[j + 1] = x->children[j];
-    x->children[i + 1] = z;
+        Children(x)[j + 1] = Children(x)[j];
+    Children(x)[i + 1] = z;
 
     for (int j = x->numKeys - 1; j >= i; --j) {
-        x->keys[j + 1] = x->keys[j];
-        x->values[j + 1] = x->values[j];
+        Keys(x)[j + 1] = Keys(x)[j];
+        Values(x)[j + 1] = std::move(Values(x)[j]);
     }
-    x->keys[i] = y->keys[order - 1];
-    x->values[i] = y->values[order - 1];
+    Keys(x)[i] = Keys(y)[order - 1];
+    Values(x)[i] = std::move(Values(y)[order - 1]);
     ++x->numKeys;
 }
 
-template<typename TKey, typename TElement>
-TElement BTree<TKey, TElement>::Get(const TKey &key) const {
-    return Search(root, key);
-}
+template<typename TKey, typename TElement, typename TAllocator>
+const typename BTree<TKey, TElement, TAllocator>::Node *
+BTree<TKey, TElement, TAllocator>::FindNode(const TKey &key, int &index) const {
+    const Node *x = root;
+    while (true) {
+        int i = KeySearch<TKey>::Rank(Keys(x), x->numKeys, key);
 
-template<typename TKey, typename TElement>
-TElement BTree<TKey, TElement>::Search(ShrdPtr<Node> x, const TKey &key) const {
-    int i = 0;
-    while (i < x->numKeys && key > x->keys[i])
-        ++i;
+        if (i < x->numKeys && key == Keys(x)[i]) {
+            index = i;
+            return x;
+        }
 
-    if (i < x->numKeys && key == x->keys[i])
-        return x->values[i];
+        if (x->isLeaf)
+            return nullptr;
 
-    if (x->isLeaf)
+        x = Children(x)[i];
+    }
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+TElement BTree<TKey, TElement, TAllocator>::Get(const TKey &key) const {
+    int index;
+    const Node *x = FindNode(key, index);
+    if (!x)
         throw std::runtime_error("Key not found.");
-    else
-        return Search(x->children[i], key);
+    return Values(x)[index];
 }
 
-template<typename TKey, typename TElement>
-bool BTree<TKey, TElement>::ContainsKey(const TKey &key) const {
-    try {
-        Search(root, key);
-        return true;
-    }
-    catch (const std::runtime_error &) {
-        return false;
-    }
+template<typename TKey, typename TElement, typename TAllocator>
+bool BTree<TKey, TElement, TAllocator>::ContainsKey(const TKey &key) const {
+    int index;
+    return FindNode(key, index) != nullptr;
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::Update(const TKey &key, const TElement &element) {
-    ShrdPtr<Node> x = root;
+template<typename TKey, typename TElement, typename TAllocator>
+std::optional<TElement> BTree<TKey, TElement, TAllocator>::TryGet(const TKey &key) const {
+    int index;
+    const Node *x = FindNode(key, index);
+    if (!x)
+        return std::nullopt;
+    return Values(x)[index];
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+TElement BTree<TKey, TElement, TAllocator>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    int index;
+    const Node *x = FindNode(key, index);
+    return x ? Values(x)[index] : defaultValue;
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::Update(const TKey &key, const TElement &element) {
+    UpdateValue(key, element);
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::Update(const TKey &key, TElement &&element) {
+    UpdateValue(key, std::move(element));
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+template<typename TValue>
+void BTree<TKey, TElement, TAllocator>::UpdateValue(const TKey &key, TValue &&element) {
+    Node *x = MakeWritable(root);
     while (true) {
-        int i = 0;
-        while (i < x->numKeys && key > x->keys[i])
-            ++i;
+        int i = KeySearch<TKey>::Rank(Keys(x), x->numKeys, key);
 
-        if (i < x->numKeys && key == x->keys[i]) {
-            x->values[i] = element;
+        if (i < x->numKeys && key == Keys(x)[i]) {
+            Values(x)[i] = std::forward<TValue>(element);
             return;
         }
 
         if (x->isLeaf)
             throw std::runtime_error("Key not found.");
 
-        x = x->children[i];
+        x = MakeWritable(Children(x)[i]);
     }
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::Remove(const TKey &key) {
-    if (!ContainsKey(key))
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::Remove(const TKey &key) {
+    if (!TryRemove(key))
         throw std::runtime_error("Key not found.");
+}
 
-    RemoveFromNode(root, key);
-    --count;
-
-    if (root->numKeys == 0) {
-        if (root->isLeaf) {
-            root.reset(new Node(true, order));
-        } else {
-            root = root->children[0];
-        }
+template<typename TKey, typename TElement, typename TAllocator>
+bool BTree<TKey, TElement, TAllocator>::TryRemove(const TKey &key) {
+    bool removed = RemoveFromNode(MakeWritable(root), key);
+    if (removed)
+        --count;
+
+    // Merges on the way down can empty the root even when the key was missing.
+    if (root->numKeys == 0 && !root->isLeaf) {
+        Node *oldRoot = root;
+        root = Children(root)[0];
+        DestroyNode(oldRoot);
     }
+    return removed;
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::RemoveFromNode(ShrdPtr<Node> x, const TKey &key) {
-    int idx = 0;
-    while (idx < x->numKeys && x->keys[idx] < key)
-        ++idx;
+template<typename TKey, typename TElement, typename TAllocator>
+bool BTree<TKey, TElement, TAllocator>::RemoveFromNode(Node *x, const TKey &key) {
+    int idx = KeySearch<TKey>::Rank(Keys(x), x->numKeys, key);
 
-    if (idx < x->numKeys && x->keys[idx] == key) {
+    if (idx < x->numKeys && Keys(x)[idx] == key) {
         if (x->isLeaf)
             RemoveFromLeaf(x, idx);
         else
             RemoveFromNonLeaf(x, idx);
-    } else {
-        if (x->isLeaf)
-            throw std::runtime_error("Key not found.");
+        return true;
+    }
 
-        bool flag = ((idx == x->numKeys));
+    if (x->isLeaf)
+        return false;
 
-        if (x->children[idx]->numKeys < order)
-            Fill(x, idx);
+    bool flag = ((idx == x->numKeys));
 
-        if (flag && idx > x->numKeys)
-            RemoveFromNode(x->children[idx - 1], key);
-        else
-            RemoveFromNode(x->children[idx], key);
-    }
+    if (Children(x)[idx]->numKeys < order)
+        Fill(x, idx);
+
+    if (flag && idx > x->numKeys)
+        return RemoveFromNode(MakeWritable(Children(x)[idx - 1]), key);
+    return RemoveFromNode(MakeWritable(Children(x)[idx]), key);
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::RemoveFromLeaf(ShrdPtr<Node> x, int idx) {
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::RemoveFromLeaf(Node *x, int idx) {
     for (int i = idx + 1; i < x->numKeys; ++i) {
-        x->keys[i - 1] = x->keys[i];
-        x->values[i - 1] = x->values[i];
+        Keys(x)[i - 1] = Keys(x)[i];
+        Values(x)[i - 1] = std::move(Values(x)[i]);
     }
     --x->numKeys;
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::RemoveFromNonLeaf(ShrdPtr<Node> x, int idx) {
-    TKey k = x->keys[idx];
-
-    if (x->children[idx]->numKeys >= order) {
-        TKey predKey = GetPredecessor(x, idx);
-        TElement predValue = x->values[idx];
-        x->keys[idx] = predKey;
-        x->values[idx] = predValue;
-        RemoveFromNode(x->children[idx], predKey);
-    } else if (x->children[idx + 1]->numKeys >= order) {
-        TKey succKey = GetSuccessor(x, idx);
-        TElement succValue = x->values[idx];
-        x->keys[idx] = succKey;
-        x->values[idx] = succValue;
-        RemoveFromNode(x->children[idx + 1], succKey);
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::RemoveFromNonLeaf(Node *x, int idx) {
+    TKey k = Keys(x)[idx];
+
+    // The predecessor or successor takes the removed pair's place along with its element.
+    // The element is copied, not moved, since its leaf may still be shared with a snapshot;
+    // the recursive call then removes the original.
+    if (Children(x)[idx]->numKeys >= order) {
+        const Node *pred = GetPredecessor(x, idx);
+        Keys(x)[idx] = Keys(pred)[pred->numKeys - 1];
+        Values(x)[idx] = Values(pred)[pred->numKeys - 1];
+        RemoveFromNode(MakeWritable(Children(x)[idx]), Keys(x)[idx]);
+    } else if (Children(x)[idx + 1]->numKeys >= order) {
+        const Node *succ = GetSuccessor(x, idx);
+        Keys(x)[idx] = Keys(succ)[0];
+        Values(x)[idx] = Values(succ)[0];
+        RemoveFromNode(MakeWritable(Children(x)[idx + 1]), Keys(x)[idx]);
     } else {
         Merge(x, idx);
-        RemoveFromNode(x->children[idx], k);
+        RemoveFromNode(Children(x)[idx], k);
     }
 }
 
-template<typename TKey, typename TElement>
-TKey BTree<TKey, TElement>::GetPredecessor(ShrdPtr<Node> x, int idx) {
-    ShrdPtr<Node> cur = x->children[idx];
+template<typename TKey, typename TElement, typename TAllocator>
+typename BTree<TKey, TElement, TAllocator>::Node *BTree<TKey, TElement, TAllocator>::GetPredecessor(Node *x, int idx) {
+    Node *cur = Children(x)[idx];
     while (!cur->isLeaf)
-        cur = cur->children[cur->numKeys];
-    return cur->keys[cur->numKeys - 1];
+        cur = Children(cur)[cur->numKeys];
+    return cur;
 }
 
-template<typename TKey, typename TElement>
-TKey BTree<TKey, TElement>::GetSuccessor(ShrdPtr<Node> x, int idx) {
-    ShrdPtr<Node> cur = x->children[idx + 1];
+template<typename TKey, typename TElement, typename TAllocator>
+typename BTree<TKey, TElement, TAllocator>::Node *BTree<TKey, TElement, TAllocator>::GetSuccessor(Node *x, int idx) {
+    Node *cur = Children(x)[idx + 1];
     while (!cur->isLeaf)
-        cur = cur->children[0];
-    return cur->keys[0];
+        cur = Children(cur)[0];
+    return cur;
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::Fill(ShrdPtr<Node> x, int idx) {
-    if (idx != 0 && x->children[idx - 1]->numKeys >= order)
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::Fill(Node *x, int idx) {
+    if (idx != 0 && Children(x)[idx - 1]->numKeys >= order)
         BorrowFromPrev(x, idx);
-    else if (idx != x->numKeys && x->children[idx + 1]->numKeys >= order)
+    else if (idx != x->numKeys && Children(x)[idx + 1]->numKeys >= order)
         BorrowFromNext(x, idx);
     else {
         if (idx != x->numKeys)
@@ -379,122 +740,320 @@ void BTree<TKey, TElement>::Fill(ShrdPtr<Node> x, int idx) {
     }
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::BorrowFromPrev(ShrdPtr<Node> x, int idx) {
-    ShrdPtr<Node> child = x->children[idx];
-    ShrdPtr<Node> sibling = x->children[idx - 1];
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::BorrowFromPrev(Node *x, int idx) {
+    Node *child = MakeWritable(Children(x)[idx]);
+    Node *sibling = MakeWritable(Children(x)[idx - 1]);
 
     for (int i = child->numKeys - 1; i >= 0; --i) {
-        child->keys[i + 1] = child->keys[i];
-        child->values[i + 1] = child->values[i];
+        Keys(child)[i + 1] = Keys(child)[i];
+        Values(child)[i + 1] = std::move(Values(child)[i]);
     }
 
     if (!child->isLeaf) {
         for (int i = child->numKeys; i >= 0; --i)
-            child->children[i + 1] = child->children[i];
+            Children(child)[i + 1] = Children(child)[i];
     }
 
-    child->keys[0] = x->keys[idx - 1];
-    child->values[0] = x->values[idx - 1];
+    Keys(child)[0] = Keys(x)[idx - 1];
+    Values(child)[0] = std::move(Values(x)[idx - 1]);
 
     if (!child->isLeaf)
-        child->children[0] = sibling->children[sibling->numKeys];
+        Children(child)[0] = Children(sibling)[sibling->numKeys];
 
-    x->keys[idx - 1] = sibling->keys[sibling->numKeys - 1];
-    x->values[idx - 1] = sibling->values[sibling->numKeys - 1];
+    Keys(x)[idx - 1] = Keys(sibling)[sibling->numKeys - 1];
+    Values(x)[idx - 1] = std::move(Values(sibling)[sibling->numKeys - 1]);
 
     ++child->numKeys;
     --sibling->numKeys;
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::BorrowFromNext(ShrdPtr<Node> x, int idx) {
-    ShrdPtr<Node> child = x->children[idx];
-    ShrdPtr<Node> sibling = x->children[idx + 1];
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::BorrowFromNext(Node *x, int idx) {
+    Node *child = MakeWritable(Children(x)[idx]);
+    Node *sibling = MakeWritable(Children(x)[idx + 1]);
 
-    child->keys[child->numKeys] = x->keys[idx];
-    child->values[child->numKeys] = x->values[idx];
+    Keys(child)[child->numKeys] = Keys(x)[idx];
+    Values(child)[child->numKeys] = std::move(Values(x)[idx]);
 
     if (!child->isLeaf)
-        child->children[child->numKeys + 1] = sibling->children[0];
+        Children(child)[child->numKeys + 1] = Children(sibling)[0];
 
-    x->keys[idx] = sibling->keys[0];
-    x->values[idx] = sibling->values[0];
+    Keys(x)[idx] = Keys(sibling)[0];
+    Values(x)[idx] = std::move(Values(sibling)[0]);
 
     for (int i = 1; i < sibling->numKeys; ++i) {
-        sibling->keys[i - 1] = sibling->keys[i];
-        sibling->values[i - 1] = sibling->values[i];
+        Keys(sibling)[i - 1] = Keys(sibling)[i];
+        Values(sibling)[i - 1] = std::move(Values(sibling)[i]);
     }
 
     if (!sibling->isLeaf) {
         for (int i = 1; i <= sibling->numKeys; ++i)
-            sibling->children[i - 1] = sibling->children[i];
+            Children(sibling)[i - 1] = Children(sibling)[i];
     }
 
     ++child->numKeys;
     --sibling->numKeys;
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::Merge(ShrdPtr<Node> x, int idx) {
-    ShrdPtr<Node> child = x->children[idx];
-    ShrdPtr<Node> sibling = x->children[idx + 1];
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::Merge(Node *x, int idx) {
+    Node *child = MakeWritable(Children(x)[idx]);
+    Node *sibling = MakeWritable(Children(x)[idx + 1]);
 
-    child->keys[order - 1] = x->keys[idx];
-    child->values[order - 1] = x->values[idx];
+    Keys(child)[order - 1] = Keys(x)[idx];
+    Values(child)[order - 1] = std::move(Values(x)[idx]);
 
     for (int i = 0; i < sibling->numKeys; ++i) {
-        child->keys[i + order] = sibling->keys[i];
-        child->values[i + order] = sibling->values[i];
+        Keys(child)[i + order] = Keys(sibling)[i];
+        Values(child)[i + order] = std::move(Values(sibling)[i]);
     }
 
     if (!child->isLeaf) {
         for (int i = 0; i <= sibling->numKeys; ++i)
-            child->children[i + order] = sibling->children[i];
+            Children(child)[i + order] = Children(sibling)[i];
     }
 
     for (int i = idx + 1; i < x->numKeys; ++i) {
-        x->keys[i - 1] = x->keys[i];
-        x->values[i - 1] = x->values[i];
+        Keys(x)[i - 1] = Keys(x)[i];
+        Values(x)[i - 1] = std::move(Values(x)[i]);
     }
 
     for (int i = idx + 2; i <= x->numKeys; ++i)
-        x->children[i - 1] = x->children[i];
+        Children(x)[i - 1] = Children(x)[i];
 
     child->numKeys += sibling->numKeys + 1;
     --x->numKeys;
-    sibling.reset();
+    DestroyNode(sibling);
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::LocateGroup(const TKey *keys, size_t count, const Node **nodes,
+                                                    int *indices) const {
+    bool done[BatchSize];
+    for (size_t i = 0; i < count; ++i) {
+        nodes[i] = root;
+        done[i] = false;
+    }
+
+    size_t pending = count;
+    while (pending > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!done[i]) {
+                Prefetch(Keys(nodes[i]));
+            }
+        }
+
+        pending = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (done[i]) {
+                continue;
+            }
+
+            const Node *x = nodes[i];
+            int j = KeySearch<TKey>::Rank(Keys(x), x->numKeys, keys[i]);
+
+            if (j < x->numKeys && keys[i] == Keys(x)[j]) {
+                indices[i] = j;
+                done[i] = true;
+            } else if (x->isLeaf) {
+                nodes[i] = nullptr;
+                done[i] = true;
+            } else {
+                nodes[i] = Children(x)[j];
+                Prefetch(nodes[i]);
+                ++pending;
+            }
+        }
+    }
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::ContainsMany(const TKey *keys, size_t count, bool *results) const {
+    const Node *nodes[BatchSize];
+    int indices[BatchSize];
+    for (size_t start = 0; start < count; start += BatchSize) {
+        size_t groupSize = count - start < BatchSize ? count - start : BatchSize;
+        LocateGroup(keys + start, groupSize, nodes, indices);
+        for (size_t i = 0; i < groupSize; ++i) {
+            results[start + i] = nodes[i] != nullptr;
+        }
+    }
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+size_t BTree<TKey, TElement, TAllocator>::GetMany(const TKey *keys, size_t count, TElement *values, bool *found) const {
+    const Node *nodes[BatchSize];
+    int indices[BatchSize];
+    size_t hits = 0;
+    for (size_t start = 0; start < count; start += BatchSize) {
+        size_t groupSize = count - start < BatchSize ? count - start : BatchSize;
+        LocateGroup(keys + start, groupSize, nodes, indices);
+        for (size_t i = 0; i < groupSize; ++i) {
+            values[start + i] = nodes[i] ? Values(nodes[i])[indices[i]] : TElement();
+            if (found) {
+                found[start + i] = nodes[i] != nullptr;
+            }
+            hits += nodes[i] ? 1 : 0;
+        }
+    }
+    return hits;
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::AddRange(const TKey *keys, const TElement *elements, size_t count) {
+    UnqPtr<size_t[]> order(new size_t[count]);
+    for (size_t i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+    // Stable, so the last of several equal keys is inserted last and wins.
+    std::stable_sort(order.get(), order.get() + count,
+                     [keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+    for (size_t i = 0; i < count; ++i) {
+        Add(keys[order[i]], elements[order[i]]);
+    }
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::AddSorted(const TKey *keys, const TElement *elements, size_t count) {
+    if (this->count == 0) {
+        BuildFromSorted(keys, keys + count, elements);
+    } else {
+        AddRange(keys, elements, count);
+    }
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+size_t BTree<TKey, TElement, TAllocator>::LevelWidth(size_t items, int targetKeys) const {
+    size_t width = (items + targetKeys + 1) / (targetKeys + 1);
+    size_t widest = (items + 1) / order;
+    return std::max<size_t>(1, std::min(width, widest));
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+template<typename TKeyIterator, typename TElementIterator>
+void BTree<TKey, TElement, TAllocator>::BuildFromSorted(TKeyIterator firstKey, TKeyIterator lastKey,
+                                                        TElementIterator firstElement, double fillFactor) {
+    if (!(fillFactor > 0.0 && fillFactor <= 1.0))
+        throw std::invalid_argument("Fill factor must be in (0, 1].");
+
+    // The input is checked before the old tree is dropped.
+    size_t total = 0;
+    for (TKeyIterator it = firstKey, previous = firstKey; it != lastKey; previous = it, ++it, ++total) {
+        if (total > 0 && !(*previous < *it))
+            throw std::invalid_argument("Keys must be sorted and unique.");
+    }
+
+    int maxKeys = 2 * order - 1;
+    int targetKeys = std::clamp(static_cast<int>(fillFactor * maxKeys + 0.5), order - 1, maxKeys);
+
+    ReleaseTree();
+    count = total;
+
+    // Leaves take the input in order; the key after each leaf but the last is a separator.
+    size_t width = LevelWidth(total, targetKeys);
+    UnqPtr<Node *[]> level(new Node *[width]);
+    UnqPtr<TKey[]> separatorKeys(new TKey[width - 1]);
+    UnqPtr<TElement[]> separatorValues(new TElement[width - 1]);
+    size_t nodeKeys = total - (width - 1);
+    for (size_t n = 0; n < width; ++n) {
+        Node *leaf = CreateNode(true);
+        level[n] = leaf;
+        leaf->numKeys = static_cast<int>(nodeKeys / width + (n < nodeKeys % width ? 1 : 0));
+        for (int j = 0; j < leaf->numKeys; ++j, ++firstKey, ++firstElement) {
+            Keys(leaf)[j] = *firstKey;
+            Values(leaf)[j] = *firstElement;
+        }
+        if (n + 1 < width) {
+            separatorKeys[n] = *firstKey;
+            separatorValues[n] = *firstElement;
+            ++firstKey;
+            ++firstElement;
+        }
+    }
+
+    // Each upper level is laid out over the separators of the one below in the same way;
+    // a node with k of them as keys adopts the next k + 1 nodes as children.
+    while (width > 1) {
+        size_t items = width - 1;
+        size_t parentWidth = LevelWidth(items, targetKeys);
+        UnqPtr<Node *[]> parents(new Node *[parentWidth]);
+        UnqPtr<TKey[]> parentKeys(new TKey[parentWidth - 1]);
+        UnqPtr<TElement[]> parentValues(new TElement[parentWidth - 1]);
+        nodeKeys = items - (parentWidth - 1);
+        size_t item = 0;
+        size_t child = 0;
+        for (size_t n = 0; n < parentWidth; ++n) {
+            Node *node = CreateNode(false);
+            parents[n] = node;
+            node->numKeys = static_cast<int>(nodeKeys / parentWidth + (n < nodeKeys % parentWidth ? 1 : 0));
+            Children(node)[0] = level[child++];
+            for (int j = 0; j < node->numKeys; ++j, ++item) {
+                Keys(node)[j] = std::move(separatorKeys[item]);
+                Values(node)[j] = std::move(separatorValues[item]);
+                Children(node)[j + 1] = level[child++];
+            }
+            if (n + 1 < parentWidth) {
+                parentKeys[n] = std::move(separatorKeys[item]);
+                parentValues[n] = std::move(separatorValues[item]);
+                ++item;
+            }
+        }
+        level = std::move(parents);
+        separatorKeys = std::move(parentKeys);
+        separatorValues = std::move(parentValues);
+        width = parentWidth;
+    }
+    root = level[0];
 }
 
-template<typename TKey, typename TElement>
-BTree<TKey, TElement>::BTreeIterator::BTreeIterator(const BTree *tree)
-        : tree(tree), hasCurrent(false) {
+template<typename TKey, typename TElement, typename TAllocator>
+BTree<TKey, TElement, TAllocator>::BTreeIterator::BTreeIterator(const BTree *tree, std::optional<TKey> lower,
+                                                                 std::optional<TKey> upper)
+        : tree(tree), lower(std::move(lower)), upper(std::move(upper)), hasCurrent(false) {
     Reset();
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::BTreeIterator::Reset() {
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::BTreeIterator::Reset() {
     stack = DynamicArraySmart<StackNode>();
     hasCurrent = false;
     if (tree->root) {
-        PushLeftmost(tree->root);
+        if (lower)
+            Seek(*lower);
+        else
+            PushLeftmost(tree->root);
+    }
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::BTreeIterator::Seek(const TKey &key) {
+    const Node *node = tree->root;
+    while (true) {
+        int i = KeySearch<TKey>::Rank(Keys(node), node->numKeys, key);
+        StackNode sn = {node, i};
+        stack.Append(sn);
+        if (node->isLeaf || (i < node->numKeys && Keys(node)[i] == key))
+            break;
+        node = tree->Children(node)[i];
     }
 }
 
-template<typename TKey, typename TElement>
-void BTree<TKey, TElement>::BTreeIterator::PushLeftmost(ShrdPtr<Node> node) {
+template<typename TKey, typename TElement, typename TAllocator>
+void BTree<TKey, TElement, TAllocator>::BTreeIterator::PushLeftmost(const Node *node) {
     while (node && node->numKeys > 0) {
         StackNode sn = {node, 0};
         stack.Append(sn);
         if (node->isLeaf)
             break;
         else
-            node = node->children[0];
+            node = tree->Children(node)[0];
     }
 }
 
-template<typename TKey, typename TElement>
-bool BTree<TKey, TElement>::BTreeIterator::MoveNext() {
+template<typename TKey, typename TElement, typename TAllocator>
+bool BTree<TKey, TElement, TAllocator>::BTreeIterator::MoveNext() {
     while (stack.GetLength() > 0) {
         StackNode &top = stack[stack.GetLength() - 1];
 
@@ -504,13 +1063,18 @@ bool BTree<TKey, TElement>::BTreeIterator::MoveNext() {
                 continue;
             }
 
-            currentKey = top.node->keys[top.index];
-            currentValue = top.node->values[top.index];
+            if (upper && !(Keys(top.node)[top.index] < *upper)) {
+                stack = DynamicArraySmart<StackNode>();
+                break;
+            }
+
+            currentKey = Keys(top.node)[top.index];
+            currentValue = tree->Values(top.node)[top.index];
             hasCurrent = true;
 
             if (!top.node->isLeaf) {
                 if (top.index + 1 <= top.node->numKeys) {
-                    ShrdPtr<Node> child = top.node->children[top.index + 1];
+                    Node *child = tree->Children(top.node)[top.index + 1];
                     ++top.index;
                     PushLeftmost(child);
                 } else {
@@ -531,24 +1095,53 @@ bool BTree<TKey, TElement>::BTreeIterator::MoveNext() {
 }
 
 
-template<typename TKey, typename TElement>
-TKey BTree<TKey, TElement>::BTreeIterator::GetCurrentKey() const {
+template<typename TKey, typename TElement, typename TAllocator>
+TKey BTree<TKey, TElement, TAllocator>::BTreeIterator::GetCurrentKey() const {
     if (!hasCurrent)
         throw std::out_of_range("Iterator out of range");
     return currentKey;
 }
 
-template<typename TKey, typename TElement>
-TElement BTree<TKey, TElement>::BTreeIterator::GetCurrentValue() const {
+template<typename TKey, typename TElement, typename TAllocator>
+TElement BTree<TKey, TElement, TAllocator>::BTreeIterator::GetCurrentValue() const {
     if (!hasCurrent)
         throw std::out_of_range("Iterator out of range");
     return currentValue;
 }
 
 
-template<typename TKey, typename TElement>
-UnqPtr<IDictionaryIterator<TKey, TElement>> BTree<TKey, TElement>::GetIterator() const {
+template<typename TKey, typename TElement, typename TAllocator>
+UnqPtr<IDictionaryIterator<TKey, TElement>> BTree<TKey, TElement, TAllocator>::GetIterator() const {
     return UnqPtr<IDictionaryIterator<TKey, TElement>>(new BTreeIterator(this));
 }
 
+template<typename TKey, typename TElement, typename TAllocator>
+UnqPtr<IDictionaryIterator<TKey, TElement>> BTree<TKey, TElement, TAllocator>::SeekIterator(const TKey &key) const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new BTreeIterator(this, key));
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+UnqPtr<IDictionaryIterator<TKey, TElement>> BTree<TKey, TElement, TAllocator>::GetRange(const TKey &lower,
+                                                                                         const TKey &upper) const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new BTreeIterator(this, lower, upper));
+}
+
+template<typename TKey, typename TElement, typename TAllocator>
+std::optional<TKey> BTree<TKey, TElement, TAllocator>::LowerBound(const TKey &key) const {
+    // Keys met further down are smaller than the candidate from the level above.
+    std::optional<TKey> candidate;
+    const Node *x = root;
+    while (true) {
+        int i = KeySearch<TKey>::Rank(Keys(x), x->numKeys, key);
+        if (i < x->numKeys) {
+            candidate = Keys(x)[i];
+            if (Keys(x)[i] == key)
+                return candidate;
+        }
+        if (x->isLeaf)
+            return candidate;
+        x = Children(x)[i];
+    }
+}
+
 #endif // BTREE_H
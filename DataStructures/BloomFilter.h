@@ -0,0 +1,112 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include "UnqPtr.h"
+#include "Hashers.h"
+#include <cstdint>
+
+// Split-block Bloom filter: each key sets one bit in every 64-bit word of a single
+// 64-byte block, so Add and MayContain touch exactly one cache line. A "no" is always
+// right; a "yes" is wrong with a small probability that depends on bits per key.
+// Keys cannot be taken out again, only the whole filter can be cleared.
+template<typename TKey, typename THash = DefaultHash<TKey>>
+class BlockedBloomFilter {
+public:
+    // Sized for expectedCount keys at bitsPerKey bits each.
+    BlockedBloomFilter(size_t expectedCount = 1024, size_t bitsPerKey = 12);
+
+    void Add(const TKey &key);
+
+    bool MayContain(const TKey &key) const;
+
+    void Clear();
+
+    // Number of keys the filter was sized for.
+    size_t GetCapacity() const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static const size_t WordsPerBlock = 8;
+
+    struct alignas(64) Block {
+        uint64_t words[WordsPerBlock];
+    };
+
+    UnqPtr<Block[]> blocks;
+    size_t blockCount;
+    size_t capacity;
+
+    size_t BlockIndex(uint64_t hash) const;
+
+    // Bit to test in word i of the block, derived from the low half of the hash.
+    static uint64_t BitMask(uint64_t hash, size_t i);
+};
+
+template<typename TKey, typename THash>
+BlockedBloomFilter<TKey, THash>::BlockedBloomFilter(size_t expectedCount, size_t bitsPerKey)
+        : blocks(nullptr), blockCount(0), capacity(expectedCount) {
+    size_t bits = expectedCount * bitsPerKey;
+    blockCount = bits / (WordsPerBlock * 64) + 1;
+    blocks.reset(new Block[blockCount]);
+    Clear();
+}
+
+template<typename TKey, typename THash>
+size_t BlockedBloomFilter<TKey, THash>::BlockIndex(uint64_t hash) const {
+    return static_cast<size_t>(((hash >> 32) * blockCount) >> 32);
+}
+
+template<typename TKey, typename THash>
+uint64_t BlockedBloomFilter<TKey, THash>::BitMask(uint64_t hash, size_t i) {
+    // Odd multipliers from the Parquet split-block filter, one per word.
+    static const uint32_t salts[WordsPerBlock] = {
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+    };
+    uint32_t bit = (static_cast<uint32_t>(hash) * salts[i]) >> 26;
+    return uint64_t(1) << bit;
+}
+
+template<typename TKey, typename THash>
+void BlockedBloomFilter<TKey, THash>::Add(const TKey &key) {
+    uint64_t hash = THash()(key);
+    Block &block = blocks[BlockIndex(hash)];
+    for (size_t i = 0; i < WordsPerBlock; ++i) {
+        block.words[i] |= BitMask(hash, i);
+    }
+}
+
+template<typename TKey, typename THash>
+bool BlockedBloomFilter<TKey, THash>::MayContain(const TKey &key) const {
+    uint64_t hash = THash()(key);
+    const Block &block = blocks[BlockIndex(hash)];
+    // No early exit: the eight tests are cheaper than the branches between them.
+    uint64_t missing = 0;
+    for (size_t i = 0; i < WordsPerBlock; ++i) {
+        uint64_t mask = BitMask(hash, i);
+        missing |= ~block.words[i] & mask;
+    }
+    return missing == 0;
+}
+
+template<typename TKey, typename THash>
+void BlockedBloomFilter<TKey, THash>::Clear() {
+    for (size_t b = 0; b < blockCount; ++b) {
+        for (size_t i = 0; i < WordsPerBlock; ++i) {
+            blocks[b].words[i] = 0;
+        }
+    }
+}
+
+template<typename TKey, typename THash>
+size_t BlockedBloomFilter<TKey, THash>::GetCapacity() const {
+    return capacity;
+}
+
+template<typename TKey, typename THash>
+size_t BlockedBloomFilter<TKey, THash>::GetMemoryUsage() const {
+    return sizeof(*this) + blockCount * sizeof(Block);
+}
+
+#endif // BLOOMFILTER_H
@@ -0,0 +1,720 @@
+#ifndef CONCURRENTBTREE_H
+#define CONCURRENTBTREE_H
+
+#include "IDictionary.h"
+#include "DynamicArraySmart.h"
+#include "EpochReclamation.h"
+#include "KeyValue.h"
+#include "KeySearch.h"
+#include "Prefetch.h"
+#include "UnqPtr.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+// Thread-safe B+ tree synchronized by optimistic lock coupling (Leis et al., "The ART of
+// Practical Synchronization"). Every node has a version word whose lowest bit is its
+// write lock. Readers take no locks: they note a node's version, read the node, and check
+// the version again before following what they read, starting over from the root if a
+// writer got in between. Writers descend the same way and lock only the leaf they change,
+// plus a full node and its parent while splitting it. Full nodes are split on the way
+// down, so a split never has to climb back up.
+//
+// Removal leaves leaves underfull, but a leaf it empties is merged with a sibling under the
+// same parent, and the leaf that drops out is unlinked from the parent and the leaf chain
+// and retired through EpochReclamation. Every operation runs inside an EpochGuard, so a
+// reader holding a stale pointer still reads valid memory. Inner nodes are kept, and an
+// empty leaf that is the only child of its parent stays. Readers copy keys and elements
+// that a writer may be changing and discard the copy if the version moved, so both have
+// to be trivially copyable.
+template<typename TKey, typename TElement>
+class ConcurrentBTree : public IDictionary<TKey, TElement> {
+    static_assert(std::is_trivially_copyable_v<TKey> && std::is_trivially_copyable_v<TElement>,
+                  "ConcurrentBTree reads keys and elements optimistically; both must be trivially copyable");
+
+public:
+    ConcurrentBTree();
+
+    virtual ~ConcurrentBTree();
+
+    ConcurrentBTree(const ConcurrentBTree &) = delete;
+
+    ConcurrentBTree &operator=(const ConcurrentBTree &) = delete;
+
+    virtual size_t GetCount() const override;
+
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    virtual bool TryRemove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    // The iterator copies one leaf at a time and moves on along the leaf links, so keys
+    // come out in ascending order and each leaf is seen consistently, but the tree as a
+    // whole is not a point-in-time snapshot. It holds an epoch guard, so it must be
+    // destroyed on the thread that created it.
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    // Starts at the leaf holding lower, with the same consistency as GetIterator.
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetRange(const TKey &lower, const TKey &upper) const override;
+
+private:
+    // Node sizes that keep the keys of a node within a few cache lines.
+    static constexpr int LeafCapacity =
+            std::max<int>(4, static_cast<int>(4 * CacheLineSize / (sizeof(TKey) + sizeof(TElement))));
+    static constexpr int InnerCapacity =
+            std::max<int>(4, static_cast<int>(4 * CacheLineSize / (sizeof(TKey) + sizeof(void *))));
+
+    static constexpr uint64_t LockedBit = 1;
+
+    // Each node starts on its own cache line, so a writer bumping one version word does
+    // not invalidate the line a reader of a neighbouring node is validating.
+    struct alignas(CacheLineSize) Node {
+        std::atomic<uint64_t> version;
+        const bool isLeaf;
+        int numKeys;
+
+        Node(bool leaf) : version(0), isLeaf(leaf), numKeys(0) {}
+    };
+
+    struct Leaf : Node {
+        TKey keys[LeafCapacity];
+        TElement values[LeafCapacity];
+        Leaf *next;
+
+        Leaf() : Node(true), keys(), values(), next(nullptr) {}
+    };
+
+    struct Inner : Node {
+        TKey keys[InnerCapacity];
+        Node *children[InnerCapacity + 1];
+
+        Inner() : Node(false), keys(), children() {}
+    };
+
+    std::atomic<Node *> root;
+    // Splits move keys to a new right sibling and merges never drop the first child of a
+    // parent, so the first leaf stays the leftmost one.
+    const Leaf *firstLeaf;
+    std::atomic<size_t> count;
+
+    // Waits until no writer holds node and returns the version to validate against.
+    static uint64_t ReadVersion(const Node *node);
+
+    // True if node is unchanged since version was read, so everything read from it since
+    // is consistent.
+    static bool Validate(const Node *node, uint64_t version);
+
+    // Locks node if it is still at version; fails if a writer changed or holds it.
+    static bool TryLock(Node *node, uint64_t version);
+
+    static void Unlock(Node *node);
+
+    // numKeys as a reader may see it mid-write, clamped so searches stay inside the node.
+    static int ReadCount(const Node *node, int capacity);
+
+    // Index of the child of an internal node whose range contains key.
+    static int ChildIndex(const Inner *inner, int numKeys, const TKey &key);
+
+    static bool IsFull(const Node *node);
+
+    // Descends to the leaf that would hold key. Returns nullptr if a writer interfered,
+    // otherwise the leaf and, in version, the version it was validated at.
+    Leaf *FindLeaf(const TKey &key, uint64_t &version) const;
+
+    // Copies the element stored under key into value; false if the key is absent.
+    bool Lookup(const TKey &key, TElement *value) const;
+
+    // Splits the locked full node; the separator goes into the locked parent, or into a
+    // new root when node is the root.
+    void Split(Inner *parent, Node *node);
+
+    // Merges the leaf that would hold key, if it is empty, with a sibling under the same
+    // parent and retires the leaf that drops out. Gives up if the leaf is refilled.
+    void Compact(const TKey &key);
+
+    void DestroySubtree(Node *node);
+
+    class ConcurrentBTreeIterator : public IDictionaryIterator<TKey, TElement> {
+    public:
+        // Without bounds the iterator covers the whole tree.
+        ConcurrentBTreeIterator(const ConcurrentBTree *tree, std::optional<TKey> lower = std::nullopt,
+                                std::optional<TKey> upper = std::nullopt);
+
+        virtual ~ConcurrentBTreeIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual TKey GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        // Keeps every leaf reachable from nextLeaf alive, including ones merged away since.
+        EpochGuard guard;
+        const ConcurrentBTree *tree;
+        std::optional<TKey> lower;
+        std::optional<TKey> upper;
+        // The next leaf to copy, nullptr past the last one.
+        const Leaf *nextLeaf;
+        int entryIndex;
+        bool finished;
+        DynamicArraySmart<KeyValue<TKey, TElement>> entries;
+
+        // Copies the entries of nextLeaf that lie in the bounds and advances nextLeaf.
+        void LoadLeaf();
+    };
+};
+
+template<typename TKey, typename TElement>
+ConcurrentBTree<TKey, TElement>::ConcurrentBTree()
+        : root(nullptr), firstLeaf(nullptr), count(0) {
+    Leaf *leaf = new Leaf();
+    firstLeaf = leaf;
+    root.store(leaf, std::memory_order_relaxed);
+}
+
+template<typename TKey, typename TElement>
+ConcurrentBTree<TKey, TElement>::~ConcurrentBTree() {
+    DestroySubtree(root.load(std::memory_order_relaxed));
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentBTree<TKey, TElement>::DestroySubtree(Node *node) {
+    if (node->isLeaf) {
+        delete static_cast<Leaf *>(node);
+        return;
+    }
+    Inner *inner = static_cast<Inner *>(node);
+    for (int i = 0; i <= inner->numKeys; ++i)
+        DestroySubtree(inner->children[i]);
+    delete inner;
+}
+
+template<typename TKey, typename TElement>
+uint64_t ConcurrentBTree<TKey, TElement>::ReadVersion(const Node *node) {
+    uint64_t version = node->version.load(std::memory_order_acquire);
+    while (version & LockedBit) {
+        std::this_thread::yield();
+        version = node->version.load(std::memory_order_acquire);
+    }
+    return version;
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentBTree<TKey, TElement>::Validate(const Node *node, uint64_t version) {
+    // Keeps the reads of the node from moving below the second look at the version.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return node->version.load(std::memory_order_relaxed) == version;
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentBTree<TKey, TElement>::TryLock(Node *node, uint64_t version) {
+    if (!node->version.compare_exchange_strong(version, version + LockedBit, std::memory_order_acquire))
+        return false;
+    // Keeps the writes that follow from becoming visible before the locked version.
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentBTree<TKey, TElement>::Unlock(Node *node) {
+    // Clears the lock bit and moves the version on in one step.
+    node->version.fetch_add(LockedBit, std::memory_order_release);
+}
+
+template<typename TKey, typename TElement>
+int ConcurrentBTree<TKey, TElement>::ReadCount(const Node *node, int capacity) {
+    return std::clamp(node->numKeys, 0, capacity);
+}
+
+template<typename TKey, typename TElement>
+int ConcurrentBTree<TKey, TElement>::ChildIndex(const Inner *inner, int numKeys, const TKey &key) {
+    // A key equal to a separator belongs to the right child, where the separator came from.
+    int i = KeySearch<TKey>::Rank(inner->keys, numKeys, key);
+    return i < numKeys && inner->keys[i] == key ? i + 1 : i;
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentBTree<TKey, TElement>::IsFull(const Node *node) {
+    return node->numKeys >= (node->isLeaf ? LeafCapacity : InnerCapacity);
+}
+
+template<typename TKey, typename TElement>
+size_t ConcurrentBTree<TKey, TElement>::GetCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+template<typename TKey, typename TElement>
+size_t ConcurrentBTree<TKey, TElement>::GetCapacity() const {
+    return GetCount();
+}
+
+template<typename TKey, typename TElement>
+typename ConcurrentBTree<TKey, TElement>::Leaf *
+ConcurrentBTree<TKey, TElement>::FindLeaf(const TKey &key, uint64_t &version) const {
+    Node *node = root.load(std::memory_order_acquire);
+    version = ReadVersion(node);
+    if (node != root.load(std::memory_order_acquire))
+        return nullptr;
+
+    const Node *parent = nullptr;
+    uint64_t parentVersion = 0;
+    while (!node->isLeaf) {
+        const Inner *inner = static_cast<const Inner *>(node);
+        Node *child = inner->children[ChildIndex(inner, ReadCount(inner, InnerCapacity), key)];
+        if (!Validate(node, version))
+            return nullptr;
+
+        parent = node;
+        parentVersion = version;
+        node = child;
+        version = ReadVersion(node);
+        // A split of the child between reading the pointer and its version changes the
+        // parent, so checking the parent again catches keys that moved to a new sibling.
+        if (!Validate(parent, parentVersion))
+            return nullptr;
+    }
+    return static_cast<Leaf *>(node);
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentBTree<TKey, TElement>::Lookup(const TKey &key, TElement *value) const {
+    EpochGuard guard;
+    while (true) {
+        uint64_t version;
+        const Leaf *leaf = FindLeaf(key, version);
+        if (!leaf)
+            continue;
+
+        int numKeys = ReadCount(leaf, LeafCapacity);
+        int i = KeySearch<TKey>::Rank(leaf->keys, numKeys, key);
+        bool found = i < numKeys && leaf->keys[i] == key;
+        TElement copy = found ? leaf->values[i] : TElement();
+        if (!Validate(leaf, version))
+            continue;
+
+        if (found && value)
+            *value = copy;
+        return found;
+    }
+}
+
+template<typename TKey, typename TElement>
+TElement ConcurrentBTree<TKey, TElement>::Get(const TKey &key) const {
+    TElement value;
+    if (!Lookup(key, &value))
+        throw std::runtime_error("Key not found.");
+    return value;
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentBTree<TKey, TElement>::ContainsKey(const TKey &key) const {
+    return Lookup(key, nullptr);
+}
+
+template<typename TKey, typename TElement>
+std::optional<TElement> ConcurrentBTree<TKey, TElement>::TryGet(const TKey &key) const {
+    TElement value;
+    if (!Lookup(key, &value))
+        return std::nullopt;
+    return value;
+}
+
+template<typename TKey, typename TElement>
+TElement ConcurrentBTree<TKey, TElement>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    TElement value;
+    return Lookup(key, &value) ? value : defaultValue;
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentBTree<TKey, TElement>::Add(const TKey &key, const TElement &element) {
+    Upsert(key, element);
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentBTree<TKey, TElement>::Upsert(const TKey &key, const TElement &element) {
+    EpochGuard guard;
+    while (true) {
+        Node *node = root.load(std::memory_order_acquire);
+        uint64_t version = ReadVersion(node);
+        if (node != root.load(std::memory_order_acquire))
+            continue;
+
+        Inner *parent = nullptr;
+        uint64_t parentVersion = 0;
+        bool restart = false;
+        while (true) {
+            if (IsFull(node)) {
+                // The parent was not full when it was read, and locking it at that version
+                // proves it still is not, so it has room for the separator.
+                if (parent && !TryLock(parent, parentVersion)) {
+                    restart = true;
+                    break;
+                }
+                if (!TryLock(node, version)) {
+                    if (parent)
+                        Unlock(parent);
+                    restart = true;
+                    break;
+                }
+                if (!parent && node != root.load(std::memory_order_acquire)) {
+                    Unlock(node);
+                    restart = true;
+                    break;
+                }
+                Split(parent, node);
+                Unlock(node);
+                if (parent)
+                    Unlock(parent);
+                restart = true;
+                break;
+            }
+            if (node->isLeaf)
+                break;
+
+            Inner *inner = static_cast<Inner *>(node);
+            Node *child = inner->children[ChildIndex(inner, ReadCount(inner, InnerCapacity), key)];
+            if (!Validate(node, version)) {
+                restart = true;
+                break;
+            }
+            parent = inner;
+            parentVersion = version;
+            node = child;
+            version = ReadVersion(node);
+            if (!Validate(parent, parentVersion)) {
+                restart = true;
+                break;
+            }
+        }
+        if (restart)
+            continue;
+
+        Leaf *leaf = static_cast<Leaf *>(node);
+        if (!TryLock(leaf, version))
+            continue;
+
+        int i = KeySearch<TKey>::Rank(leaf->keys, leaf->numKeys, key);
+        if (i < leaf->numKeys && leaf->keys[i] == key) {
+            leaf->values[i] = element;
+            Unlock(leaf);
+            return false;
+        }
+        for (int j = leaf->numKeys; j > i; --j) {
+            leaf->keys[j] = leaf->keys[j - 1];
+            leaf->values[j] = leaf->values[j - 1];
+        }
+        leaf->keys[i] = key;
+        leaf->values[i] = element;
+        ++leaf->numKeys;
+        Unlock(leaf);
+        count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentBTree<TKey, TElement>::Split(Inner *parent, Node *node) {
+    TKey separator;
+    Node *right;
+    if (node->isLeaf) {
+        Leaf *leaf = static_cast<Leaf *>(node);
+        Leaf *sibling = new Leaf();
+        int half = leaf->numKeys / 2;
+        sibling->numKeys = leaf->numKeys - half;
+        for (int j = 0; j < sibling->numKeys; ++j) {
+            sibling->keys[j] = leaf->keys[half + j];
+            sibling->values[j] = leaf->values[half + j];
+        }
+        sibling->next = leaf->next;
+        leaf->next = sibling;
+        leaf->numKeys = half;
+        separator = sibling->keys[0];
+        right = sibling;
+    } else {
+        Inner *inner = static_cast<Inner *>(node);
+        Inner *sibling = new Inner();
+        int half = inner->numKeys / 2;
+        separator = inner->keys[half];
+        sibling->numKeys = inner->numKeys - half - 1;
+        for (int j = 0; j < sibling->numKeys; ++j)
+            sibling->keys[j] = inner->keys[half + 1 + j];
+        for (int j = 0; j <= sibling->numKeys; ++j)
+            sibling->children[j] = inner->children[half + 1 + j];
+        inner->numKeys = half;
+        right = sibling;
+    }
+
+    if (!parent) {
+        Inner *newRoot = new Inner();
+        newRoot->numKeys = 1;
+        newRoot->keys[0] = separator;
+        newRoot->children[0] = node;
+        newRoot->children[1] = right;
+        root.store(newRoot, std::memory_order_release);
+        return;
+    }
+
+    int i = KeySearch<TKey>::Rank(parent->keys, parent->numKeys, separator);
+    for (int j = parent->numKeys; j > i; --j) {
+        parent->keys[j] = parent->keys[j - 1];
+        parent->children[j + 1] = parent->children[j];
+    }
+    parent->keys[i] = separator;
+    parent->children[i + 1] = right;
+    ++parent->numKeys;
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentBTree<TKey, TElement>::Update(const TKey &key, const TElement &element) {
+    EpochGuard guard;
+    while (true) {
+        uint64_t version;
+        Leaf *leaf = FindLeaf(key, version);
+        if (!leaf || !TryLock(leaf, version))
+            continue;
+
+        int i = KeySearch<TKey>::Rank(leaf->keys, leaf->numKeys, key);
+        bool found = i < leaf->numKeys && leaf->keys[i] == key;
+        if (found)
+            leaf->values[i] = element;
+        Unlock(leaf);
+        if (!found)
+            throw std::runtime_error("Key not found.");
+        return;
+    }
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentBTree<TKey, TElement>::Remove(const TKey &key) {
+    if (!TryRemove(key))
+        throw std::runtime_error("Key not found.");
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentBTree<TKey, TElement>::TryRemove(const TKey &key) {
+    EpochGuard guard;
+    while (true) {
+        uint64_t version;
+        Leaf *leaf = FindLeaf(key, version);
+        if (!leaf || !TryLock(leaf, version))
+            continue;
+
+        int i = KeySearch<TKey>::Rank(leaf->keys, leaf->numKeys, key);
+        bool found = i < leaf->numKeys && leaf->keys[i] == key;
+        if (found) {
+            for (int j = i + 1; j < leaf->numKeys; ++j) {
+                leaf->keys[j - 1] = leaf->keys[j];
+                leaf->values[j - 1] = leaf->values[j];
+            }
+            --leaf->numKeys;
+            count.fetch_sub(1, std::memory_order_relaxed);
+        }
+        bool emptied = found && leaf->numKeys == 0;
+        Unlock(leaf);
+        if (emptied)
+            Compact(key);
+        return found;
+    }
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentBTree<TKey, TElement>::Compact(const TKey &key) {
+    while (true) {
+        Node *node = root.load(std::memory_order_acquire);
+        uint64_t version = ReadVersion(node);
+        if (node != root.load(std::memory_order_acquire))
+            continue;
+        if (node->isLeaf)
+            return;
+
+        // Descends to the parent of the leaf that would hold key.
+        Inner *parent = nullptr;
+        int index = 0;
+        bool restart = false;
+        while (!parent) {
+            Inner *inner = static_cast<Inner *>(node);
+            index = ChildIndex(inner, ReadCount(inner, InnerCapacity), key);
+            Node *child = inner->children[index];
+            if (!Validate(node, version)) {
+                restart = true;
+                break;
+            }
+            if (child->isLeaf) {
+                parent = inner;
+                break;
+            }
+            uint64_t childVersion = ReadVersion(child);
+            if (!Validate(node, version)) {
+                restart = true;
+                break;
+            }
+            node = child;
+            version = childVersion;
+        }
+        if (restart || !TryLock(parent, version))
+            continue;
+        if (parent->numKeys == 0) {
+            Unlock(parent);
+            return;
+        }
+
+        // The right one of the pair drops out, so the first child of a parent is never
+        // retired, and the leaf pointing to it in the chain is the left one, locked here.
+        int rightIndex = index > 0 ? index : 1;
+        Leaf *left = static_cast<Leaf *>(parent->children[rightIndex - 1]);
+        Leaf *right = static_cast<Leaf *>(parent->children[rightIndex]);
+        if (!TryLock(left, ReadVersion(left))) {
+            Unlock(parent);
+            continue;
+        }
+        if (!TryLock(right, ReadVersion(right))) {
+            Unlock(left);
+            Unlock(parent);
+            continue;
+        }
+
+        bool merge = (index > 0 ? right : left)->numKeys == 0;
+        if (merge) {
+            // One of the two is empty, so the other fits into left. right keeps its
+            // entries and link, so a reader that reaches it late still sees valid data.
+            for (int j = 0; j < right->numKeys; ++j) {
+                left->keys[left->numKeys + j] = right->keys[j];
+                left->values[left->numKeys + j] = right->values[j];
+            }
+            left->numKeys += right->numKeys;
+            left->next = right->next;
+            for (int j = rightIndex; j < parent->numKeys; ++j) {
+                parent->keys[j - 1] = parent->keys[j];
+                parent->children[j] = parent->children[j + 1];
+            }
+            --parent->numKeys;
+        }
+        Unlock(right);
+        Unlock(left);
+        Unlock(parent);
+        if (merge)
+            EpochDomain::Global().Retire(right);
+        return;
+    }
+}
+
+template<typename TKey, typename TElement>
+ConcurrentBTree<TKey, TElement>::ConcurrentBTreeIterator::ConcurrentBTreeIterator(
+        const ConcurrentBTree *tree, std::optional<TKey> lower, std::optional<TKey> upper)
+        : guard(), tree(tree), lower(std::move(lower)), upper(std::move(upper)), nextLeaf(nullptr), entryIndex(-1),
+          finished(false) {
+    Reset();
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentBTree<TKey, TElement>::ConcurrentBTreeIterator::Reset() {
+    entries = DynamicArraySmart<KeyValue<TKey, TElement>>();
+    entryIndex = -1;
+    finished = false;
+
+    // The guard keeps the leaf usable however the tree changes later.
+    if (!lower) {
+        nextLeaf = tree->firstLeaf;
+        return;
+    }
+    uint64_t version;
+    const Leaf *leaf = nullptr;
+    while (!leaf)
+        leaf = tree->FindLeaf(*lower, version);
+    nextLeaf = leaf;
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentBTree<TKey, TElement>::ConcurrentBTreeIterator::LoadLeaf() {
+    entries = DynamicArraySmart<KeyValue<TKey, TElement>>();
+    entryIndex = 0;
+
+    TKey keys[LeafCapacity];
+    TElement values[LeafCapacity];
+    int numKeys;
+    const Leaf *next;
+    while (true) {
+        uint64_t version = ReadVersion(nextLeaf);
+        numKeys = ReadCount(nextLeaf, LeafCapacity);
+        std::copy(nextLeaf->keys, nextLeaf->keys + numKeys, keys);
+        std::copy(nextLeaf->values, nextLeaf->values + numKeys, values);
+        next = nextLeaf->next;
+        if (Validate(nextLeaf, version))
+            break;
+    }
+
+    nextLeaf = next;
+    for (int i = 0; i < numKeys; ++i) {
+        if (lower && keys[i] < *lower)
+            continue;
+        if (upper && !(keys[i] < *upper)) {
+            nextLeaf = nullptr;
+            break;
+        }
+        entries.Append(KeyValue<TKey, TElement>(keys[i], values[i]));
+    }
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentBTree<TKey, TElement>::ConcurrentBTreeIterator::MoveNext() {
+    if (finished)
+        return false;
+    ++entryIndex;
+    while (entryIndex >= entries.GetLength()) {
+        if (!nextLeaf) {
+            finished = true;
+            return false;
+        }
+        LoadLeaf();
+    }
+    return true;
+}
+
+template<typename TKey, typename TElement>
+TKey ConcurrentBTree<TKey, TElement>::ConcurrentBTreeIterator::GetCurrentKey() const {
+    if (finished || entryIndex < 0 || entryIndex >= entries.GetLength())
+        throw std::out_of_range("Iterator out of range");
+    return entries[entryIndex].key;
+}
+
+template<typename TKey, typename TElement>
+TElement ConcurrentBTree<TKey, TElement>::ConcurrentBTreeIterator::GetCurrentValue() const {
+    if (finished || entryIndex < 0 || entryIndex >= entries.GetLength())
+        throw std::out_of_range("Iterator out of range");
+    return entries[entryIndex].value;
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> ConcurrentBTree<TKey, TElement>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new ConcurrentBTreeIterator(this));
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> ConcurrentBTree<TKey, TElement>::GetRange(const TKey &lower,
+                                                                                       const TKey &upper) const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new ConcurrentBTreeIterator(this, lower, upper));
+}
+
+#endif // CONCURRENTBTREE_H
@@ -0,0 +1,289 @@
+#ifndef CONCURRENTHASHTABLE_H
+#define CONCURRENTHASHTABLE_H
+
+#include "IDictionary.h"
+#include "HashTable.h"
+#include "DynamicArraySmart.h"
+#include "KeyValue.h"
+#include "UnqPtr.h"
+#include "Hashers.h"
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <optional>
+#include <stdexcept>
+
+// Thread-safe dictionary: keys are partitioned across a power-of-two number of shards,
+// each one a HashTable guarded by its own reader/writer lock. Readers of a shard run in
+// parallel, writers only block the shard they touch.
+template<typename TKey, typename TElement>
+class ConcurrentHashTable : public IDictionary<TKey, TElement> {
+public:
+    ConcurrentHashTable(size_t shardCount = 16, size_t initialShardCapacity = 16);
+
+    virtual ~ConcurrentHashTable();
+
+    virtual size_t GetCount() const override;
+
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    // Looks the key up and erases it under one lock of its shard.
+    virtual bool TryRemove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    // The iterator copies one shard at a time under its read lock, so every shard is
+    // seen consistently but the table as a whole is not a point-in-time snapshot.
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    // Keys spread evenly over the shards, so each one reserves its share.
+    virtual void Reserve(size_t count) override;
+
+    size_t GetShardCount() const;
+
+private:
+    // Each shard sits on its own cache lines so that locking one does not invalidate its neighbours.
+    struct alignas(64) Shard {
+        UnqPtr<HashTable<TKey, TElement>> table;
+        mutable std::shared_mutex lock;
+    };
+
+    UnqPtr<Shard[]> shards;
+    size_t shardCount;
+    int shardShift;
+
+    size_t ShardIndex(const TKey &key) const;
+
+    class ConcurrentHashTableIterator : public IDictionaryIterator<TKey, TElement> {
+    public:
+        ConcurrentHashTableIterator(const ConcurrentHashTable *hashTable);
+
+        virtual ~ConcurrentHashTableIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual TKey GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        const ConcurrentHashTable *hashTable;
+        size_t shardIndex;
+        int entryIndex;
+        DynamicArraySmart<KeyValue<TKey, TElement>> entries;
+
+        void LoadShard(size_t index);
+    };
+};
+
+template<typename TKey, typename TElement>
+ConcurrentHashTable<TKey, TElement>::ConcurrentHashTable(size_t shardCount, size_t initialShardCapacity)
+        : shards(nullptr), shardCount(1), shardShift(64) {
+    while (this->shardCount < shardCount) {
+        this->shardCount <<= 1;
+        --shardShift;
+    }
+
+    shards.reset(new Shard[this->shardCount]);
+    for (size_t i = 0; i < this->shardCount; ++i) {
+        shards[i].table.reset(new HashTable<TKey, TElement>(initialShardCapacity));
+    }
+}
+
+template<typename TKey, typename TElement>
+ConcurrentHashTable<TKey, TElement>::~ConcurrentHashTable() {
+
+}
+
+template<typename TKey, typename TElement>
+size_t ConcurrentHashTable<TKey, TElement>::GetShardCount() const {
+    return shardCount;
+}
+
+template<typename TKey, typename TElement>
+size_t ConcurrentHashTable<TKey, TElement>::ShardIndex(const TKey &key) const {
+    if (shardCount == 1) {
+        return 0;
+    }
+
+    // The shard tables pick buckets by the low bits of the same hash, so shards take the
+    // high bits; otherwise every shard would use 1/shardCount of its buckets.
+    uint64_t hash = DefaultHash<TKey>()(key);
+    return static_cast<size_t>(hash >> shardShift);
+}
+
+template<typename TKey, typename TElement>
+size_t ConcurrentHashTable<TKey, TElement>::GetCount() const {
+    size_t total = 0;
+    for (size_t i = 0; i < shardCount; ++i) {
+        std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+        total += shards[i].table->GetCount();
+    }
+    return total;
+}
+
+template<typename TKey, typename TElement>
+size_t ConcurrentHashTable<TKey, TElement>::GetCapacity() const {
+    size_t total = 0;
+    for (size_t i = 0; i < shardCount; ++i) {
+        std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+        total += shards[i].table->GetCapacity();
+    }
+    return total;
+}
+
+template<typename TKey, typename TElement>
+TElement ConcurrentHashTable<TKey, TElement>::Get(const TKey &key) const {
+    const Shard &shard = shards[ShardIndex(key)];
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table->Get(key);
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentHashTable<TKey, TElement>::ContainsKey(const TKey &key) const {
+    const Shard &shard = shards[ShardIndex(key)];
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table->ContainsKey(key);
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentHashTable<TKey, TElement>::Add(const TKey &key, const TElement &element) {
+    Shard &shard = shards[ShardIndex(key)];
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    shard.table->Add(key, element);
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentHashTable<TKey, TElement>::Remove(const TKey &key) {
+    if (!TryRemove(key)) {
+        throw std::runtime_error("Key not found.");
+    }
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentHashTable<TKey, TElement>::TryRemove(const TKey &key) {
+    Shard &shard = shards[ShardIndex(key)];
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table->TryRemove(key);
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentHashTable<TKey, TElement>::Update(const TKey &key, const TElement &element) {
+    Shard &shard = shards[ShardIndex(key)];
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    shard.table->Update(key, element);
+}
+
+template<typename TKey, typename TElement>
+std::optional<TElement> ConcurrentHashTable<TKey, TElement>::TryGet(const TKey &key) const {
+    const Shard &shard = shards[ShardIndex(key)];
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table->TryGet(key);
+}
+
+template<typename TKey, typename TElement>
+TElement ConcurrentHashTable<TKey, TElement>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    const Shard &shard = shards[ShardIndex(key)];
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table->GetOrDefault(key, defaultValue);
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentHashTable<TKey, TElement>::Upsert(const TKey &key, const TElement &element) {
+    Shard &shard = shards[ShardIndex(key)];
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    return shard.table->Upsert(key, element);
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentHashTable<TKey, TElement>::Reserve(size_t count) {
+    size_t shardShare = (count + shardCount - 1) / shardCount;
+    for (size_t i = 0; i < shardCount; ++i) {
+        std::unique_lock<std::shared_mutex> guard(shards[i].lock);
+        shards[i].table->Reserve(shardShare);
+    }
+}
+
+template<typename TKey, typename TElement>
+ConcurrentHashTable<TKey, TElement>::ConcurrentHashTableIterator::ConcurrentHashTableIterator(
+        const ConcurrentHashTable *hashTable)
+        : hashTable(hashTable), shardIndex(0), entryIndex(-1) {
+    Reset();
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentHashTable<TKey, TElement>::ConcurrentHashTableIterator::LoadShard(size_t index) {
+    entries = DynamicArraySmart<KeyValue<TKey, TElement>>();
+    entryIndex = -1;
+    if (index >= hashTable->shardCount) {
+        return;
+    }
+
+    const Shard &shard = hashTable->shards[index];
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    auto iterator = shard.table->GetIterator();
+    while (iterator->MoveNext()) {
+        entries.Append(KeyValue<TKey, TElement>(iterator->GetCurrentKey(), iterator->GetCurrentValue()));
+    }
+}
+
+template<typename TKey, typename TElement>
+bool ConcurrentHashTable<TKey, TElement>::ConcurrentHashTableIterator::MoveNext() {
+    ++entryIndex;
+
+    while (shardIndex < hashTable->shardCount) {
+        if (entryIndex < entries.GetLength()) {
+            return true;
+        }
+        ++shardIndex;
+        LoadShard(shardIndex);
+        entryIndex = 0;
+    }
+
+    return false;
+}
+
+template<typename TKey, typename TElement>
+void ConcurrentHashTable<TKey, TElement>::ConcurrentHashTableIterator::Reset() {
+    shardIndex = 0;
+    LoadShard(0);
+}
+
+template<typename TKey, typename TElement>
+TKey ConcurrentHashTable<TKey, TElement>::ConcurrentHashTableIterator::GetCurrentKey() const {
+    if (shardIndex >= hashTable->shardCount || entryIndex < 0 || entryIndex >= entries.GetLength())
+        throw std::out_of_range("Iterator out of range");
+
+    return entries[entryIndex].key;
+}
+
+template<typename TKey, typename TElement>
+TElement ConcurrentHashTable<TKey, TElement>::ConcurrentHashTableIterator::GetCurrentValue() const {
+    if (shardIndex >= hashTable->shardCount || entryIndex < 0 || entryIndex >= entries.GetLength())
+        throw std::out_of_range("Iterator out of range");
+
+    return entries[entryIndex].value;
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> ConcurrentHashTable<TKey, TElement>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new ConcurrentHashTableIterator(this));
+}
+
+#endif // CONCURRENTHASHTABLE_H
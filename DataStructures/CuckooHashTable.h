@@ -0,0 +1,511 @@
+#ifndef CUCKOOHASHTABLE_H
+#define CUCKOOHASHTABLE_H
+
+#include "IDictionary.h"
+#include "UnqPtr.h"
+#include "Hashers.h"
+#include "Prefetch.h"
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+// Bucketized cuckoo hash table: every key lives in one of two candidate buckets of
+// SlotsPerBucket entries, or in a small stash when displacement fails. A lookup checks
+// at most the two buckets (plus the stash while it is not empty) and never probes
+// further, so its worst case does not depend on the load or on the key set. Buckets
+// are aligned to cache lines and hold as many slots (up to four) as fit in one line: four
+// for int -> double, three for IndexPair -> double, so a lookup touches at most two lines.
+// Entries too large for two to share a line get four slots spread over several lines,
+// since a bucket with a single slot would cap the load factor near one half.
+template<typename TKey, typename TElement>
+class CuckooHashTable : public IDictionary<TKey, TElement> {
+public:
+    CuckooHashTable(size_t initialCapacity = 16);
+
+    virtual ~CuckooHashTable();
+
+    virtual size_t GetCount() const override;
+
+    // Number of bucket slots, the stash not included.
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    virtual bool TryRemove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    virtual void Reserve(size_t count) override;
+
+    size_t GetStashCount() const;
+
+private:
+    // Bytes of a bucket with the given number of slots, laid out as in Bucket.
+    static constexpr size_t BucketBytes(size_t slots) {
+        size_t keysEnd = alignof(TKey) + slots * sizeof(TKey);
+        size_t valuesStart = (keysEnd + alignof(TElement) - 1) / alignof(TElement) * alignof(TElement);
+        return valuesStart + slots * sizeof(TElement);
+    }
+
+    static constexpr size_t SlotsFittingLine() {
+        size_t slots = 4;
+        while (slots > 2 && BucketBytes(slots) > CacheLineSize)
+            --slots;
+        return BucketBytes(slots) <= CacheLineSize ? slots : 4;
+    }
+
+    static constexpr size_t SlotsPerBucket = SlotsFittingLine();
+    static const size_t StashSize = 8;
+    // Displacements tried before the homeless entry goes to the stash.
+    static const int MaxKicks = 500;
+    static constexpr double MaxLoadFactor = 0.9;
+
+    // The occupancy byte comes first, so it only costs the padding up to the key alignment.
+    struct alignas(CacheLineSize) Bucket {
+        // Bit i is set when slot i holds an entry.
+        uint8_t occupied;
+        TKey keys[SlotsPerBucket];
+        TElement values[SlotsPerBucket];
+
+        Bucket() : occupied(0), keys(), values() {}
+    };
+
+    static_assert(sizeof(Bucket) == CacheLineSize || BucketBytes(2) > CacheLineSize,
+                  "A bucket must fit in one cache line when two entries do");
+
+    struct StashEntry {
+        TKey key;
+        TElement value;
+
+        StashEntry() : key(), value() {}
+    };
+
+    UnqPtr<Bucket[]> buckets;
+    size_t bucketCount;
+    size_t mask;
+    size_t count;
+    StashEntry stash[StashSize];
+    size_t stashCount;
+    // State of the xorshift generator that picks the entry to displace.
+    uint64_t kickState;
+
+    size_t HashFunction(const TKey &key) const;
+
+    size_t PrimaryBucket(size_t hash) const;
+
+    size_t AlternateBucket(size_t hash) const;
+
+    // Returns the element stored under key, or nullptr if it is absent.
+    TElement *FindValue(const TKey &key) const;
+
+    // Places a key known to be absent. Returns false only when displacement failed and the
+    // stash is full; key and value then hold the entry that is left without a slot.
+    bool InsertUnique(TKey &key, TElement &value);
+
+    // InsertUnique that grows the table until the entry fits.
+    void Place(TKey key, TElement value);
+
+    void Rehash(size_t newBucketCount);
+
+    void Allocate(size_t newBucketCount);
+
+    static size_t RoundUpToPowerOfTwo(size_t value);
+
+    class CuckooHashTableIterator : public IDictionaryIterator<TKey, TElement> {
+    public:
+        CuckooHashTableIterator(const CuckooHashTable *hashTable);
+
+        virtual ~CuckooHashTableIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual TKey GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        const CuckooHashTable *hashTable;
+        // Bucket slots are numbered first, the stash follows them.
+        size_t slotIndex;
+        bool started;
+
+        bool IsValid() const;
+    };
+};
+
+template<typename TKey, typename TElement>
+CuckooHashTable<TKey, TElement>::CuckooHashTable(size_t initialCapacity)
+        : buckets(nullptr), bucketCount(0), mask(0), count(0), stash(), stashCount(0),
+          kickState(0x9e3779b97f4a7c15ULL) {
+    size_t minimum = initialCapacity / SlotsPerBucket;
+    Allocate(RoundUpToPowerOfTwo(minimum < 2 ? 2 : minimum));
+}
+
+template<typename TKey, typename TElement>
+CuckooHashTable<TKey, TElement>::~CuckooHashTable() {
+
+}
+
+template<typename TKey, typename TElement>
+size_t CuckooHashTable<TKey, TElement>::GetCount() const {
+    return count;
+}
+
+template<typename TKey, typename TElement>
+size_t CuckooHashTable<TKey, TElement>::GetCapacity() const {
+    return bucketCount * SlotsPerBucket;
+}
+
+template<typename TKey, typename TElement>
+size_t CuckooHashTable<TKey, TElement>::GetStashCount() const {
+    return stashCount;
+}
+
+template<typename TKey, typename TElement>
+size_t CuckooHashTable<TKey, TElement>::RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+template<typename TKey, typename TElement>
+void CuckooHashTable<TKey, TElement>::Allocate(size_t newBucketCount) {
+    buckets.reset(new Bucket[newBucketCount]);
+    bucketCount = newBucketCount;
+    mask = newBucketCount - 1;
+    stashCount = 0;
+}
+
+template<typename TKey, typename TElement>
+size_t CuckooHashTable<TKey, TElement>::HashFunction(const TKey &key) const {
+    return DefaultHash<TKey>()(key);
+}
+
+// The two bucket choices come from the low and the high half of one mixed hash.
+template<typename TKey, typename TElement>
+size_t CuckooHashTable<TKey, TElement>::PrimaryBucket(size_t hash) const {
+    return hash & mask;
+}
+
+template<typename TKey, typename TElement>
+size_t CuckooHashTable<TKey, TElement>::AlternateBucket(size_t hash) const {
+    size_t index = (static_cast<uint64_t>(hash) >> 32) & mask;
+    return index == PrimaryBucket(hash) ? index ^ 1 : index;
+}
+
+template<typename TKey, typename TElement>
+TElement *CuckooHashTable<TKey, TElement>::FindValue(const TKey &key) const {
+    size_t hash = HashFunction(key);
+
+    Bucket &primary = buckets[PrimaryBucket(hash)];
+    for (size_t slot = 0; slot < SlotsPerBucket; ++slot) {
+        if ((primary.occupied & (1u << slot)) && primary.keys[slot] == key) {
+            return &primary.values[slot];
+        }
+    }
+
+    Bucket &alternate = buckets[AlternateBucket(hash)];
+    for (size_t slot = 0; slot < SlotsPerBucket; ++slot) {
+        if ((alternate.occupied & (1u << slot)) && alternate.keys[slot] == key) {
+            return &alternate.values[slot];
+        }
+    }
+
+    for (size_t i = 0; i < stashCount; ++i) {
+        if (stash[i].key == key) {
+            return const_cast<TElement *>(&stash[i].value);
+        }
+    }
+
+    return nullptr;
+}
+
+template<typename TKey, typename TElement>
+bool CuckooHashTable<TKey, TElement>::InsertUnique(TKey &key, TElement &value) {
+    size_t hash = HashFunction(key);
+    size_t candidates[2] = {PrimaryBucket(hash), AlternateBucket(hash)};
+
+    for (size_t candidate : candidates) {
+        Bucket &bucket = buckets[candidate];
+        for (size_t slot = 0; slot < SlotsPerBucket; ++slot) {
+            if (!(bucket.occupied & (1u << slot))) {
+                bucket.keys[slot] = std::move(key);
+                bucket.values[slot] = std::move(value);
+                bucket.occupied |= static_cast<uint8_t>(1u << slot);
+                return true;
+            }
+        }
+    }
+
+    // Both buckets are full: evict a random resident, move it to its other bucket and
+    // repeat with whatever that one displaces.
+    size_t index = candidates[kickState & 1];
+    for (int kick = 0; kick < MaxKicks; ++kick) {
+        kickState ^= kickState << 13;
+        kickState ^= kickState >> 7;
+        kickState ^= kickState << 17;
+
+        Bucket &bucket = buckets[index];
+        size_t victim = kickState % SlotsPerBucket;
+        std::swap(key, bucket.keys[victim]);
+        std::swap(value, bucket.values[victim]);
+
+        size_t victimHash = HashFunction(key);
+        size_t primaryIndex = PrimaryBucket(victimHash);
+        index = primaryIndex == index ? AlternateBucket(victimHash) : primaryIndex;
+
+        Bucket &next = buckets[index];
+        for (size_t slot = 0; slot < SlotsPerBucket; ++slot) {
+            if (!(next.occupied & (1u << slot))) {
+                next.keys[slot] = std::move(key);
+                next.values[slot] = std::move(value);
+                next.occupied |= static_cast<uint8_t>(1u << slot);
+                return true;
+            }
+        }
+    }
+
+    if (stashCount < StashSize) {
+        stash[stashCount].key = std::move(key);
+        stash[stashCount].value = std::move(value);
+        ++stashCount;
+        return true;
+    }
+
+    return false;
+}
+
+template<typename TKey, typename TElement>
+void CuckooHashTable<TKey, TElement>::Place(TKey key, TElement value) {
+    while (!InsertUnique(key, value)) {
+        Rehash(bucketCount * 2);
+    }
+}
+
+template<typename TKey, typename TElement>
+void CuckooHashTable<TKey, TElement>::Rehash(size_t newBucketCount) {
+    UnqPtr<Bucket[]> oldBuckets(std::move(buckets));
+    size_t oldBucketCount = bucketCount;
+
+    StashEntry oldStash[StashSize];
+    size_t oldStashCount = stashCount;
+    for (size_t i = 0; i < oldStashCount; ++i) {
+        oldStash[i].key = std::move(stash[i].key);
+        oldStash[i].value = std::move(stash[i].value);
+    }
+
+    Allocate(newBucketCount);
+
+    // Place may grow the table again; it then works on the new arrays, while the
+    // remaining old entries stay in oldBuckets until they are moved below.
+    for (size_t i = 0; i < oldBucketCount; ++i) {
+        Bucket &bucket = oldBuckets[i];
+        for (size_t slot = 0; slot < SlotsPerBucket; ++slot) {
+            if (bucket.occupied & (1u << slot)) {
+                Place(std::move(bucket.keys[slot]), std::move(bucket.values[slot]));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < oldStashCount; ++i) {
+        Place(std::move(oldStash[i].key), std::move(oldStash[i].value));
+    }
+}
+
+template<typename TKey, typename TElement>
+void CuckooHashTable<TKey, TElement>::Add(const TKey &key, const TElement &element) {
+    Upsert(key, element);
+}
+
+template<typename TKey, typename TElement>
+bool CuckooHashTable<TKey, TElement>::Upsert(const TKey &key, const TElement &element) {
+    TElement *value = FindValue(key);
+    if (value) {
+        *value = element;
+        return false;
+    }
+
+    if (static_cast<double>(count + 1) > MaxLoadFactor * GetCapacity()) {
+        Rehash(bucketCount * 2);
+    }
+
+    Place(key, element);
+    ++count;
+    return true;
+}
+
+template<typename TKey, typename TElement>
+void CuckooHashTable<TKey, TElement>::Reserve(size_t count) {
+    size_t slots = static_cast<size_t>(count / MaxLoadFactor) + 1;
+    size_t newBucketCount = RoundUpToPowerOfTwo((slots + SlotsPerBucket - 1) / SlotsPerBucket);
+    if (newBucketCount > bucketCount) {
+        Rehash(newBucketCount);
+    }
+}
+
+template<typename TKey, typename TElement>
+void CuckooHashTable<TKey, TElement>::Remove(const TKey &key) {
+    if (!TryRemove(key)) {
+        throw std::runtime_error("Key not found.");
+    }
+}
+
+template<typename TKey, typename TElement>
+bool CuckooHashTable<TKey, TElement>::TryRemove(const TKey &key) {
+    size_t hash = HashFunction(key);
+    size_t candidates[2] = {PrimaryBucket(hash), AlternateBucket(hash)};
+
+    for (size_t candidate : candidates) {
+        Bucket &bucket = buckets[candidate];
+        for (size_t slot = 0; slot < SlotsPerBucket; ++slot) {
+            if ((bucket.occupied & (1u << slot)) && bucket.keys[slot] == key) {
+                bucket.keys[slot] = TKey();
+                bucket.values[slot] = TElement();
+                bucket.occupied &= static_cast<uint8_t>(~(1u << slot));
+                --count;
+                return true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < stashCount; ++i) {
+        if (stash[i].key == key) {
+            --stashCount;
+            stash[i].key = std::move(stash[stashCount].key);
+            stash[i].value = std::move(stash[stashCount].value);
+            stash[stashCount].key = TKey();
+            stash[stashCount].value = TElement();
+            --count;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template<typename TKey, typename TElement>
+void CuckooHashTable<TKey, TElement>::Update(const TKey &key, const TElement &element) {
+    TElement *value = FindValue(key);
+    if (!value) {
+        throw std::runtime_error("Key not found.");
+    }
+    *value = element;
+}
+
+template<typename TKey, typename TElement>
+bool CuckooHashTable<TKey, TElement>::ContainsKey(const TKey &key) const {
+    return FindValue(key) != nullptr;
+}
+
+template<typename TKey, typename TElement>
+TElement CuckooHashTable<TKey, TElement>::Get(const TKey &key) const {
+    TElement *value = FindValue(key);
+    if (!value) {
+        throw std::runtime_error("Key not found.");
+    }
+    return *value;
+}
+
+template<typename TKey, typename TElement>
+std::optional<TElement> CuckooHashTable<TKey, TElement>::TryGet(const TKey &key) const {
+    TElement *value = FindValue(key);
+    if (!value) {
+        return std::nullopt;
+    }
+    return *value;
+}
+
+template<typename TKey, typename TElement>
+TElement CuckooHashTable<TKey, TElement>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    TElement *value = FindValue(key);
+    return value ? *value : defaultValue;
+}
+
+template<typename TKey, typename TElement>
+CuckooHashTable<TKey, TElement>::CuckooHashTableIterator::CuckooHashTableIterator(const CuckooHashTable *hashTable)
+        : hashTable(hashTable), slotIndex(0), started(false) {
+}
+
+template<typename TKey, typename TElement>
+bool CuckooHashTable<TKey, TElement>::CuckooHashTableIterator::IsValid() const {
+    size_t bucketSlots = hashTable->bucketCount * SlotsPerBucket;
+    if (slotIndex < bucketSlots) {
+        const Bucket &bucket = hashTable->buckets[slotIndex / SlotsPerBucket];
+        return bucket.occupied & (1u << (slotIndex % SlotsPerBucket));
+    }
+    return slotIndex - bucketSlots < hashTable->stashCount;
+}
+
+template<typename TKey, typename TElement>
+bool CuckooHashTable<TKey, TElement>::CuckooHashTableIterator::MoveNext() {
+    if (started) {
+        ++slotIndex;
+    }
+    started = true;
+
+    size_t end = hashTable->bucketCount * SlotsPerBucket + hashTable->stashCount;
+    while (slotIndex < end) {
+        if (IsValid()) {
+            return true;
+        }
+        ++slotIndex;
+    }
+
+    return false;
+}
+
+template<typename TKey, typename TElement>
+void CuckooHashTable<TKey, TElement>::CuckooHashTableIterator::Reset() {
+    slotIndex = 0;
+    started = false;
+}
+
+template<typename TKey, typename TElement>
+TKey CuckooHashTable<TKey, TElement>::CuckooHashTableIterator::GetCurrentKey() const {
+    if (!started || !IsValid())
+        throw std::out_of_range("Iterator out of range");
+
+    size_t bucketSlots = hashTable->bucketCount * SlotsPerBucket;
+    if (slotIndex < bucketSlots) {
+        return hashTable->buckets[slotIndex / SlotsPerBucket].keys[slotIndex % SlotsPerBucket];
+    }
+    return hashTable->stash[slotIndex - bucketSlots].key;
+}
+
+template<typename TKey, typename TElement>
+TElement CuckooHashTable<TKey, TElement>::CuckooHashTableIterator::GetCurrentValue() const {
+    if (!started || !IsValid())
+        throw std::out_of_range("Iterator out of range");
+
+    size_t bucketSlots = hashTable->bucketCount * SlotsPerBucket;
+    if (slotIndex < bucketSlots) {
+        return hashTable->buckets[slotIndex / SlotsPerBucket].values[slotIndex % SlotsPerBucket];
+    }
+    return hashTable->stash[slotIndex - bucketSlots].value;
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> CuckooHashTable<TKey, TElement>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new CuckooHashTableIterator(this));
+}
+
+#endif // CUCKOOHASHTABLE_H
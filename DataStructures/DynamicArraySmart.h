@@ -98,6 +98,22 @@ public:
         data[length++] = item;
     }
 
+    void Append(T&& item) {
+        if (length == capacity) {
+            int newCapacity = capacity == 0 ? 1 : capacity * 2;
+            resize(newCapacity);
+        }
+        data[length++] = std::move(item);
+    }
+
+    // Builds the new last element from args. Slots are default-constructed by the array
+    // allocation, so the element is move-assigned into place rather than constructed there.
+    template <typename... Args>
+    T& Emplace(Args&&... args) {
+        Append(T(std::forward<Args>(args)...));
+        return data[length - 1];
+    }
+
     void Prepend(const T& item) override {
         if (length == capacity) {
             int newCapacity = capacity == 0 ? 1 : capacity * 2;
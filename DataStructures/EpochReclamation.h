@@ -0,0 +1,226 @@
+#ifndef EPOCHRECLAMATION_H
+#define EPOCHRECLAMATION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Epoch-based memory reclamation for lock-free structures.
+//
+// A thread announces the global epoch while it reads shared nodes (EpochGuard). Unlinked
+// nodes are retired into the retiring thread's list for the epoch it observed; the global
+// epoch only advances when every active thread has announced the current one, so a node
+// retired in epoch e can be freed once the global epoch reaches e + 2.
+class EpochDomain {
+public:
+    static EpochDomain &Global();
+
+    ~EpochDomain();
+
+    EpochDomain(const EpochDomain &) = delete;
+    EpochDomain &operator=(const EpochDomain &) = delete;
+
+    void Enter();
+
+    void Leave();
+
+    void Retire(void *pointer, void (*deleter)(void *));
+
+    template<typename T>
+    void Retire(T *pointer) {
+        Retire(static_cast<void *>(pointer), [](void *p) { delete static_cast<T *>(p); });
+    }
+
+private:
+    struct RetiredEntry {
+        void *pointer;
+        void (*deleter)(void *);
+        RetiredEntry *next;
+    };
+
+    // Bit 0 of state is the "inside a guard" flag, the rest is the announced epoch.
+    struct alignas(64) ThreadRecord {
+        std::atomic<uint64_t> state;
+        std::atomic<bool> inUse;
+        ThreadRecord *next;
+        int nesting;
+        size_t retiredSinceAdvance;
+        RetiredEntry *retired[3];
+        uint64_t retiredEpoch[3];
+
+        ThreadRecord() : state(0), inUse(true), next(nullptr), nesting(0), retiredSinceAdvance(0),
+                         retired{nullptr, nullptr, nullptr}, retiredEpoch{0, 0, 0} {}
+    };
+
+    // Releases the record of a thread when that thread exits.
+    struct ThreadHandle {
+        EpochDomain *domain;
+        ThreadRecord *record;
+
+        ~ThreadHandle() {
+            if (record != nullptr) {
+                domain->ReleaseRecord(record);
+            }
+        }
+    };
+
+    static constexpr size_t RetiredPerAdvance = 64;
+
+    std::atomic<uint64_t> globalEpoch;
+    std::atomic<ThreadRecord *> records;
+
+    EpochDomain() : globalEpoch(0), records(nullptr) {}
+
+    ThreadRecord *LocalRecord();
+
+    ThreadRecord *AcquireRecord();
+
+    void ReleaseRecord(ThreadRecord *record);
+
+    bool TryAdvance();
+
+    void Collect(ThreadRecord *record);
+
+    static void FreeList(RetiredEntry *entry);
+};
+
+// Keeps the calling thread inside the current epoch for the lifetime of the guard.
+class EpochGuard {
+public:
+    EpochGuard() : domain(EpochDomain::Global()) {
+        domain.Enter();
+    }
+
+    ~EpochGuard() {
+        domain.Leave();
+    }
+
+    EpochGuard(const EpochGuard &) = delete;
+    EpochGuard &operator=(const EpochGuard &) = delete;
+
+private:
+    EpochDomain &domain;
+};
+
+inline EpochDomain &EpochDomain::Global() {
+    static EpochDomain domain;
+    return domain;
+}
+
+inline EpochDomain::~EpochDomain() {
+    ThreadRecord *record = records.load(std::memory_order_acquire);
+    while (record != nullptr) {
+        ThreadRecord *next = record->next;
+        for (int i = 0; i < 3; ++i) {
+            FreeList(record->retired[i]);
+        }
+        delete record;
+        record = next;
+    }
+}
+
+inline EpochDomain::ThreadRecord *EpochDomain::LocalRecord() {
+    thread_local ThreadHandle handle{this, nullptr};
+    if (handle.record == nullptr) {
+        handle.record = AcquireRecord();
+    }
+    return handle.record;
+}
+
+inline EpochDomain::ThreadRecord *EpochDomain::AcquireRecord() {
+    // Records are never unlinked: a thread that exits hands its record, including any
+    // garbage still waiting in it, over to the next thread that starts.
+    for (ThreadRecord *record = records.load(std::memory_order_acquire); record != nullptr; record = record->next) {
+        bool expected = false;
+        if (!record->inUse.load(std::memory_order_relaxed) &&
+            record->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return record;
+        }
+    }
+
+    ThreadRecord *record = new ThreadRecord();
+    ThreadRecord *head = records.load(std::memory_order_relaxed);
+    do {
+        record->next = head;
+    } while (!records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+    return record;
+}
+
+inline void EpochDomain::ReleaseRecord(ThreadRecord *record) {
+    record->nesting = 0;
+    record->state.store(0, std::memory_order_release);
+    TryAdvance();
+    Collect(record);
+    record->inUse.store(false, std::memory_order_release);
+}
+
+inline void EpochDomain::Enter() {
+    ThreadRecord *record = LocalRecord();
+    if (record->nesting++ == 0) {
+        uint64_t epoch = globalEpoch.load(std::memory_order_relaxed);
+        record->state.store((epoch << 1) | 1, std::memory_order_relaxed);
+        // The announcement must be visible before any shared pointer is read.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+inline void EpochDomain::Leave() {
+    ThreadRecord *record = LocalRecord();
+    if (--record->nesting == 0) {
+        record->state.store(0, std::memory_order_release);
+    }
+}
+
+inline void EpochDomain::Retire(void *pointer, void (*deleter)(void *)) {
+    ThreadRecord *record = LocalRecord();
+    uint64_t epoch = globalEpoch.load(std::memory_order_acquire);
+    size_t slot = epoch % 3;
+
+    // The slot still holds garbage from epoch - 3 or earlier, which is already safe to free.
+    if (record->retiredEpoch[slot] != epoch) {
+        FreeList(record->retired[slot]);
+        record->retired[slot] = nullptr;
+        record->retiredEpoch[slot] = epoch;
+    }
+    record->retired[slot] = new RetiredEntry{pointer, deleter, record->retired[slot]};
+
+    if (++record->retiredSinceAdvance >= RetiredPerAdvance) {
+        record->retiredSinceAdvance = 0;
+        if (TryAdvance()) {
+            Collect(record);
+        }
+    }
+}
+
+inline bool EpochDomain::TryAdvance() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t epoch = globalEpoch.load(std::memory_order_acquire);
+    for (ThreadRecord *record = records.load(std::memory_order_acquire); record != nullptr; record = record->next) {
+        uint64_t state = record->state.load(std::memory_order_acquire);
+        if ((state & 1) != 0 && (state >> 1) != epoch) {
+            return false;
+        }
+    }
+    return globalEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+}
+
+inline void EpochDomain::Collect(ThreadRecord *record) {
+    uint64_t epoch = globalEpoch.load(std::memory_order_acquire);
+    for (int i = 0; i < 3; ++i) {
+        if (record->retired[i] != nullptr && record->retiredEpoch[i] + 2 <= epoch) {
+            FreeList(record->retired[i]);
+            record->retired[i] = nullptr;
+        }
+    }
+}
+
+inline void EpochDomain::FreeList(RetiredEntry *entry) {
+    while (entry != nullptr) {
+        RetiredEntry *next = entry->next;
+        entry->deleter(entry->pointer);
+        delete entry;
+        entry = next;
+    }
+}
+
+#endif // EPOCHRECLAMATION_H
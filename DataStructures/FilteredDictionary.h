@@ -0,0 +1,246 @@
+#ifndef FILTEREDDICTIONARY_H
+#define FILTEREDDICTIONARY_H
+
+#include "IDictionary.h"
+#include "HashTable.h"
+#include "BloomFilter.h"
+#include "UnqPtr.h"
+#include <optional>
+#include <stdexcept>
+
+// Puts a blocked Bloom filter in front of any dictionary so that lookups of absent keys,
+// the common case for the zeros of a sparse structure, are usually answered from one
+// cache line without touching the dictionary. Every added key goes into the filter too.
+// Removed keys stay in it as stale bits that only raise the false-positive rate; the
+// filter is rebuilt from the dictionary once they pile up, and when it outgrows its size.
+template<typename TKey, typename TElement, typename TDictionary = HashTable<TKey, TElement>>
+class FilteredDictionary : public IDictionary<TKey, TElement> {
+public:
+    FilteredDictionary(size_t bitsPerKey = 12);
+
+    virtual ~FilteredDictionary();
+
+    virtual size_t GetCount() const override;
+
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    virtual bool TryRemove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    virtual void Reserve(size_t count) override;
+
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetRange(const TKey &lower, const TKey &upper) const override;
+
+    const BlockedBloomFilter<TKey> &GetFilter() const;
+
+    // Lookups the filter let through that the dictionary then did not find.
+    size_t GetFalsePositiveCount() const;
+
+    // Lookups that reached the filter.
+    size_t GetLookupCount() const;
+
+private:
+    static const size_t MinimumFilterCapacity = 64;
+
+    TDictionary dictionary;
+    UnqPtr<BlockedBloomFilter<TKey>> filter;
+    size_t bitsPerKey;
+    // Keys removed since the filter was last rebuilt; their bits are still set.
+    size_t staleCount;
+    mutable size_t lookupCount;
+    mutable size_t falsePositiveCount;
+
+    bool MayContain(const TKey &key) const;
+
+    void AddToFilter(const TKey &key);
+
+    // Builds a fresh filter for at least capacity keys from the dictionary's current keys.
+    void RebuildFilter(size_t capacity);
+};
+
+template<typename TKey, typename TElement, typename TDictionary>
+FilteredDictionary<TKey, TElement, TDictionary>::FilteredDictionary(size_t bitsPerKey)
+        : dictionary(), filter(nullptr), bitsPerKey(bitsPerKey), staleCount(0), lookupCount(0),
+          falsePositiveCount(0) {
+    filter.reset(new BlockedBloomFilter<TKey>(MinimumFilterCapacity, bitsPerKey));
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+FilteredDictionary<TKey, TElement, TDictionary>::~FilteredDictionary() {
+
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+size_t FilteredDictionary<TKey, TElement, TDictionary>::GetCount() const {
+    return dictionary.GetCount();
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+size_t FilteredDictionary<TKey, TElement, TDictionary>::GetCapacity() const {
+    return dictionary.GetCapacity();
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+const BlockedBloomFilter<TKey> &FilteredDictionary<TKey, TElement, TDictionary>::GetFilter() const {
+    return *filter;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+size_t FilteredDictionary<TKey, TElement, TDictionary>::GetFalsePositiveCount() const {
+    return falsePositiveCount;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+size_t FilteredDictionary<TKey, TElement, TDictionary>::GetLookupCount() const {
+    return lookupCount;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+bool FilteredDictionary<TKey, TElement, TDictionary>::MayContain(const TKey &key) const {
+    ++lookupCount;
+    return filter->MayContain(key);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void FilteredDictionary<TKey, TElement, TDictionary>::AddToFilter(const TKey &key) {
+    if (dictionary.GetCount() + staleCount > filter->GetCapacity()) {
+        RebuildFilter(2 * dictionary.GetCount());
+    } else {
+        filter->Add(key);
+    }
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void FilteredDictionary<TKey, TElement, TDictionary>::RebuildFilter(size_t capacity) {
+    if (capacity < MinimumFilterCapacity) {
+        capacity = MinimumFilterCapacity;
+    }
+    filter.reset(new BlockedBloomFilter<TKey>(capacity, bitsPerKey));
+    auto iterator = dictionary.GetIterator();
+    while (iterator->MoveNext()) {
+        filter->Add(iterator->GetCurrentKey());
+    }
+    staleCount = 0;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+TElement FilteredDictionary<TKey, TElement, TDictionary>::Get(const TKey &key) const {
+    if (!MayContain(key)) {
+        throw std::runtime_error("Key not found.");
+    }
+    std::optional<TElement> value = dictionary.TryGet(key);
+    if (!value) {
+        ++falsePositiveCount;
+        throw std::runtime_error("Key not found.");
+    }
+    return *value;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+bool FilteredDictionary<TKey, TElement, TDictionary>::ContainsKey(const TKey &key) const {
+    if (!MayContain(key)) {
+        return false;
+    }
+    if (!dictionary.ContainsKey(key)) {
+        ++falsePositiveCount;
+        return false;
+    }
+    return true;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+std::optional<TElement> FilteredDictionary<TKey, TElement, TDictionary>::TryGet(const TKey &key) const {
+    if (!MayContain(key)) {
+        return std::nullopt;
+    }
+    std::optional<TElement> value = dictionary.TryGet(key);
+    if (!value) {
+        ++falsePositiveCount;
+    }
+    return value;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+TElement FilteredDictionary<TKey, TElement, TDictionary>::GetOrDefault(const TKey &key,
+                                                                       const TElement &defaultValue) const {
+    std::optional<TElement> value = TryGet(key);
+    return value ? *value : defaultValue;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void FilteredDictionary<TKey, TElement, TDictionary>::Add(const TKey &key, const TElement &element) {
+    Upsert(key, element);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+bool FilteredDictionary<TKey, TElement, TDictionary>::Upsert(const TKey &key, const TElement &element) {
+    bool inserted = dictionary.Upsert(key, element);
+    if (inserted) {
+        AddToFilter(key);
+    }
+    return inserted;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void FilteredDictionary<TKey, TElement, TDictionary>::Update(const TKey &key, const TElement &element) {
+    dictionary.Update(key, element);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void FilteredDictionary<TKey, TElement, TDictionary>::Remove(const TKey &key) {
+    if (!TryRemove(key)) {
+        throw std::runtime_error("Key not found.");
+    }
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+bool FilteredDictionary<TKey, TElement, TDictionary>::TryRemove(const TKey &key) {
+    // Removals are not counted as lookups, so the false-positive statistics cover reads only.
+    if (!filter->MayContain(key) || !dictionary.TryRemove(key)) {
+        return false;
+    }
+    ++staleCount;
+    // Once stale keys make up half of the filter, rebuilding it pays for itself.
+    if (2 * staleCount > filter->GetCapacity()) {
+        RebuildFilter(2 * dictionary.GetCount());
+    }
+    return true;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void FilteredDictionary<TKey, TElement, TDictionary>::Reserve(size_t count) {
+    dictionary.Reserve(count);
+    if (count > filter->GetCapacity()) {
+        RebuildFilter(count);
+    }
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+UnqPtr<IDictionaryIterator<TKey, TElement>> FilteredDictionary<TKey, TElement, TDictionary>::GetIterator() const {
+    return dictionary.GetIterator();
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+UnqPtr<IDictionaryIterator<TKey, TElement>> FilteredDictionary<TKey, TElement, TDictionary>::GetRange(
+        const TKey &lower, const TKey &upper) const {
+    return dictionary.GetRange(lower, upper);
+}
+
+#endif // FILTEREDDICTIONARY_H
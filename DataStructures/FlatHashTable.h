@@ -0,0 +1,338 @@
+#ifndef FLATHASHTABLE_H
+#define FLATHASHTABLE_H
+
+#include "IDictionary.h"
+#include "UnqPtr.h"
+#include "Hashers.h"
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+// Open-addressing hash table: keys and values are stored inline in one slot array.
+// Collisions are resolved with Robin Hood linear probing, removal uses backward shift,
+// so there are no tombstones and no per-entry allocations.
+template<typename TKey, typename TElement>
+class FlatHashTable : public IDictionary<TKey, TElement> {
+public:
+    FlatHashTable(size_t initialCapacity = 16);
+
+    virtual ~FlatHashTable();
+
+    virtual size_t GetCount() const override;
+
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    virtual bool TryRemove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    virtual void Reserve(size_t count) override;
+
+private:
+    struct Slot {
+        TKey key;
+        TElement value;
+        // Distance from the home slot, -1 marks an empty slot.
+        int distance;
+
+        Slot() : key(), value(), distance(-1) {}
+    };
+
+    static constexpr size_t NotFound = static_cast<size_t>(-1);
+    static constexpr double MaxLoadFactor = 0.875;
+
+    UnqPtr<Slot[]> slots;
+    size_t count;
+    size_t capacity;
+    size_t mask;
+
+    size_t HashFunction(const TKey &key) const;
+
+    size_t FindIndex(const TKey &key) const;
+
+    void InsertUnique(TKey key, TElement value);
+
+    void Rehash(size_t newCapacity);
+
+    static size_t RoundUpToPowerOfTwo(size_t value);
+
+    class FlatHashTableIterator : public IDictionaryIterator<TKey, TElement> {
+    public:
+        FlatHashTableIterator(const FlatHashTable *hashTable);
+
+        virtual ~FlatHashTableIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual TKey GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        const FlatHashTable *hashTable;
+        size_t slotIndex;
+        bool started;
+    };
+};
+
+template<typename TKey, typename TElement>
+FlatHashTable<TKey, TElement>::FlatHashTable(size_t initialCapacity)
+        : slots(nullptr), count(0), capacity(RoundUpToPowerOfTwo(initialCapacity < 8 ? 8 : initialCapacity)),
+          mask(0) {
+    slots.reset(new Slot[capacity]);
+    mask = capacity - 1;
+}
+
+template<typename TKey, typename TElement>
+FlatHashTable<TKey, TElement>::~FlatHashTable() {
+
+}
+
+template<typename TKey, typename TElement>
+size_t FlatHashTable<TKey, TElement>::GetCount() const {
+    return count;
+}
+
+template<typename TKey, typename TElement>
+size_t FlatHashTable<TKey, TElement>::GetCapacity() const {
+    return capacity;
+}
+
+template<typename TKey, typename TElement>
+size_t FlatHashTable<TKey, TElement>::RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+template<typename TKey, typename TElement>
+size_t FlatHashTable<TKey, TElement>::HashFunction(const TKey &key) const {
+    return DefaultHash<TKey>()(key);
+}
+
+template<typename TKey, typename TElement>
+size_t FlatHashTable<TKey, TElement>::FindIndex(const TKey &key) const {
+    size_t index = HashFunction(key) & mask;
+    int distance = 0;
+
+    while (true) {
+        const Slot &slot = slots[index];
+        // Robin Hood invariant: once the resident is closer to home than we are, the key is absent.
+        if (slot.distance < distance) {
+            return NotFound;
+        }
+        if (slot.key == key) {
+            return index;
+        }
+        index = (index + 1) & mask;
+        ++distance;
+    }
+}
+
+template<typename TKey, typename TElement>
+void FlatHashTable<TKey, TElement>::InsertUnique(TKey key, TElement value) {
+    size_t index = HashFunction(key) & mask;
+    int distance = 0;
+
+    while (true) {
+        Slot &slot = slots[index];
+        if (slot.distance < 0) {
+            slot.key = std::move(key);
+            slot.value = std::move(value);
+            slot.distance = distance;
+            return;
+        }
+        if (slot.distance < distance) {
+            std::swap(key, slot.key);
+            std::swap(value, slot.value);
+            std::swap(distance, slot.distance);
+        }
+        index = (index + 1) & mask;
+        ++distance;
+    }
+}
+
+template<typename TKey, typename TElement>
+void FlatHashTable<TKey, TElement>::Add(const TKey &key, const TElement &element) {
+    Upsert(key, element);
+}
+
+template<typename TKey, typename TElement>
+bool FlatHashTable<TKey, TElement>::Upsert(const TKey &key, const TElement &element) {
+    size_t index = FindIndex(key);
+    if (index != NotFound) {
+        slots[index].value = element;
+        return false;
+    }
+
+    if (static_cast<double>(count + 1) > MaxLoadFactor * capacity) {
+        Rehash(capacity * 2);
+    }
+
+    InsertUnique(key, element);
+    ++count;
+    return true;
+}
+
+template<typename TKey, typename TElement>
+void FlatHashTable<TKey, TElement>::Reserve(size_t count) {
+    size_t newCapacity = RoundUpToPowerOfTwo(static_cast<size_t>(count / MaxLoadFactor) + 1);
+    if (newCapacity > capacity) {
+        Rehash(newCapacity);
+    }
+}
+
+template<typename TKey, typename TElement>
+void FlatHashTable<TKey, TElement>::Remove(const TKey &key) {
+    if (!TryRemove(key)) {
+        throw std::runtime_error("Key not found.");
+    }
+}
+
+template<typename TKey, typename TElement>
+bool FlatHashTable<TKey, TElement>::TryRemove(const TKey &key) {
+    size_t index = FindIndex(key);
+    if (index == NotFound) {
+        return false;
+    }
+
+    size_t next = (index + 1) & mask;
+    while (slots[next].distance > 0) {
+        slots[index].key = std::move(slots[next].key);
+        slots[index].value = std::move(slots[next].value);
+        slots[index].distance = slots[next].distance - 1;
+        index = next;
+        next = (next + 1) & mask;
+    }
+
+    slots[index].key = TKey();
+    slots[index].value = TElement();
+    slots[index].distance = -1;
+    --count;
+    return true;
+}
+
+template<typename TKey, typename TElement>
+void FlatHashTable<TKey, TElement>::Update(const TKey &key, const TElement &element) {
+    size_t index = FindIndex(key);
+    if (index == NotFound) {
+        throw std::runtime_error("Key not found.");
+    }
+    slots[index].value = element;
+}
+
+template<typename TKey, typename TElement>
+bool FlatHashTable<TKey, TElement>::ContainsKey(const TKey &key) const {
+    return FindIndex(key) != NotFound;
+}
+
+template<typename TKey, typename TElement>
+TElement FlatHashTable<TKey, TElement>::Get(const TKey &key) const {
+    size_t index = FindIndex(key);
+    if (index == NotFound) {
+        throw std::runtime_error("Key not found.");
+    }
+    return slots[index].value;
+}
+
+template<typename TKey, typename TElement>
+std::optional<TElement> FlatHashTable<TKey, TElement>::TryGet(const TKey &key) const {
+    size_t index = FindIndex(key);
+    if (index == NotFound) {
+        return std::nullopt;
+    }
+    return slots[index].value;
+}
+
+template<typename TKey, typename TElement>
+TElement FlatHashTable<TKey, TElement>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    size_t index = FindIndex(key);
+    return index == NotFound ? defaultValue : slots[index].value;
+}
+
+template<typename TKey, typename TElement>
+void FlatHashTable<TKey, TElement>::Rehash(size_t newCapacity) {
+    UnqPtr<Slot[]> oldSlots(std::move(slots));
+    size_t oldCapacity = capacity;
+
+    slots.reset(new Slot[newCapacity]);
+    capacity = newCapacity;
+    mask = newCapacity - 1;
+
+    for (size_t i = 0; i < oldCapacity; ++i) {
+        if (oldSlots[i].distance >= 0) {
+            InsertUnique(std::move(oldSlots[i].key), std::move(oldSlots[i].value));
+        }
+    }
+}
+
+template<typename TKey, typename TElement>
+FlatHashTable<TKey, TElement>::FlatHashTableIterator::FlatHashTableIterator(const FlatHashTable *hashTable)
+        : hashTable(hashTable), slotIndex(0), started(false) {
+}
+
+template<typename TKey, typename TElement>
+bool FlatHashTable<TKey, TElement>::FlatHashTableIterator::MoveNext() {
+    if (started) {
+        ++slotIndex;
+    }
+    started = true;
+
+    while (slotIndex < hashTable->capacity) {
+        if (hashTable->slots[slotIndex].distance >= 0) {
+            return true;
+        }
+        ++slotIndex;
+    }
+
+    return false;
+}
+
+template<typename TKey, typename TElement>
+void FlatHashTable<TKey, TElement>::FlatHashTableIterator::Reset() {
+    slotIndex = 0;
+    started = false;
+}
+
+template<typename TKey, typename TElement>
+TKey FlatHashTable<TKey, TElement>::FlatHashTableIterator::GetCurrentKey() const {
+    if (!started || slotIndex >= hashTable->capacity)
+        throw std::out_of_range("Iterator out of range");
+
+    return hashTable->slots[slotIndex].key;
+}
+
+template<typename TKey, typename TElement>
+TElement FlatHashTable<TKey, TElement>::FlatHashTableIterator::GetCurrentValue() const {
+    if (!started || slotIndex >= hashTable->capacity)
+        throw std::out_of_range("Iterator out of range");
+
+    return hashTable->slots[slotIndex].value;
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> FlatHashTable<TKey, TElement>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new FlatHashTableIterator(this));
+}
+
+#endif // FLATHASHTABLE_H
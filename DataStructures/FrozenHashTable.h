@@ -0,0 +1,460 @@
+#ifndef FROZENHASHTABLE_H
+#define FROZENHASHTABLE_H
+
+#include "IDictionary.h"
+#include "UnqPtr.h"
+#include "Hashers.h"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+// Immutable dictionary built once from another one. Keys and elements are packed into a
+// single array addressed by a minimal perfect hash in the style of PTHash: keys are split
+// into small buckets, and every bucket gets a 16-bit pilot chosen so that its keys land
+// on free positions. A lookup hashes the key, reads its bucket's pilot and probes exactly
+// one entry. Positions are drawn from a slightly larger range to keep the pilot search
+// short; the few that fall past the end are remapped into the holes that range leaves,
+// so the entry array has no empty slots. Overhead is about 3 bits per key.
+//
+// The key set is fixed: Add and Upsert of a new key and Remove throw, while existing
+// elements can still be overwritten with Update, Add or Upsert.
+template<typename TKey, typename TElement>
+class FrozenHashTable : public IDictionary<TKey, TElement> {
+public:
+    explicit FrozenHashTable(const IDictionary<TKey, TElement> &source);
+
+    virtual ~FrozenHashTable();
+
+    virtual size_t GetCount() const override;
+
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    // Bytes held by the entries, the pilots and the remap table.
+    size_t GetMemoryUsage() const;
+
+    // Bits per key spent on the perfect hash itself (pilots and remap table).
+    double GetBitsPerKey() const;
+
+private:
+    struct Entry {
+        TKey key;
+        TElement value;
+
+        Entry() : key(), value() {}
+    };
+
+    // Average number of keys per bucket.
+    static const size_t BucketLoad = 6;
+    // DenseKeyShare of the keys go to the first DenseBucketShare of the buckets. The big
+    // dense buckets are placed while the table is still empty, which leaves small buckets
+    // for the crowded end of the search.
+    static constexpr double DenseKeyShare = 0.6;
+    static constexpr double DenseBucketShare = 0.3;
+    // Positions are drawn from count / LoadFactor slots.
+    static constexpr double LoadFactor = 0.99;
+    static const uint32_t MaxPilot = 0xFFFF;
+    static const int MaxSeedAttempts = 16;
+
+    UnqPtr<Entry[]> entries;
+    size_t count;
+    UnqPtr<uint16_t[]> pilots;
+    size_t bucketCount;
+    size_t denseBucketCount;
+    // Size of the position range; positions at or past count are looked up in remap.
+    size_t positionCount;
+    UnqPtr<uint32_t[]> remap;
+    uint64_t seed;
+
+    static uint64_t HashFunction(const TKey &key);
+
+    size_t BucketOf(uint64_t hash) const;
+
+    size_t PositionOf(uint64_t hash, uint32_t pilot) const;
+
+    // Index of key in entries, or count if it is absent.
+    size_t FindIndex(const TKey &key) const;
+
+    // Tries to find pilots for all buckets with the current seed. keyOrder lists the keys
+    // grouped by bucket, bucketStart[b] is where bucket b begins in it.
+    bool SearchPilots(const uint64_t *hashes, const size_t *keyOrder, const size_t *bucketStart,
+                      const size_t *bucketOrder, uint64_t *taken, uint32_t *positions);
+
+    class FrozenHashTableIterator : public IDictionaryIterator<TKey, TElement> {
+    public:
+        FrozenHashTableIterator(const FrozenHashTable *hashTable);
+
+        virtual ~FrozenHashTableIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual TKey GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        const FrozenHashTable *hashTable;
+        size_t entryIndex;
+        bool started;
+    };
+};
+
+// Builds the frozen copy of a dictionary behind the IDictionary interface.
+template<typename TKey, typename TElement>
+UnqPtr<IDictionary<TKey, TElement>> Freeze(const IDictionary<TKey, TElement> &source) {
+    return UnqPtr<IDictionary<TKey, TElement>>(new FrozenHashTable<TKey, TElement>(source));
+}
+
+template<typename TKey, typename TElement>
+FrozenHashTable<TKey, TElement>::FrozenHashTable(const IDictionary<TKey, TElement> &source)
+        : entries(nullptr), count(source.GetCount()), pilots(nullptr), bucketCount(0), denseBucketCount(0),
+          positionCount(0),
+          remap(nullptr), seed(0) {
+    UnqPtr<TKey[]> keys(new TKey[count]);
+    UnqPtr<TElement[]> values(new TElement[count]);
+    size_t index = 0;
+    auto iterator = source.GetIterator();
+    while (iterator->MoveNext() && index < count) {
+        keys[index] = iterator->GetCurrentKey();
+        values[index] = iterator->GetCurrentValue();
+        ++index;
+    }
+    count = index;
+
+    bucketCount = count / BucketLoad + 2;
+    denseBucketCount = static_cast<size_t>(bucketCount * DenseBucketShare) + 1;
+    positionCount = static_cast<size_t>(count / LoadFactor) + 1;
+    pilots.reset(new uint16_t[bucketCount]);
+
+    UnqPtr<uint64_t[]> hashes(new uint64_t[count]);
+    for (size_t i = 0; i < count; ++i) {
+        hashes[i] = HashFunction(keys[i]);
+    }
+
+    // Group the keys by bucket with a counting sort.
+    UnqPtr<size_t[]> bucketStart(new size_t[bucketCount + 1]);
+    for (size_t b = 0; b <= bucketCount; ++b) {
+        bucketStart[b] = 0;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        ++bucketStart[BucketOf(hashes[i]) + 1];
+    }
+    size_t largestBucket = 0;
+    for (size_t b = 0; b < bucketCount; ++b) {
+        largestBucket = std::max(largestBucket, bucketStart[b + 1]);
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    UnqPtr<size_t[]> keyOrder(new size_t[count]);
+    UnqPtr<size_t[]> fill(new size_t[bucketCount]);
+    for (size_t b = 0; b < bucketCount; ++b) {
+        fill[b] = bucketStart[b];
+    }
+    for (size_t i = 0; i < count; ++i) {
+        keyOrder[fill[BucketOf(hashes[i])]++] = i;
+    }
+
+    // Largest buckets are placed first, while most positions are still free.
+    UnqPtr<size_t[]> sizeStart(new size_t[largestBucket + 2]);
+    for (size_t s = 0; s <= largestBucket + 1; ++s) {
+        sizeStart[s] = 0;
+    }
+    for (size_t b = 0; b < bucketCount; ++b) {
+        ++sizeStart[largestBucket - (bucketStart[b + 1] - bucketStart[b]) + 1];
+    }
+    for (size_t s = 0; s <= largestBucket; ++s) {
+        sizeStart[s + 1] += sizeStart[s];
+    }
+    UnqPtr<size_t[]> bucketOrder(new size_t[bucketCount]);
+    for (size_t b = 0; b < bucketCount; ++b) {
+        bucketOrder[sizeStart[largestBucket - (bucketStart[b + 1] - bucketStart[b])]++] = b;
+    }
+
+    size_t takenWords = (positionCount + 63) / 64;
+    UnqPtr<uint64_t[]> taken(new uint64_t[takenWords]);
+    UnqPtr<uint32_t[]> positions(new uint32_t[count]);
+    bool built = false;
+    for (int attempt = 0; attempt < MaxSeedAttempts && !built; ++attempt) {
+        seed = MixHash(static_cast<uint64_t>(attempt) + 1);
+        for (size_t w = 0; w < takenWords; ++w) {
+            taken[w] = 0;
+        }
+        built = SearchPilots(hashes.get(), keyOrder.get(), bucketStart.get(), bucketOrder.get(), taken.get(),
+                             positions.get());
+    }
+    if (!built) {
+        throw std::runtime_error("Cannot build a perfect hash for these keys.");
+    }
+
+    // Every position past the end is paired with one of the holes left below it.
+    remap.reset(new uint32_t[positionCount - count]);
+    size_t hole = 0;
+    for (size_t p = count; p < positionCount; ++p) {
+        if (taken[p / 64] & (uint64_t(1) << (p % 64))) {
+            while (taken[hole / 64] & (uint64_t(1) << (hole % 64))) {
+                ++hole;
+            }
+            remap[p - count] = static_cast<uint32_t>(hole++);
+        } else {
+            remap[p - count] = 0;
+        }
+    }
+
+    entries.reset(new Entry[count]);
+    for (size_t i = 0; i < count; ++i) {
+        size_t position = positions[i];
+        if (position >= count) {
+            position = remap[position - count];
+        }
+        entries[position].key = std::move(keys[i]);
+        entries[position].value = std::move(values[i]);
+    }
+}
+
+template<typename TKey, typename TElement>
+bool FrozenHashTable<TKey, TElement>::SearchPilots(const uint64_t *hashes, const size_t *keyOrder,
+                                                   const size_t *bucketStart, const size_t *bucketOrder,
+                                                   uint64_t *taken, uint32_t *positions) {
+    // bucketOrder starts with the largest bucket, which sizes the scratch arrays.
+    size_t largestBucket = bucketStart[bucketOrder[0] + 1] - bucketStart[bucketOrder[0]];
+    UnqPtr<uint64_t[]> bucketHashes(new uint64_t[largestBucket + 1]);
+    UnqPtr<size_t[]> bucketPositions(new size_t[largestBucket + 1]);
+
+    for (size_t i = 0; i < bucketCount; ++i) {
+        size_t bucket = bucketOrder[i];
+        size_t begin = bucketStart[bucket];
+        size_t size = bucketStart[bucket + 1] - begin;
+        pilots[bucket] = 0;
+        if (size == 0) {
+            continue;
+        }
+
+        for (size_t k = 0; k < size; ++k) {
+            bucketHashes[k] = hashes[keyOrder[begin + k]];
+        }
+
+        bool placed = false;
+        for (uint32_t pilot = 0; pilot <= MaxPilot && !placed; ++pilot) {
+            size_t k = 0;
+            for (; k < size; ++k) {
+                size_t position = PositionOf(bucketHashes[k], pilot);
+                if (taken[position / 64] & (uint64_t(1) << (position % 64))) {
+                    break;
+                }
+                // Two keys of the same bucket must not share a position either.
+                size_t j = 0;
+                while (j < k && bucketPositions[j] != position) {
+                    ++j;
+                }
+                if (j < k) {
+                    break;
+                }
+                bucketPositions[k] = position;
+            }
+
+            if (k == size) {
+                for (size_t j = 0; j < size; ++j) {
+                    taken[bucketPositions[j] / 64] |= uint64_t(1) << (bucketPositions[j] % 64);
+                    positions[keyOrder[begin + j]] = static_cast<uint32_t>(bucketPositions[j]);
+                }
+                pilots[bucket] = static_cast<uint16_t>(pilot);
+                placed = true;
+            }
+        }
+
+        if (!placed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename TKey, typename TElement>
+FrozenHashTable<TKey, TElement>::~FrozenHashTable() {
+
+}
+
+template<typename TKey, typename TElement>
+uint64_t FrozenHashTable<TKey, TElement>::HashFunction(const TKey &key) {
+    return static_cast<uint64_t>(DefaultHash<TKey>()(key));
+}
+
+// Both mappings scale a 32-bit half of a hash to the range with a multiply instead of a
+// division. The low half of the hash picks the dense or sparse buckets, the high half
+// the bucket within them, and the position comes from a remix of the whole hash.
+template<typename TKey, typename TElement>
+size_t FrozenHashTable<TKey, TElement>::BucketOf(uint64_t hash) const {
+    const uint64_t denseThreshold = static_cast<uint64_t>(DenseKeyShare * 4294967296.0);
+    uint64_t high = hash >> 32;
+    if ((hash & 0xFFFFFFFFULL) < denseThreshold) {
+        return static_cast<size_t>((high * denseBucketCount) >> 32);
+    }
+    return denseBucketCount + static_cast<size_t>((high * (bucketCount - denseBucketCount)) >> 32);
+}
+
+template<typename TKey, typename TElement>
+size_t FrozenHashTable<TKey, TElement>::PositionOf(uint64_t hash, uint32_t pilot) const {
+    uint64_t mixed = MixHash(hash ^ (seed + pilot * 0x9e3779b97f4a7c15ULL));
+    return static_cast<size_t>(((mixed >> 32) * positionCount) >> 32);
+}
+
+template<typename TKey, typename TElement>
+size_t FrozenHashTable<TKey, TElement>::FindIndex(const TKey &key) const {
+    if (count == 0) {
+        return count;
+    }
+
+    uint64_t hash = HashFunction(key);
+    size_t position = PositionOf(hash, pilots[BucketOf(hash)]);
+    if (position >= count) {
+        position = remap[position - count];
+    }
+    return entries[position].key == key ? position : count;
+}
+
+template<typename TKey, typename TElement>
+size_t FrozenHashTable<TKey, TElement>::GetCount() const {
+    return count;
+}
+
+template<typename TKey, typename TElement>
+size_t FrozenHashTable<TKey, TElement>::GetCapacity() const {
+    return count;
+}
+
+template<typename TKey, typename TElement>
+size_t FrozenHashTable<TKey, TElement>::GetMemoryUsage() const {
+    return sizeof(*this) + count * sizeof(Entry) + bucketCount * sizeof(uint16_t) +
+           (positionCount - count) * sizeof(uint32_t);
+}
+
+template<typename TKey, typename TElement>
+double FrozenHashTable<TKey, TElement>::GetBitsPerKey() const {
+    if (count == 0) {
+        return 0;
+    }
+    size_t bits = 8 * (bucketCount * sizeof(uint16_t) + (positionCount - count) * sizeof(uint32_t));
+    return static_cast<double>(bits) / count;
+}
+
+template<typename TKey, typename TElement>
+TElement FrozenHashTable<TKey, TElement>::Get(const TKey &key) const {
+    size_t index = FindIndex(key);
+    if (index == count) {
+        throw std::runtime_error("Key not found.");
+    }
+    return entries[index].value;
+}
+
+template<typename TKey, typename TElement>
+bool FrozenHashTable<TKey, TElement>::ContainsKey(const TKey &key) const {
+    return FindIndex(key) != count;
+}
+
+template<typename TKey, typename TElement>
+std::optional<TElement> FrozenHashTable<TKey, TElement>::TryGet(const TKey &key) const {
+    size_t index = FindIndex(key);
+    if (index == count) {
+        return std::nullopt;
+    }
+    return entries[index].value;
+}
+
+template<typename TKey, typename TElement>
+TElement FrozenHashTable<TKey, TElement>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    size_t index = FindIndex(key);
+    return index == count ? defaultValue : entries[index].value;
+}
+
+template<typename TKey, typename TElement>
+void FrozenHashTable<TKey, TElement>::Add(const TKey &key, const TElement &element) {
+    Upsert(key, element);
+}
+
+template<typename TKey, typename TElement>
+bool FrozenHashTable<TKey, TElement>::Upsert(const TKey &key, const TElement &element) {
+    size_t index = FindIndex(key);
+    if (index == count) {
+        throw std::runtime_error("Cannot add a key to a frozen dictionary.");
+    }
+    entries[index].value = element;
+    return false;
+}
+
+template<typename TKey, typename TElement>
+void FrozenHashTable<TKey, TElement>::Update(const TKey &key, const TElement &element) {
+    size_t index = FindIndex(key);
+    if (index == count) {
+        throw std::runtime_error("Key not found.");
+    }
+    entries[index].value = element;
+}
+
+template<typename TKey, typename TElement>
+void FrozenHashTable<TKey, TElement>::Remove(const TKey &key) {
+    (void)key;
+    throw std::runtime_error("Cannot remove a key from a frozen dictionary.");
+}
+
+template<typename TKey, typename TElement>
+FrozenHashTable<TKey, TElement>::FrozenHashTableIterator::FrozenHashTableIterator(const FrozenHashTable *hashTable)
+        : hashTable(hashTable), entryIndex(0), started(false) {
+}
+
+template<typename TKey, typename TElement>
+bool FrozenHashTable<TKey, TElement>::FrozenHashTableIterator::MoveNext() {
+    if (started && entryIndex < hashTable->count) {
+        ++entryIndex;
+    }
+    started = true;
+    return entryIndex < hashTable->count;
+}
+
+template<typename TKey, typename TElement>
+void FrozenHashTable<TKey, TElement>::FrozenHashTableIterator::Reset() {
+    entryIndex = 0;
+    started = false;
+}
+
+template<typename TKey, typename TElement>
+TKey FrozenHashTable<TKey, TElement>::FrozenHashTableIterator::GetCurrentKey() const {
+    if (!started || entryIndex >= hashTable->count)
+        throw std::out_of_range("Iterator out of range");
+
+    return hashTable->entries[entryIndex].key;
+}
+
+template<typename TKey, typename TElement>
+TElement FrozenHashTable<TKey, TElement>::FrozenHashTableIterator::GetCurrentValue() const {
+    if (!started || entryIndex >= hashTable->count)
+        throw std::out_of_range("Iterator out of range");
+
+    return hashTable->entries[entryIndex].value;
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> FrozenHashTable<TKey, TElement>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new FrozenHashTableIterator(this));
+}
+
+#endif // FROZENHASHTABLE_H
@@ -6,15 +6,25 @@
 #include "LinkedListSmart.h"
 #include "ShrdPtr.h"
 #include "UnqPtr.h"
-#include "IndexPair.h"
-#include <functional>
+#include "Hashers.h"
+#include "HashTableStats.h"
+#include "Prefetch.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <optional>
 #include <stdexcept>
-#include <type_traits>
+#include <utility>
 
-template<typename TKey, typename TElement>
+// TStats receives lookup and rehash events (see HashTableStats.h); the default records nothing.
+template<typename TKey, typename TElement, typename THash = DefaultHash<TKey>, typename TStats = NoHashTableStats>
 class HashTable : public IDictionary<TKey, TElement> {
 public:
-    HashTable(size_t initialCapacity = 16);
+    // The bucket count is a power of two and buckets are picked by the low bits of THash,
+    // so THash must spread its entropy into those bits (see Hashers.h).
+    // With incrementalRehash the table grows by migrating a few buckets on every mutation
+    // instead of reinserting all entries inside a single Add.
+    HashTable(size_t initialCapacity = 16, bool incrementalRehash = false);
 
     virtual ~HashTable();
 
@@ -30,26 +40,158 @@ public:
 
     virtual void Remove(const TKey &key) override;
 
+    virtual bool TryRemove(const TKey &key) override;
+
     virtual void Update(const TKey &key, const TElement &element) override;
 
     virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
 
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    virtual void Add(const TKey &key, TElement &&element) override;
+
+    virtual void Update(const TKey &key, TElement &&element) override;
+
+    virtual bool Upsert(const TKey &key, TElement &&element) override;
+
+    // Builds the element from args inside the new chain node; an existing key gets a
+    // freshly built element move-assigned.
+    template<typename... Args>
+    void Emplace(const TKey &key, Args &&... args);
+
+    virtual void ContainsMany(const TKey *keys, size_t count, bool *results) const override;
+
+    virtual size_t GetMany(const TKey *keys, size_t count, TElement *values, bool *found) const override;
+
+    virtual void AddRange(const TKey *keys, const TElement *elements, size_t count) override;
+
+    // Grows the table once so that count entries fit under the max load factor. A running
+    // incremental rehash is finished first.
+    virtual void Reserve(size_t count) override;
+
+    // Rebuilds the table with the fewest buckets that hold the current entries under the
+    // max load factor, giving back memory left over from earlier growth or removals.
+    void ShrinkToFit();
+
+    double GetMaxLoadFactor() const;
+
+    // Entries per bucket allowed before the table doubles. Throws std::invalid_argument
+    // for a non-positive value; a lower value than the current load grows the table now.
+    void SetMaxLoadFactor(double loadFactor);
+
+    // Estimated bytes held by the table: the table object, bucket segments and chain
+    // nodes. Memory owned by the keys and elements themselves is not included.
+    size_t GetMemoryUsage() const;
+
+    bool IsRehashing() const;
+
+    // Chain lengths and load factor, computed by walking the buckets.
+    CollisionStats GetCollisionStats() const;
+
+    // Lookup and rehash counters gathered by the TStats policy since construction or the
+    // last ResetTelemetry.
+    const TStats &GetTelemetry() const;
+
+    void ResetTelemetry();
+
 private:
     struct KeyValuePair {
         TKey key;
         TElement value;
 
         KeyValuePair(const TKey &k, const TElement &v) : key(k), value(v) {}
+
+        template<typename... Args>
+        KeyValuePair(std::in_place_t, const TKey &k, Args &&... args) : key(k), value(std::forward<Args>(args)...) {}
     };
 
-    UnqPtr<DynamicArraySmart<LinkedListSmart<KeyValuePair>>> table;
+    // Bucket storage split into fixed-size segments that are allocated on first write, so
+    // creating or dropping a table costs O(capacity / SegmentSize) instead of O(capacity).
+    class BucketArray {
+    public:
+        static const size_t SegmentSize = 1024;
+
+        explicit BucketArray(size_t bucketCount);
+
+        // Returns nullptr for a bucket whose segment was never written, i.e. an empty chain.
+        LinkedListSmart<KeyValuePair> *Find(size_t index) const;
+
+        LinkedListSmart<KeyValuePair> &Get(size_t index);
+
+        void ReleaseSegment(size_t segmentIndex);
+
+        // Bytes of the segment table plus every allocated segment.
+        size_t GetMemoryUsage() const;
+
+    private:
+        UnqPtr<UnqPtr<LinkedListSmart<KeyValuePair>[]>[]> segments;
+        size_t segmentCount;
+    };
+
+    static const size_t MigrationBucketsPerStep = 8;
+    static constexpr double DefaultMaxLoadFactor = 0.75;
+    // Keys handled per prefetch round by the batch operations.
+    static const size_t BatchSize = 16;
+
+    UnqPtr<BucketArray> table;
     size_t count;
     size_t capacity;
+    bool incrementalRehash;
+    double maxLoadFactor;
+
+    // Previous table while an incremental rehash is running. Buckets below
+    // migrationIndex have already been moved into table.
+    UnqPtr<BucketArray> oldTable;
+    size_t oldCapacity;
+    size_t migrationIndex;
+
+    [[no_unique_address]] TStats telemetry;
 
     size_t HashFunction(const TKey &key) const;
 
-    void Rehash();
+    static size_t RoundUpToPowerOfTwo(size_t value);
+
+    // Smallest power-of-two bucket count that keeps count entries under maxLoadFactor.
+    size_t CapacityFor(size_t count) const;
+
+    // The read path: Get, ContainsKey, TryGet, GetOrDefault and the batch lookups. Each call
+    // is reported to the telemetry as one lookup.
+    KeyValuePair *Find(const TKey &key) const;
+
+    KeyValuePair *Find(const TKey &key, size_t hash) const;
 
+    // The search behind Find, also used by the write paths, which are not counted as lookups.
+    // probes receives the number of key comparisons.
+    KeyValuePair *Locate(const TKey &key, size_t hash, size_t &probes) const;
+
+    // Inserts key with an element built from args, or overwrites the existing element.
+    // Returns true if the key was inserted.
+    template<typename... Args>
+    bool EmplaceHashed(const TKey &key, size_t hash, Args &&... args);
+
+    // Hashes a group of keys, then prefetches their bucket slots and first chain nodes.
+    void PrefetchGroup(const TKey *keys, size_t count, size_t *hashes) const;
+
+    LinkedListSmart<KeyValuePair> *FindOldChain(size_t hash) const;
+
+    // Adds the number of keys compared to probes.
+    static KeyValuePair *FindInChain(const LinkedListSmart<KeyValuePair> &chain, const TKey &key, size_t &probes);
+
+    static bool RemoveFromChain(LinkedListSmart<KeyValuePair> &chain, const TKey &key);
+
+    // Moves every entry into a new table of newCapacity buckets in one go.
+    void Rehash(size_t newCapacity);
+
+    void BeginMigration();
+
+    void MigrateStep(size_t bucketCount);
+
+    // Holds its position as a cursor into the current chain, so every step is O(1):
+    // advancing follows one next pointer and empty bucket segments are skipped whole.
     class HashTableIterator : public IDictionaryIterator<TKey, TElement> {
     public:
         HashTableIterator(const HashTable *hashTable);
@@ -66,198 +208,616 @@ private:
 
     private:
         const HashTable *hashTable;
+        // Remaining old buckets are visited first, then the current table.
+        bool inOldTable;
         size_t bucketIndex;
-        int listIndex;
+        typename LinkedListSmart<KeyValuePair>::Iterator position;
+        // Entry under the cursor, nullptr before the first and after the last one.
+        const KeyValuePair *current;
+
+        // Moves to the first entry at or after bucketIndex.
+        bool SeekChain();
     };
 };
 
-template<typename TKey, typename TElement>
-HashTable<TKey, TElement>::HashTable(size_t initialCapacity)
-        : table(new DynamicArraySmart<LinkedListSmart<KeyValuePair>>(static_cast<int>(initialCapacity))), count(0),
-          capacity(initialCapacity) {
-    for (size_t i = 0; i < capacity; ++i) {
-        table->Append(LinkedListSmart<KeyValuePair>());
-    }
+template<typename TKey, typename TElement, typename THash, typename TStats>
+HashTable<TKey, TElement, THash, TStats>::HashTable(size_t initialCapacity, bool incrementalRehash)
+        : table(nullptr), count(0), capacity(RoundUpToPowerOfTwo(initialCapacity)),
+          incrementalRehash(incrementalRehash), maxLoadFactor(DefaultMaxLoadFactor), oldTable(nullptr),
+          oldCapacity(0), migrationIndex(0) {
+    table.reset(new BucketArray(capacity));
 }
 
-template<typename TKey, typename TElement>
-HashTable<TKey, TElement>::~HashTable() {
+template<typename TKey, typename TElement, typename THash, typename TStats>
+HashTable<TKey, TElement, THash, TStats>::~HashTable() {
 
 }
 
-template<typename TKey, typename TElement>
-size_t HashTable<TKey, TElement>::GetCount() const {
+template<typename TKey, typename TElement, typename THash, typename TStats>
+size_t HashTable<TKey, TElement, THash, TStats>::GetCount() const {
     return count;
 }
 
-template<typename TKey, typename TElement>
-size_t HashTable<TKey, TElement>::GetCapacity() const {
+template<typename TKey, typename TElement, typename THash, typename TStats>
+size_t HashTable<TKey, TElement, THash, TStats>::GetCapacity() const {
     return capacity;
 }
 
-template<typename TKey, typename TElement>
-size_t HashTable<TKey, TElement>::HashFunction(const TKey &key) const {
-    if constexpr (std::is_same<TKey, IndexPair>::value) {
-        return IndexPairHash()(key);
-    } else {
-        return std::hash<TKey>()(key);
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::Reserve(size_t count) {
+    size_t newCapacity = CapacityFor(count);
+    if (newCapacity > capacity) {
+        Rehash(newCapacity);
     }
 }
 
-template<typename TKey, typename TElement>
-void HashTable<TKey, TElement>::Add(const TKey &key, const TElement &element) {
-    size_t index = HashFunction(key) % capacity;
-    LinkedListSmart<KeyValuePair> &chain = table->Get(static_cast<int>(index));
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::ShrinkToFit() {
+    size_t newCapacity = CapacityFor(count);
+    if (newCapacity < capacity) {
+        Rehash(newCapacity);
+    }
+}
 
-    auto iterator = chain.begin();
-    for (; iterator != chain.end(); ++iterator) {
-        if ((*iterator).key == key) {
-            (*iterator).value = element;
-            return;
-        }
+template<typename TKey, typename TElement, typename THash, typename TStats>
+double HashTable<TKey, TElement, THash, TStats>::GetMaxLoadFactor() const {
+    return maxLoadFactor;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::SetMaxLoadFactor(double loadFactor) {
+    if (!(loadFactor > 0)) {
+        throw std::invalid_argument("Max load factor must be positive.");
     }
+    maxLoadFactor = loadFactor;
+    Reserve(count);
+}
 
-    chain.Append(KeyValuePair(key, element));
-    ++count;
+template<typename TKey, typename TElement, typename THash, typename TStats>
+size_t HashTable<TKey, TElement, THash, TStats>::GetMemoryUsage() const {
+    // A chain node is one make_shared block: the control block (a vtable pointer and two
+    // counters) followed by the pair and the next pointer.
+    const size_t nodeSize = 2 * sizeof(void *) + sizeof(KeyValuePair) + sizeof(std::shared_ptr<void>);
 
-    if (static_cast<double>(count) / capacity > 0.75) {
-        Rehash();
+    size_t bytes = sizeof(*this) + sizeof(BucketArray) + table->GetMemoryUsage() + count * nodeSize;
+    if (oldTable) {
+        bytes += sizeof(BucketArray) + oldTable->GetMemoryUsage();
     }
+    return bytes;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+bool HashTable<TKey, TElement, THash, TStats>::IsRehashing() const {
+    return static_cast<bool>(oldTable);
 }
 
-template<typename TKey, typename TElement>
-void HashTable<TKey, TElement>::Remove(const TKey &key) {
-    size_t index = HashFunction(key) % capacity;
-    LinkedListSmart<KeyValuePair> &chain = table->Get(static_cast<int>(index));
+template<typename TKey, typename TElement, typename THash, typename TStats>
+size_t HashTable<TKey, TElement, THash, TStats>::HashFunction(const TKey &key) const {
+    return THash()(key);
+}
 
-    auto iterator = chain.begin();
+template<typename TKey, typename TElement, typename THash, typename TStats>
+size_t HashTable<TKey, TElement, THash, TStats>::RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+size_t HashTable<TKey, TElement, THash, TStats>::CapacityFor(size_t count) const {
+    size_t buckets = static_cast<size_t>(std::ceil(static_cast<double>(count) / maxLoadFactor));
+    return RoundUpToPowerOfTwo(buckets == 0 ? 1 : buckets);
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+HashTable<TKey, TElement, THash, TStats>::BucketArray::BucketArray(size_t bucketCount)
+        : segments(nullptr), segmentCount((bucketCount + SegmentSize - 1) / SegmentSize) {
+    segments.reset(new UnqPtr<LinkedListSmart<KeyValuePair>[]>[segmentCount]);
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+LinkedListSmart<typename HashTable<TKey, TElement, THash, TStats>::KeyValuePair> *
+HashTable<TKey, TElement, THash, TStats>::BucketArray::Find(size_t index) const {
+    const UnqPtr<LinkedListSmart<KeyValuePair>[]> &segment = segments[index / SegmentSize];
+    if (!segment) {
+        return nullptr;
+    }
+    return &segment[index % SegmentSize];
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+LinkedListSmart<typename HashTable<TKey, TElement, THash, TStats>::KeyValuePair> &
+HashTable<TKey, TElement, THash, TStats>::BucketArray::Get(size_t index) {
+    UnqPtr<LinkedListSmart<KeyValuePair>[]> &segment = segments[index / SegmentSize];
+    if (!segment) {
+        segment.reset(new LinkedListSmart<KeyValuePair>[SegmentSize]);
+    }
+    return segment[index % SegmentSize];
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::BucketArray::ReleaseSegment(size_t segmentIndex) {
+    segments[segmentIndex].reset();
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+size_t HashTable<TKey, TElement, THash, TStats>::BucketArray::GetMemoryUsage() const {
+    size_t bytes = segmentCount * sizeof(UnqPtr<LinkedListSmart<KeyValuePair>[]>);
+    for (size_t i = 0; i < segmentCount; ++i) {
+        if (segments[i]) {
+            bytes += SegmentSize * sizeof(LinkedListSmart<KeyValuePair>);
+        }
+    }
+    return bytes;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+typename HashTable<TKey, TElement, THash, TStats>::KeyValuePair *
+HashTable<TKey, TElement, THash, TStats>::FindInChain(const LinkedListSmart<KeyValuePair> &chain, const TKey &key,
+                                                      size_t &probes) {
+    for (auto iterator = chain.begin(); iterator != chain.end(); ++iterator) {
+        ++probes;
+        if ((*iterator).key == key) {
+            return &(*iterator);
+        }
+    }
+    return nullptr;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+bool HashTable<TKey, TElement, THash, TStats>::RemoveFromChain(LinkedListSmart<KeyValuePair> &chain, const TKey &key) {
     int i = 0;
-    for (; iterator != chain.end(); ++iterator) {
-        ++i;
+    for (auto iterator = chain.begin(); iterator != chain.end(); ++iterator, ++i) {
         if ((*iterator).key == key) {
             chain.RemoveAt(i);
-            --count;
-            return;
+            return true;
         }
     }
+    return false;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+LinkedListSmart<typename HashTable<TKey, TElement, THash, TStats>::KeyValuePair> *
+HashTable<TKey, TElement, THash, TStats>::FindOldChain(size_t hash) const {
+    if (!oldTable) {
+        return nullptr;
+    }
+    size_t index = hash & (oldCapacity - 1);
+    if (index < migrationIndex) {
+        return nullptr;
+    }
+    return oldTable->Find(index);
+}
 
-    throw std::runtime_error("Key not found.");
+template<typename TKey, typename TElement, typename THash, typename TStats>
+typename HashTable<TKey, TElement, THash, TStats>::KeyValuePair *HashTable<TKey, TElement, THash, TStats>::Find(const TKey &key) const {
+    return Find(key, HashFunction(key));
 }
 
-template<typename TKey, typename TElement>
-void HashTable<TKey, TElement>::Update(const TKey &key, const TElement &element) {
-    size_t index = HashFunction(key) % capacity;
-    LinkedListSmart<KeyValuePair> &chain = table->Get(static_cast<int>(index));
+template<typename TKey, typename TElement, typename THash, typename TStats>
+typename HashTable<TKey, TElement, THash, TStats>::KeyValuePair *
+HashTable<TKey, TElement, THash, TStats>::Find(const TKey &key, size_t hash) const {
+    size_t probes;
+    KeyValuePair *pair = Locate(key, hash, probes);
+    telemetry.RecordLookup(pair != nullptr, probes);
+    return pair;
+}
 
-    for (int i = 0; i < chain.GetLength(); ++i) {
-        if (chain.Get(i).key == key) {
-            chain.Get(i).value = element;
-            return;
+template<typename TKey, typename TElement, typename THash, typename TStats>
+typename HashTable<TKey, TElement, THash, TStats>::KeyValuePair *
+HashTable<TKey, TElement, THash, TStats>::Locate(const TKey &key, size_t hash, size_t &probes) const {
+    probes = 0;
+    LinkedListSmart<KeyValuePair> *oldChain = FindOldChain(hash);
+    if (oldChain) {
+        KeyValuePair *pair = FindInChain(*oldChain, key, probes);
+        if (pair) {
+            return pair;
         }
     }
 
-    throw std::runtime_error("Key not found.");
+    LinkedListSmart<KeyValuePair> *chain = table->Find(hash & (capacity - 1));
+    return chain ? FindInChain(*chain, key, probes) : nullptr;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::Add(const TKey &key, const TElement &element) {
+    EmplaceHashed(key, HashFunction(key), element);
 }
 
-template<typename TKey, typename TElement>
-bool HashTable<TKey, TElement>::ContainsKey(const TKey &key) const {
-    size_t index = HashFunction(key) % capacity;
-    const LinkedListSmart<KeyValuePair> &chain = table->Get(static_cast<int>(index));
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::Add(const TKey &key, TElement &&element) {
+    EmplaceHashed(key, HashFunction(key), std::move(element));
+}
 
-    for (int i = 0; i < chain.GetLength(); ++i) {
-        if (chain.Get(i).key == key) {
-            return true;
+template<typename TKey, typename TElement, typename THash, typename TStats>
+template<typename... Args>
+void HashTable<TKey, TElement, THash, TStats>::Emplace(const TKey &key, Args &&... args) {
+    EmplaceHashed(key, HashFunction(key), std::forward<Args>(args)...);
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+template<typename... Args>
+bool HashTable<TKey, TElement, THash, TStats>::EmplaceHashed(const TKey &key, size_t hash, Args &&... args) {
+    MigrateStep(MigrationBucketsPerStep);
+
+    size_t probes;
+    KeyValuePair *pair = Locate(key, hash, probes);
+    if (pair) {
+        pair->value = TElement(std::forward<Args>(args)...);
+        return false;
+    }
+
+    size_t index = hash & (capacity - 1);
+    table->Get(index).Emplace(std::in_place, key, std::forward<Args>(args)...);
+    ++count;
+
+    if (static_cast<double>(count) / capacity > maxLoadFactor) {
+        if (incrementalRehash) {
+            BeginMigration();
+        } else {
+            Rehash(capacity * 2);
         }
     }
+    return true;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+bool HashTable<TKey, TElement, THash, TStats>::Upsert(const TKey &key, const TElement &element) {
+    return EmplaceHashed(key, HashFunction(key), element);
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+bool HashTable<TKey, TElement, THash, TStats>::Upsert(const TKey &key, TElement &&element) {
+    return EmplaceHashed(key, HashFunction(key), std::move(element));
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::Remove(const TKey &key) {
+    if (!TryRemove(key)) {
+        throw std::runtime_error("Key not found.");
+    }
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+bool HashTable<TKey, TElement, THash, TStats>::TryRemove(const TKey &key) {
+    MigrateStep(MigrationBucketsPerStep);
+
+    size_t hash = HashFunction(key);
+    LinkedListSmart<KeyValuePair> *oldChain = FindOldChain(hash);
+    LinkedListSmart<KeyValuePair> *chain = table->Find(hash & (capacity - 1));
+
+    if ((oldChain && RemoveFromChain(*oldChain, key)) || (chain && RemoveFromChain(*chain, key))) {
+        --count;
+        return true;
+    }
 
     return false;
 }
 
-template<typename TKey, typename TElement>
-TElement HashTable<TKey, TElement>::Get(const TKey &key) const {
-    size_t index = HashFunction(key) % capacity;
-    const LinkedListSmart<KeyValuePair> &chain = table->Get(static_cast<int>(index));
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::Update(const TKey &key, const TElement &element) {
+    MigrateStep(MigrationBucketsPerStep);
 
-    for (int i = 0; i < chain.GetLength(); ++i) {
-        if (chain.Get(i).key == key) {
-            return chain.Get(i).value;
-        }
+    size_t probes;
+    KeyValuePair *pair = Locate(key, HashFunction(key), probes);
+    if (pair) {
+        pair->value = element;
+        return;
     }
 
     throw std::runtime_error("Key not found.");
 }
 
-template<typename TKey, typename TElement>
-void HashTable<TKey, TElement>::Rehash() {
-    size_t newCapacity = capacity * 2;
-    UnqPtr<DynamicArraySmart<LinkedListSmart<KeyValuePair>>> newTable(
-            new DynamicArraySmart<LinkedListSmart<KeyValuePair>>(static_cast<int>(newCapacity)));
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::Update(const TKey &key, TElement &&element) {
+    MigrateStep(MigrationBucketsPerStep);
+
+    size_t probes;
+    KeyValuePair *pair = Locate(key, HashFunction(key), probes);
+    if (pair) {
+        pair->value = std::move(element);
+        return;
+    }
+
+    throw std::runtime_error("Key not found.");
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+bool HashTable<TKey, TElement, THash, TStats>::ContainsKey(const TKey &key) const {
+    return Find(key) != nullptr;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+TElement HashTable<TKey, TElement, THash, TStats>::Get(const TKey &key) const {
+    KeyValuePair *pair = Find(key);
+    if (pair) {
+        return pair->value;
+    }
+
+    throw std::runtime_error("Key not found.");
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+std::optional<TElement> HashTable<TKey, TElement, THash, TStats>::TryGet(const TKey &key) const {
+    KeyValuePair *pair = Find(key);
+    if (pair) {
+        return pair->value;
+    }
+    return std::nullopt;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+TElement HashTable<TKey, TElement, THash, TStats>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    KeyValuePair *pair = Find(key);
+    return pair ? pair->value : defaultValue;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::PrefetchGroup(const TKey *keys, size_t count, size_t *hashes) const {
+    for (size_t i = 0; i < count; ++i) {
+        hashes[i] = HashFunction(keys[i]);
+        const LinkedListSmart<KeyValuePair> *chain = table->Find(hashes[i] & (capacity - 1));
+        if (chain) {
+            Prefetch(chain);
+        }
+    }
+
+    // By now the first slots have arrived, so their head nodes can be requested as well.
+    for (size_t i = 0; i < count; ++i) {
+        const LinkedListSmart<KeyValuePair> *chain = table->Find(hashes[i] & (capacity - 1));
+        if (chain && chain->GetLength() > 0) {
+            Prefetch(&chain->GetFirst());
+        }
+    }
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::ContainsMany(const TKey *keys, size_t count, bool *results) const {
+    size_t hashes[BatchSize];
+    for (size_t start = 0; start < count; start += BatchSize) {
+        size_t groupSize = count - start < BatchSize ? count - start : BatchSize;
+        PrefetchGroup(keys + start, groupSize, hashes);
+        for (size_t i = 0; i < groupSize; ++i) {
+            results[start + i] = Find(keys[start + i], hashes[i]) != nullptr;
+        }
+    }
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+size_t HashTable<TKey, TElement, THash, TStats>::GetMany(const TKey *keys, size_t count, TElement *values,
+                                                 bool *found) const {
+    size_t hashes[BatchSize];
+    size_t hits = 0;
+    for (size_t start = 0; start < count; start += BatchSize) {
+        size_t groupSize = count - start < BatchSize ? count - start : BatchSize;
+        PrefetchGroup(keys + start, groupSize, hashes);
+        for (size_t i = 0; i < groupSize; ++i) {
+            KeyValuePair *pair = Find(keys[start + i], hashes[i]);
+            values[start + i] = pair ? pair->value : TElement();
+            if (found) {
+                found[start + i] = pair != nullptr;
+            }
+            hits += pair ? 1 : 0;
+        }
+    }
+    return hits;
+}
 
-    for (size_t i = 0; i < newCapacity; ++i) {
-        newTable->Append(LinkedListSmart<KeyValuePair>());
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::AddRange(const TKey *keys, const TElement *elements, size_t count) {
+    size_t hashes[BatchSize];
+    for (size_t start = 0; start < count; start += BatchSize) {
+        size_t groupSize = count - start < BatchSize ? count - start : BatchSize;
+        PrefetchGroup(keys + start, groupSize, hashes);
+        for (size_t i = 0; i < groupSize; ++i) {
+            EmplaceHashed(keys[start + i], hashes[i], elements[start + i]);
+        }
     }
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::Rehash(size_t newCapacity) {
+    // A pending migration always finishes before the table is resized again.
+    MigrateStep(oldCapacity);
+
+    long long start = telemetry.StartTimer();
+    UnqPtr<BucketArray> newTable(new BucketArray(newCapacity));
 
     for (size_t i = 0; i < capacity; ++i) {
-        LinkedListSmart<KeyValuePair> &chain = table->Get(static_cast<int>(i));
-        for (int j = 0; j < chain.GetLength(); ++j) {
-            const KeyValuePair &kvp = chain.Get(j);
-            size_t index = HashFunction(kvp.key) % newCapacity;
-            newTable->Get(static_cast<int>(index)).Append(kvp);
+        LinkedListSmart<KeyValuePair> *chain = table->Find(i);
+        if (!chain) {
+            continue;
+        }
+        for (auto iterator = chain->begin(); iterator != chain->end(); ++iterator) {
+            KeyValuePair &kvp = *iterator;
+            size_t index = HashFunction(kvp.key) & (newCapacity - 1);
+            newTable->Get(index).Append(std::move(kvp));
         }
     }
 
     table = std::move(newTable);
     capacity = newCapacity;
+    telemetry.RecordRehash(start);
 }
 
-template<typename TKey, typename TElement>
-HashTable<TKey, TElement>::HashTableIterator::HashTableIterator(const HashTable *hashTable)
-        : hashTable(hashTable), bucketIndex(0), listIndex(-1) {
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::BeginMigration() {
+    if (oldTable) {
+        return;
+    }
+
+    long long start = telemetry.StartTimer();
+    oldTable = std::move(table);
+    oldCapacity = capacity;
+    migrationIndex = 0;
+
+    capacity *= 2;
+    table.reset(new BucketArray(capacity));
+    telemetry.RecordRehash(start);
 }
 
-template<typename TKey, typename TElement>
-bool HashTable<TKey, TElement>::HashTableIterator::MoveNext() {
-    ++listIndex;
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::MigrateStep(size_t bucketCount) {
+    if (!oldTable) {
+        return;
+    }
+
+    long long start = telemetry.StartTimer();
+    size_t end = migrationIndex + bucketCount;
+    if (end > oldCapacity) {
+        end = oldCapacity;
+    }
+
+    for (; migrationIndex < end; ++migrationIndex) {
+        LinkedListSmart<KeyValuePair> *chain = oldTable->Find(migrationIndex);
+        if (chain) {
+            for (auto iterator = chain->begin(); iterator != chain->end(); ++iterator) {
+                KeyValuePair &kvp = *iterator;
+                size_t index = HashFunction(kvp.key) & (capacity - 1);
+                table->Get(index).Append(std::move(kvp));
+            }
+            chain->Clear();
+        }
+        // Segments are freed as soon as they are drained so the old table never
+        // has to be torn down in one go.
+        if ((migrationIndex + 1) % BucketArray::SegmentSize == 0) {
+            oldTable->ReleaseSegment(migrationIndex / BucketArray::SegmentSize);
+        }
+    }
+
+    if (migrationIndex == oldCapacity) {
+        oldTable.reset();
+        oldCapacity = 0;
+        migrationIndex = 0;
+    }
+    telemetry.RecordMigrationStep(start);
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+CollisionStats HashTable<TKey, TElement, THash, TStats>::GetCollisionStats() const {
+    CollisionStats stats;
+    stats.count = count;
+    stats.bucketCount = capacity + (oldTable ? oldCapacity : 0);
+
+    size_t probes = 0;
+    auto accumulate = [&](const BucketArray &buckets, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const LinkedListSmart<KeyValuePair> *chain = buckets.Find(i);
+            size_t length = chain ? static_cast<size_t>(chain->GetLength()) : 0;
+            ++stats.chainLengthHistogram[std::min(length, CollisionStats::HistogramSize - 1)];
+            if (length == 0) {
+                continue;
+            }
+            ++stats.usedBuckets;
+            if (length > stats.maxChainLength) {
+                stats.maxChainLength = length;
+            }
+            // The k-th entry of a chain is found after k comparisons.
+            probes += length * (length + 1) / 2;
+        }
+    };
 
-    while (bucketIndex < hashTable->capacity) {
-        LinkedListSmart<KeyValuePair> &chain = hashTable->table->Get(static_cast<int>(bucketIndex));
-        if (listIndex < chain.GetLength()) {
+    if (oldTable) {
+        accumulate(*oldTable, migrationIndex, oldCapacity);
+    }
+    accumulate(*table, 0, capacity);
+
+    stats.loadFactor = static_cast<double>(count) / stats.bucketCount;
+    if (stats.usedBuckets > 0) {
+        stats.averageChainLength = static_cast<double>(count) / stats.usedBuckets;
+    }
+    if (count > 0) {
+        stats.averageProbeLength = static_cast<double>(probes) / count;
+    }
+    return stats;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+const TStats &HashTable<TKey, TElement, THash, TStats>::GetTelemetry() const {
+    return telemetry;
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::ResetTelemetry() {
+    telemetry = TStats();
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+HashTable<TKey, TElement, THash, TStats>::HashTableIterator::HashTableIterator(const HashTable *hashTable)
+        : hashTable(hashTable), inOldTable(false), bucketIndex(0), position(nullptr), current(nullptr) {
+    Reset();
+}
+
+template<typename TKey, typename TElement, typename THash, typename TStats>
+bool HashTable<TKey, TElement, THash, TStats>::HashTableIterator::SeekChain() {
+    while (true) {
+        if (inOldTable && bucketIndex >= hashTable->oldCapacity) {
+            inOldTable = false;
+            bucketIndex = 0;
+        }
+
+        if (!inOldTable && bucketIndex >= hashTable->capacity) {
+            current = nullptr;
+            return false;
+        }
+
+        const BucketArray *buckets = inOldTable ? hashTable->oldTable.get() : hashTable->table.get();
+        const LinkedListSmart<KeyValuePair> *chain = buckets->Find(bucketIndex);
+        if (!chain) {
+            bucketIndex = (bucketIndex / BucketArray::SegmentSize + 1) * BucketArray::SegmentSize;
+            continue;
+        }
+
+        position = chain->begin();
+        if (position != chain->end()) {
+            current = &*position;
             return true;
-        } else {
-            ++bucketIndex;
-            listIndex = 0;
         }
+        ++bucketIndex;
     }
+}
 
-    return false;
+template<typename TKey, typename TElement, typename THash, typename TStats>
+bool HashTable<TKey, TElement, THash, TStats>::HashTableIterator::MoveNext() {
+    if (current) {
+        ++position;
+        if (position != typename LinkedListSmart<KeyValuePair>::Iterator(nullptr)) {
+            current = &*position;
+            return true;
+        }
+        ++bucketIndex;
+    }
+    return SeekChain();
 }
 
-template<typename TKey, typename TElement>
-void HashTable<TKey, TElement>::HashTableIterator::Reset() {
-    bucketIndex = 0;
-    listIndex = -1;
+template<typename TKey, typename TElement, typename THash, typename TStats>
+void HashTable<TKey, TElement, THash, TStats>::HashTableIterator::Reset() {
+    inOldTable = static_cast<bool>(hashTable->oldTable);
+    bucketIndex = inOldTable ? hashTable->migrationIndex : 0;
+    position = typename LinkedListSmart<KeyValuePair>::Iterator(nullptr);
+    current = nullptr;
 }
 
-template<typename TKey, typename TElement>
-TKey HashTable<TKey, TElement>::HashTableIterator::GetCurrentKey() const {
-    if (bucketIndex >= hashTable->capacity)
+template<typename TKey, typename TElement, typename THash, typename TStats>
+TKey HashTable<TKey, TElement, THash, TStats>::HashTableIterator::GetCurrentKey() const {
+    if (!current)
         throw std::out_of_range("Iterator out of range");
 
-    const LinkedListSmart<KeyValuePair> &chain = hashTable->table->Get(static_cast<int>(bucketIndex));
-    return chain.Get(listIndex).key;
+    return current->key;
 }
 
-template<typename TKey, typename TElement>
-TElement HashTable<TKey, TElement>::HashTableIterator::GetCurrentValue() const {
-    if (bucketIndex >= hashTable->capacity)
+template<typename TKey, typename TElement, typename THash, typename TStats>
+TElement HashTable<TKey, TElement, THash, TStats>::HashTableIterator::GetCurrentValue() const {
+    if (!current)
         throw std::out_of_range("Iterator out of range");
 
-    const LinkedListSmart<KeyValuePair> &chain = hashTable->table->Get(static_cast<int>(bucketIndex));
-    return chain.Get(listIndex).value;
+    return current->value;
 }
 
-template<typename TKey, typename TElement>
-UnqPtr<IDictionaryIterator<TKey, TElement>> HashTable<TKey, TElement>::GetIterator() const {
+template<typename TKey, typename TElement, typename THash, typename TStats>
+UnqPtr<IDictionaryIterator<TKey, TElement>> HashTable<TKey, TElement, THash, TStats>::GetIterator() const {
     return UnqPtr<IDictionaryIterator<TKey, TElement>>(new HashTableIterator(this));
 }
 
@@ -0,0 +1,94 @@
+#ifndef HASHTABLESTATS_H
+#define HASHTABLESTATS_H
+
+#include <chrono>
+#include <cstddef>
+
+// Runtime telemetry policies for HashTable. The table calls the hooks on every read lookup
+// (Get, ContainsKey, TryGet, GetOrDefault and the batch forms; inserts and updates do not
+// count) and around every rehash; with NoHashTableStats they are empty inline functions,
+// so a table built without telemetry compiles to the same code as before.
+
+struct NoHashTableStats {
+    void RecordLookup(bool, size_t) const {}
+
+    long long StartTimer() const { return 0; }
+
+    void RecordRehash(long long) const {}
+
+    void RecordMigrationStep(long long) const {}
+};
+
+// Counts lookup hits and misses, the number of key comparisons each one took, and the
+// number of rehashes along with the time spent moving entries. For an incremental rehash
+// the time of every migration step is added to the rehash total.
+class CountingHashTableStats {
+public:
+    static const size_t HistogramSize = 16;
+
+    void RecordLookup(bool hit, size_t probes) const {
+        if (hit) {
+            ++hitCount;
+            hitProbes += probes;
+        } else {
+            ++missCount;
+            missProbes += probes;
+        }
+        ++probeHistogram[probes < HistogramSize ? probes : HistogramSize - 1];
+    }
+
+    long long StartTimer() const {
+        return Now();
+    }
+
+    void RecordRehash(long long start) const {
+        ++rehashCount;
+        rehashNanoseconds += Now() - start;
+    }
+
+    void RecordMigrationStep(long long start) const {
+        rehashNanoseconds += Now() - start;
+    }
+
+    size_t GetHitCount() const { return hitCount; }
+
+    size_t GetMissCount() const { return missCount; }
+
+    // Average key comparisons of a successful or a failed lookup.
+    double GetAverageHitProbes() const {
+        return hitCount ? static_cast<double>(hitProbes) / hitCount : 0.0;
+    }
+
+    double GetAverageMissProbes() const {
+        return missCount ? static_cast<double>(missProbes) / missCount : 0.0;
+    }
+
+    // Lookups that took length comparisons; the last entry counts every longer lookup too.
+    size_t GetProbeHistogram(size_t length) const {
+        return probeHistogram[length < HistogramSize ? length : HistogramSize - 1];
+    }
+
+    size_t GetRehashCount() const { return rehashCount; }
+
+    long long GetRehashNanoseconds() const { return rehashNanoseconds; }
+
+    void Reset() {
+        *this = CountingHashTableStats();
+    }
+
+private:
+    mutable size_t hitCount = 0;
+    mutable size_t missCount = 0;
+    mutable size_t hitProbes = 0;
+    mutable size_t missProbes = 0;
+    mutable size_t probeHistogram[HistogramSize] = {};
+    mutable size_t rehashCount = 0;
+    mutable long long rehashNanoseconds = 0;
+
+    static long long Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+#endif // HASHTABLESTATS_H
@@ -0,0 +1,82 @@
+#ifndef HASHERS_H
+#define HASHERS_H
+
+#include "IndexPair.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Hash policies for the hash-based dictionaries.
+//
+// DefaultHash runs every key through a 64-bit finalizer, so all bits of the result depend
+// on all bits of the key and tables can reduce it with a power-of-two mask. StdHash keeps
+// the raw std::hash / IndexPairHash value (the identity for int on libstdc++) and is only
+// a good choice when the keys are already well spread.
+
+// MurmurHash3 fmix64 finalizer.
+inline uint64_t MixHash(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+template<typename TKey>
+struct DefaultHash {
+    size_t operator()(const TKey &key) const {
+        return static_cast<size_t>(MixHash(std::hash<TKey>()(key)));
+    }
+};
+
+template<>
+struct DefaultHash<int> {
+    size_t operator()(int key) const {
+        return static_cast<size_t>(MixHash(static_cast<uint32_t>(key)));
+    }
+};
+
+// Row and column are packed into one word before mixing, so distinct pairs never collide
+// before the finalizer.
+template<>
+struct DefaultHash<IndexPair> {
+    size_t operator()(const IndexPair &key) const {
+        uint64_t packed = (static_cast<uint64_t>(static_cast<uint32_t>(key.row)) << 32) |
+                          static_cast<uint32_t>(key.column);
+        return static_cast<size_t>(MixHash(packed));
+    }
+};
+
+template<typename TKey>
+struct StdHash {
+    size_t operator()(const TKey &key) const {
+        return std::hash<TKey>()(key);
+    }
+};
+
+template<>
+struct StdHash<IndexPair> {
+    size_t operator()(const IndexPair &key) const {
+        return IndexPairHash()(key);
+    }
+};
+
+// Bucket occupancy of a separately chained table.
+struct CollisionStats {
+    static const size_t HistogramSize = 16;
+
+    size_t count = 0;
+    size_t bucketCount = 0;
+    size_t usedBuckets = 0;
+    size_t maxChainLength = 0;
+    double loadFactor = 0.0;
+    // Average length of the non-empty chains.
+    double averageChainLength = 0.0;
+    // Average number of key comparisons for a successful lookup.
+    double averageProbeLength = 0.0;
+    // Number of buckets per chain length; the last entry counts every longer chain too.
+    size_t chainLengthHistogram[HistogramSize] = {};
+};
+
+#endif // HASHERS_H
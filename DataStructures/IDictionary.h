@@ -3,9 +3,55 @@
 #define IDICTIONARY_H
 
 #include <cstddef>
+#include <optional>
+#include <utility>
 #include "IDictionaryIterator.h"
 #include "UnqPtr.h"
 
+// Yields the entries of another iterator whose keys lie in [lower, upper), in its order.
+template <typename TKey, typename TElement>
+class RangeFilterIterator : public IDictionaryIterator<TKey, TElement>
+{
+public:
+    RangeFilterIterator(UnqPtr<IDictionaryIterator<TKey, TElement>> source, const TKey& lower, const TKey& upper)
+            : source(std::move(source)), lower(lower), upper(upper)
+    {
+    }
+
+    virtual bool MoveNext() override
+    {
+        while (source->MoveNext())
+        {
+            TKey key = source->GetCurrentKey();
+            if (!(key < lower) && key < upper)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    virtual void Reset() override
+    {
+        source->Reset();
+    }
+
+    virtual TKey GetCurrentKey() const override
+    {
+        return source->GetCurrentKey();
+    }
+
+    virtual TElement GetCurrentValue() const override
+    {
+        return source->GetCurrentValue();
+    }
+
+private:
+    UnqPtr<IDictionaryIterator<TKey, TElement>> source;
+    TKey lower;
+    TKey upper;
+};
+
 template <typename TKey, typename TElement>
 class IDictionary
 {
@@ -22,6 +68,129 @@ public:
     virtual void Update(const TKey& key, const TElement& element) = 0;
 
     virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const = 0;
+
+    // Single-lookup primitives that never throw on a missing key. The defaults are built on
+    // the methods above and look the key up twice; implementations override them.
+    virtual std::optional<TElement> TryGet(const TKey& key) const
+    {
+        if (ContainsKey(key))
+        {
+            return Get(key);
+        }
+        return std::nullopt;
+    }
+
+    virtual TElement GetOrDefault(const TKey& key, const TElement& defaultValue) const
+    {
+        std::optional<TElement> value = TryGet(key);
+        return value ? *value : defaultValue;
+    }
+
+    // Inserts the key or overwrites its element. Returns true if the key was inserted.
+    virtual bool Upsert(const TKey& key, const TElement& element)
+    {
+        bool inserted = !ContainsKey(key);
+        Add(key, element);
+        return inserted;
+    }
+
+    // Removes the key if it is present and reports whether it was. The default looks the
+    // key up and then removes it, which takes two lookups and is not atomic; every mutable
+    // dictionary in this library overrides it to do both in one step.
+    virtual bool TryRemove(const TKey& key)
+    {
+        if (!ContainsKey(key))
+        {
+            return false;
+        }
+        Remove(key);
+        return true;
+    }
+
+    // Overloads that move the element into the dictionary. The defaults fall back to the
+    // copying versions; implementations that store elements by value override them.
+    virtual void Add(const TKey& key, TElement&& element)
+    {
+        Add(key, static_cast<const TElement&>(element));
+    }
+
+    virtual void Update(const TKey& key, TElement&& element)
+    {
+        Update(key, static_cast<const TElement&>(element));
+    }
+
+    virtual bool Upsert(const TKey& key, TElement&& element)
+    {
+        return Upsert(key, static_cast<const TElement&>(element));
+    }
+
+    // Adds or overwrites key with an element built from args. Implementations may hide this
+    // with a version that constructs the element directly in its final place.
+    template <typename... Args>
+    void Emplace(const TKey& key, Args&&... args)
+    {
+        Add(key, TElement(std::forward<Args>(args)...));
+    }
+
+    // Batch operations over count keys. The defaults call the single-key methods in turn;
+    // implementations override them to overlap the memory accesses of neighbouring keys.
+    virtual void ContainsMany(const TKey* keys, size_t count, bool* results) const
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            results[i] = ContainsKey(keys[i]);
+        }
+    }
+
+    // Missing keys get TElement() and found[i] == false; found may be nullptr.
+    // Returns the number of keys that were found.
+    virtual size_t GetMany(const TKey* keys, size_t count, TElement* values, bool* found) const
+    {
+        size_t hits = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            bool contains = ContainsKey(keys[i]);
+            values[i] = contains ? Get(keys[i]) : TElement();
+            if (found)
+            {
+                found[i] = contains;
+            }
+            hits += contains ? 1 : 0;
+        }
+        return hits;
+    }
+
+    // Adds or overwrites every pair; a key that occurs twice keeps its last element.
+    virtual void AddRange(const TKey* keys, const TElement* elements, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            Add(keys[i], elements[i]);
+        }
+    }
+
+    // AddRange for keys that are already in strictly ascending order. Ordered dictionaries
+    // override it to build an empty structure in one pass instead of key by key.
+    virtual void AddSorted(const TKey* keys, const TElement* elements, size_t count)
+    {
+        AddRange(keys, elements, count);
+    }
+
+    // Iterates over the entries with lower <= key < upper. The default filters a full scan
+    // and keeps the order of GetIterator; ordered dictionaries override it to seek to
+    // lower and yield ascending keys in O(log n + k).
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetRange(const TKey& lower, const TKey& upper) const
+    {
+        return UnqPtr<IDictionaryIterator<TKey, TElement>>(
+                new RangeFilterIterator<TKey, TElement>(GetIterator(), lower, upper));
+    }
+
+    // Hint that count elements are about to be stored, so a dictionary that grows by
+    // rehashing can size itself once up front. The default ignores it.
+    virtual void Reserve(size_t count)
+    {
+        (void)count;
+    }
 };
 
 #endif // IDICTIONARY_H
@@ -0,0 +1,110 @@
+#ifndef KEYSEARCH_H
+#define KEYSEARCH_H
+
+#include "IndexPair.h"
+#include <bit>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KEYSEARCH_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KEYSEARCH_SSE2 1
+#endif
+
+// Branchless binary search over keys[0, count): the loop runs log2(count) times whatever
+// the keys are, and each comparison only picks one of two pointers, which compiles to a
+// conditional move instead of a hard-to-predict branch.
+template<typename TKey>
+int BranchlessRank(const TKey *keys, int count, const TKey &key) {
+    if (count == 0) {
+        return 0;
+    }
+    const TKey *base = keys;
+    int length = count;
+    while (length > 1) {
+        int half = length / 2;
+        base = base[half] < key ? base + half : base;
+        length -= half;
+    }
+    return static_cast<int>(base - keys) + (*base < key ? 1 : 0);
+}
+
+// Rank of key in the sorted array keys[0, count): the number of keys less than it, which
+// is where key sits or would be inserted. Specializations compare a whole block of keys
+// with one SIMD instruction and count the lanes that are less; only full blocks are
+// loaded, so nothing past keys + count is read.
+template<typename TKey>
+struct KeySearch {
+    static int Rank(const TKey *keys, int count, const TKey &key) {
+        return BranchlessRank(keys, count, key);
+    }
+};
+
+template<>
+struct KeySearch<int> {
+    static int Rank(const int *keys, int count, const int &key) {
+        int i = 0;
+#if defined(KEYSEARCH_AVX2)
+        __m256i needle = _mm256_set1_epi32(key);
+        for (; i + 8 <= count; i += 8) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, block)));
+            if (mask != 0xFF) {
+                return i + std::popcount(static_cast<unsigned>(mask));
+            }
+        }
+#elif defined(KEYSEARCH_SSE2)
+        __m128i needle = _mm_set1_epi32(key);
+        for (; i + 4 <= count; i += 4) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(needle, block)));
+            if (mask != 0xF) {
+                return i + std::popcount(static_cast<unsigned>(mask));
+            }
+        }
+#endif
+        int rank = i;
+        for (; i < count; ++i) {
+            rank += keys[i] < key ? 1 : 0;
+        }
+        return rank;
+    }
+};
+
+template<>
+struct KeySearch<IndexPair> {
+    static int Rank(const IndexPair *keys, int count, const IndexPair &key) {
+#if defined(KEYSEARCH_AVX2)
+        static_assert(sizeof(IndexPair) == sizeof(int64_t), "IndexPair must pack into 64 bits");
+        // A key becomes the 64-bit integer row * 2^32 + column, with the column's sign bit
+        // flipped so that signed 64-bit order equals (row, column) order. In memory the
+        // row is the low half, so the loaded halves are swapped first.
+        const int64_t columnSign = int64_t(1) << 31;
+        int64_t packed = static_cast<int64_t>((static_cast<uint64_t>(static_cast<uint32_t>(key.row)) << 32) |
+                                              static_cast<uint32_t>(key.column));
+        __m256i needle = _mm256_set1_epi64x(packed ^ columnSign);
+        __m256i flip = _mm256_set1_epi64x(columnSign);
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+            block = _mm256_xor_si256(_mm256_shuffle_epi32(block, _MM_SHUFFLE(2, 3, 0, 1)), flip);
+            int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(needle, block)));
+            if (mask != 0xF) {
+                return i + std::popcount(static_cast<unsigned>(mask));
+            }
+        }
+        int rank = i;
+        for (; i < count; ++i) {
+            rank += keys[i] < key ? 1 : 0;
+        }
+        return rank;
+#else
+        // Without AVX2 there is no 64-bit compare; the binary search is the faster fallback.
+        return BranchlessRank(keys, count, key);
+#endif
+    }
+};
+
+#endif // KEYSEARCH_H
@@ -2,14 +2,21 @@
 #define LINKEDLISTSMART_H
 
 #include "Sequence.h"
+#include "NodeAllocator.h"
 #include <memory>
+#include <new>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 #define LINKEDLIST_EMPTY "LinkedListSmart is empty"
 #define LINKEDLIST_OUT_OF_RANGE "Index out of range"
 #define LINKEDLIST_SUBSEQ_ERR "Invalid subsequence indices"
 
-template <typename T>
+// Nodes are shared_ptr blocks whose memory comes from TAllocator (see NodeAllocator.h). With
+// an arena the nodes live in the list's own chunks, so an iterator must not outlive the list
+// or a Clear of it.
+template <typename T, typename TAllocator = HeapNodeAllocator>
 class LinkedListSmart : public Sequence<T> {
 private:
     struct Node {
@@ -17,14 +24,48 @@ private:
         std::shared_ptr<Node> next;
 
         explicit Node(const T& item) : data(item), next(nullptr) {}
+
+        explicit Node(T&& item) : data(std::move(item)), next(nullptr) {}
+
+        template <typename... Args>
+        explicit Node(std::in_place_t, Args&&... args) : data(std::forward<Args>(args)...), next(nullptr) {}
     };
 
+    [[no_unique_address]] TAllocator allocator;
     std::shared_ptr<Node> head;
     size_t length;
 
+    template <typename... Args>
+    std::shared_ptr<Node> MakeNode(Args&&... args) {
+        return std::allocate_shared<Node>(NodeStdAllocator<Node, TAllocator>(allocator), std::forward<Args>(args)...);
+    }
+
 public:
     LinkedListSmart() : head(nullptr), length(0) {}
-    ~LinkedListSmart() override = default;
+
+    explicit LinkedListSmart(TAllocator allocator) : allocator(std::move(allocator)), head(nullptr), length(0) {}
+
+    ~LinkedListSmart() override {
+        Clear();
+    }
+
+    // Frees the nodes one by one; dropping head alone would recurse once per node. A node
+    // still shared with a copy of the list ends the walk, and the rest stays with the copy.
+    // Elements that need no destructor are instead dropped with the arena's chunks in O(1)
+    // when the allocator can release them all.
+    void Clear() {
+        if (std::is_trivially_destructible_v<T> && head.use_count() == 1 && allocator.TryReleaseAll()) {
+            // The nodes and their control blocks are gone, so head is forgotten, not reset.
+            new (&head) std::shared_ptr<Node>();
+            length = 0;
+            return;
+        }
+        while (head && head.use_count() == 1) {
+            head = std::move(head->next);
+        }
+        head.reset();
+        length = 0;
+    }
 
     T& GetFirst() const override {
         if (!head)
@@ -56,7 +97,7 @@ public:
         if (startIndex < 0 || endIndex >= static_cast<int>(length) || startIndex > endIndex)
             throw std::out_of_range(LINKEDLIST_SUBSEQ_ERR);
 
-        auto subseq = new LinkedListSmart<T>();
+        auto subseq = new LinkedListSmart<T, TAllocator>();
         auto current = head;
         for (int i = 0; i <= endIndex; ++i) {
             if (i >= startIndex) {
@@ -72,7 +113,27 @@ public:
     }
 
     void Append(const T& item) override {
-        auto newNode = std::make_shared<Node>(item);
+        auto newNode = MakeNode(item);
+        if (!head) {
+            head = newNode;
+        } else {
+            auto current = head;
+            while (current->next) {
+                current = current->next;
+            }
+            current->next = newNode;
+        }
+        ++length;
+    }
+
+    void Append(T&& item) {
+        Emplace(std::move(item));
+    }
+
+    // Constructs the new last element in place from args.
+    template <typename... Args>
+    T& Emplace(Args&&... args) {
+        auto newNode = MakeNode(std::in_place, std::forward<Args>(args)...);
         if (!head) {
             head = newNode;
         } else {
@@ -83,10 +144,18 @@ public:
             current->next = newNode;
         }
         ++length;
+        return newNode->data;
     }
 
     void Prepend(const T& item) override {
-        auto newNode = std::make_shared<Node>(item);
+        auto newNode = MakeNode(item);
+        newNode->next = head;
+        head = newNode;
+        ++length;
+    }
+
+    void Prepend(T&& item) {
+        auto newNode = MakeNode(std::move(item));
         newNode->next = head;
         head = newNode;
         ++length;
@@ -102,7 +171,7 @@ public:
             for (int i = 0; i < index - 1; ++i) {
                 current = current->next;
             }
-            auto newNode = std::make_shared<Node>(item);
+            auto newNode = MakeNode(item);
             newNode->next = current->next;
             current->next = newNode;
             ++length;
@@ -132,7 +201,7 @@ public:
     }
 
     Sequence<T>* Concat(Sequence<T>* list) const override {
-        auto newList = new LinkedListSmart<T>();
+        auto newList = new LinkedListSmart<T, TAllocator>();
         auto current = head;
         while (current) {
             newList->Append(current->data);
@@ -0,0 +1,515 @@
+#ifndef LOCKFREEHASHTABLE_H
+#define LOCKFREEHASHTABLE_H
+
+#include "IDictionary.h"
+#include "EpochReclamation.h"
+#include "Hashers.h"
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+
+// Lock-free dictionary built on a split-ordered list (Shalev & Shavit).
+//
+// All entries live in one Harris-Michael linked list sorted by the bit-reversed hash.
+// A bucket is a pointer to a dummy node inside that list, so doubling the bucket count
+// never moves entries: a new bucket is initialized lazily by splicing its dummy node in
+// after the dummy of its parent bucket. Values are boxed and replaced atomically, and
+// unlinked nodes and old boxes are freed through EpochDomain.
+template<typename TKey, typename TElement>
+class LockFreeHashTable : public IDictionary<TKey, TElement> {
+public:
+    LockFreeHashTable(size_t initialCapacity = 16);
+
+    virtual ~LockFreeHashTable();
+
+    LockFreeHashTable(const LockFreeHashTable &) = delete;
+    LockFreeHashTable &operator=(const LockFreeHashTable &) = delete;
+
+    virtual size_t GetCount() const override;
+
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    // Returns true only for the thread whose mark removed the key, so concurrent removals
+    // of one key never both succeed.
+    virtual bool TryRemove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    // The iterator stays inside an epoch until it is destroyed, so it must be used and
+    // destroyed on the thread that created it. Concurrent changes may or may not be seen.
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+private:
+    struct Node {
+        uint64_t splitKey;
+        TKey key;
+        std::atomic<TElement *> value;
+        // Bit 0 marks this node as logically removed.
+        std::atomic<uintptr_t> next;
+
+        explicit Node(uint64_t splitKey) : splitKey(splitKey), key(), value(nullptr), next(0) {}
+
+        Node(uint64_t splitKey, const TKey &key, TElement *value)
+                : splitKey(splitKey), key(key), value(value), next(0) {}
+
+        ~Node() {
+            delete value.load(std::memory_order_relaxed);
+        }
+    };
+
+    // Bucket b lives in segment bit_width(b) - 1 (buckets 0 and 1 share segment 0), so
+    // segment s holds 2^s buckets and 64 segments cover any table size.
+    static constexpr int SegmentCount = 64;
+    static constexpr size_t MaxLoadFactor = 2;
+
+    mutable std::atomic<std::atomic<Node *> *> segments[SegmentCount];
+    std::atomic<size_t> bucketCount;
+    std::atomic<size_t> count;
+    Node *head;
+
+    static uint64_t HashFunction(const TKey &key);
+
+    static uint64_t ReverseBits(uint64_t value);
+
+    static uint64_t RegularKey(uint64_t hash);
+
+    static uint64_t DummyKey(size_t bucket);
+
+    static Node *Pointer(uintptr_t link);
+
+    static bool IsMarked(uintptr_t link);
+
+    std::atomic<Node *> &BucketSlot(size_t bucket) const;
+
+    Node *GetBucket(uint64_t hash) const;
+
+    Node *InitializeBucket(size_t bucket) const;
+
+    // Searches the list starting at start for the node with the given split key (and key,
+    // for regular nodes). Unlinks and retires removed nodes on the way. On return prevLink
+    // is the link that points to current, the first node not ordered before the target.
+    bool Find(Node *start, uint64_t splitKey, const TKey *key,
+              std::atomic<uintptr_t> *&prevLink, Node *&current) const;
+
+    void ReplaceValue(Node *node, TElement *value);
+
+    class LockFreeHashTableIterator : public IDictionaryIterator<TKey, TElement> {
+    public:
+        LockFreeHashTableIterator(const LockFreeHashTable *hashTable);
+
+        virtual ~LockFreeHashTableIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual TKey GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        EpochGuard guard;
+        const LockFreeHashTable *hashTable;
+        Node *current;
+        bool started;
+    };
+};
+
+template<typename TKey, typename TElement>
+LockFreeHashTable<TKey, TElement>::LockFreeHashTable(size_t initialCapacity)
+        : bucketCount(2), count(0), head(nullptr) {
+    for (int i = 0; i < SegmentCount; ++i) {
+        segments[i].store(nullptr, std::memory_order_relaxed);
+    }
+    size_t buckets = 2;
+    while (buckets * MaxLoadFactor < initialCapacity) {
+        buckets <<= 1;
+    }
+    bucketCount.store(buckets, std::memory_order_relaxed);
+
+    head = new Node(DummyKey(0));
+    BucketSlot(0).store(head, std::memory_order_release);
+}
+
+template<typename TKey, typename TElement>
+LockFreeHashTable<TKey, TElement>::~LockFreeHashTable() {
+    // Removed nodes are already unlinked and owned by the epoch domain; everything still
+    // reachable from the head, dummies included, belongs to the table.
+    Node *node = head;
+    while (node != nullptr) {
+        Node *next = Pointer(node->next.load(std::memory_order_relaxed));
+        delete node;
+        node = next;
+    }
+    for (int i = 0; i < SegmentCount; ++i) {
+        delete[] segments[i].load(std::memory_order_relaxed);
+    }
+}
+
+template<typename TKey, typename TElement>
+size_t LockFreeHashTable<TKey, TElement>::GetCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+template<typename TKey, typename TElement>
+size_t LockFreeHashTable<TKey, TElement>::GetCapacity() const {
+    return bucketCount.load(std::memory_order_relaxed);
+}
+
+template<typename TKey, typename TElement>
+uint64_t LockFreeHashTable<TKey, TElement>::HashFunction(const TKey &key) {
+    return DefaultHash<TKey>()(key);
+}
+
+template<typename TKey, typename TElement>
+uint64_t LockFreeHashTable<TKey, TElement>::ReverseBits(uint64_t value) {
+    value = ((value >> 1) & 0x5555555555555555ULL) | ((value & 0x5555555555555555ULL) << 1);
+    value = ((value >> 2) & 0x3333333333333333ULL) | ((value & 0x3333333333333333ULL) << 2);
+    value = ((value >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((value & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    value = ((value >> 8) & 0x00FF00FF00FF00FFULL) | ((value & 0x00FF00FF00FF00FFULL) << 8);
+    value = ((value >> 16) & 0x0000FFFF0000FFFFULL) | ((value & 0x0000FFFF0000FFFFULL) << 16);
+    return (value >> 32) | (value << 32);
+}
+
+// Regular keys have the lowest bit set and dummy keys have it clear, so a bucket's dummy
+// sorts right before the entries whose hashes end with the bucket index.
+template<typename TKey, typename TElement>
+uint64_t LockFreeHashTable<TKey, TElement>::RegularKey(uint64_t hash) {
+    return ReverseBits(hash | 0x8000000000000000ULL);
+}
+
+template<typename TKey, typename TElement>
+uint64_t LockFreeHashTable<TKey, TElement>::DummyKey(size_t bucket) {
+    return ReverseBits(bucket);
+}
+
+template<typename TKey, typename TElement>
+typename LockFreeHashTable<TKey, TElement>::Node *LockFreeHashTable<TKey, TElement>::Pointer(uintptr_t link) {
+    return reinterpret_cast<Node *>(link & ~static_cast<uintptr_t>(1));
+}
+
+template<typename TKey, typename TElement>
+bool LockFreeHashTable<TKey, TElement>::IsMarked(uintptr_t link) {
+    return (link & 1) != 0;
+}
+
+template<typename TKey, typename TElement>
+std::atomic<typename LockFreeHashTable<TKey, TElement>::Node *> &
+LockFreeHashTable<TKey, TElement>::BucketSlot(size_t bucket) const {
+    int segment = bucket < 2 ? 0 : static_cast<int>(std::bit_width(bucket)) - 1;
+    size_t offset = bucket < 2 ? bucket : bucket - (static_cast<size_t>(1) << segment);
+
+    std::atomic<Node *> *slots = segments[segment].load(std::memory_order_acquire);
+    if (slots == nullptr) {
+        size_t size = segment == 0 ? 2 : static_cast<size_t>(1) << segment;
+        std::atomic<Node *> *allocated = new std::atomic<Node *>[size];
+        for (size_t i = 0; i < size; ++i) {
+            allocated[i].store(nullptr, std::memory_order_relaxed);
+        }
+        if (segments[segment].compare_exchange_strong(slots, allocated, std::memory_order_acq_rel)) {
+            slots = allocated;
+        } else {
+            delete[] allocated;
+        }
+    }
+    return slots[offset];
+}
+
+template<typename TKey, typename TElement>
+typename LockFreeHashTable<TKey, TElement>::Node *LockFreeHashTable<TKey, TElement>::GetBucket(uint64_t hash) const {
+    size_t bucket = static_cast<size_t>(hash & (bucketCount.load(std::memory_order_acquire) - 1));
+    Node *dummy = BucketSlot(bucket).load(std::memory_order_acquire);
+    return dummy != nullptr ? dummy : InitializeBucket(bucket);
+}
+
+template<typename TKey, typename TElement>
+typename LockFreeHashTable<TKey, TElement>::Node *LockFreeHashTable<TKey, TElement>::InitializeBucket(size_t bucket) const {
+    size_t parent = bucket & ~std::bit_floor(bucket);
+    Node *parentDummy = BucketSlot(parent).load(std::memory_order_acquire);
+    if (parentDummy == nullptr) {
+        parentDummy = InitializeBucket(parent);
+    }
+
+    Node *dummy = new Node(DummyKey(bucket));
+    std::atomic<uintptr_t> *prevLink;
+    Node *current;
+    while (true) {
+        if (Find(parentDummy, dummy->splitKey, nullptr, prevLink, current)) {
+            // Another thread spliced the same dummy in first.
+            delete dummy;
+            dummy = current;
+            break;
+        }
+        dummy->next.store(reinterpret_cast<uintptr_t>(current), std::memory_order_relaxed);
+        uintptr_t expected = reinterpret_cast<uintptr_t>(current);
+        if (prevLink->compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(dummy),
+                                              std::memory_order_release, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    BucketSlot(bucket).store(dummy, std::memory_order_release);
+    return dummy;
+}
+
+template<typename TKey, typename TElement>
+bool LockFreeHashTable<TKey, TElement>::Find(Node *start, uint64_t splitKey, const TKey *key,
+                                             std::atomic<uintptr_t> *&prevLink, Node *&current) const {
+    while (true) {
+        prevLink = &start->next;
+        current = Pointer(prevLink->load(std::memory_order_acquire));
+        bool restart = false;
+
+        while (current != nullptr) {
+            uintptr_t next = current->next.load(std::memory_order_acquire);
+            if (IsMarked(next)) {
+                uintptr_t expected = reinterpret_cast<uintptr_t>(current);
+                if (!prevLink->compare_exchange_strong(expected, next & ~static_cast<uintptr_t>(1),
+                                                       std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    restart = true;
+                    break;
+                }
+                EpochDomain::Global().Retire(current);
+                current = Pointer(next);
+                continue;
+            }
+
+            if (current->splitKey > splitKey) {
+                return false;
+            }
+            // Dummy and regular split keys never coincide; regular keys only coincide on a
+            // full 63-bit hash collision, so keep scanning until the key itself matches.
+            if (current->splitKey == splitKey && (key == nullptr || current->key == *key)) {
+                return true;
+            }
+
+            prevLink = &current->next;
+            current = Pointer(next);
+        }
+
+        if (!restart) {
+            return false;
+        }
+    }
+}
+
+template<typename TKey, typename TElement>
+void LockFreeHashTable<TKey, TElement>::ReplaceValue(Node *node, TElement *value) {
+    TElement *old = node->value.exchange(value, std::memory_order_acq_rel);
+    EpochDomain::Global().Retire(old);
+}
+
+template<typename TKey, typename TElement>
+TElement LockFreeHashTable<TKey, TElement>::Get(const TKey &key) const {
+    EpochGuard guard;
+    uint64_t hash = HashFunction(key);
+    std::atomic<uintptr_t> *prevLink;
+    Node *current;
+    if (!Find(GetBucket(hash), RegularKey(hash), &key, prevLink, current)) {
+        throw std::runtime_error("Key not found.");
+    }
+    return *current->value.load(std::memory_order_acquire);
+}
+
+template<typename TKey, typename TElement>
+std::optional<TElement> LockFreeHashTable<TKey, TElement>::TryGet(const TKey &key) const {
+    EpochGuard guard;
+    uint64_t hash = HashFunction(key);
+    std::atomic<uintptr_t> *prevLink;
+    Node *current;
+    if (!Find(GetBucket(hash), RegularKey(hash), &key, prevLink, current)) {
+        return std::nullopt;
+    }
+    return *current->value.load(std::memory_order_acquire);
+}
+
+template<typename TKey, typename TElement>
+TElement LockFreeHashTable<TKey, TElement>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    EpochGuard guard;
+    uint64_t hash = HashFunction(key);
+    std::atomic<uintptr_t> *prevLink;
+    Node *current;
+    if (!Find(GetBucket(hash), RegularKey(hash), &key, prevLink, current)) {
+        return defaultValue;
+    }
+    return *current->value.load(std::memory_order_acquire);
+}
+
+template<typename TKey, typename TElement>
+bool LockFreeHashTable<TKey, TElement>::ContainsKey(const TKey &key) const {
+    EpochGuard guard;
+    uint64_t hash = HashFunction(key);
+    std::atomic<uintptr_t> *prevLink;
+    Node *current;
+    return Find(GetBucket(hash), RegularKey(hash), &key, prevLink, current);
+}
+
+template<typename TKey, typename TElement>
+void LockFreeHashTable<TKey, TElement>::Add(const TKey &key, const TElement &element) {
+    Upsert(key, element);
+}
+
+template<typename TKey, typename TElement>
+bool LockFreeHashTable<TKey, TElement>::Upsert(const TKey &key, const TElement &element) {
+    EpochGuard guard;
+    uint64_t hash = HashFunction(key);
+    uint64_t splitKey = RegularKey(hash);
+    Node *bucket = GetBucket(hash);
+    Node *node = nullptr;
+    std::atomic<uintptr_t> *prevLink;
+    Node *current;
+
+    while (true) {
+        if (Find(bucket, splitKey, &key, prevLink, current)) {
+            if (node != nullptr) {
+                // Lost the race to insert; reuse the boxed value for the update.
+                ReplaceValue(current, node->value.exchange(nullptr, std::memory_order_relaxed));
+                delete node;
+            } else {
+                ReplaceValue(current, new TElement(element));
+            }
+            return false;
+        }
+
+        if (node == nullptr) {
+            node = new Node(splitKey, key, new TElement(element));
+        }
+        node->next.store(reinterpret_cast<uintptr_t>(current), std::memory_order_relaxed);
+        uintptr_t expected = reinterpret_cast<uintptr_t>(current);
+        if (prevLink->compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node),
+                                              std::memory_order_release, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    size_t newCount = count.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t buckets = bucketCount.load(std::memory_order_relaxed);
+    if (newCount > buckets * MaxLoadFactor && buckets < (static_cast<size_t>(1) << (SegmentCount - 1))) {
+        bucketCount.compare_exchange_strong(buckets, buckets * 2, std::memory_order_acq_rel);
+    }
+    return true;
+}
+
+template<typename TKey, typename TElement>
+void LockFreeHashTable<TKey, TElement>::Remove(const TKey &key) {
+    if (!TryRemove(key)) {
+        throw std::runtime_error("Key not found.");
+    }
+}
+
+template<typename TKey, typename TElement>
+bool LockFreeHashTable<TKey, TElement>::TryRemove(const TKey &key) {
+    EpochGuard guard;
+    uint64_t hash = HashFunction(key);
+    uint64_t splitKey = RegularKey(hash);
+    Node *bucket = GetBucket(hash);
+    std::atomic<uintptr_t> *prevLink;
+    Node *current;
+
+    while (true) {
+        if (!Find(bucket, splitKey, &key, prevLink, current)) {
+            return false;
+        }
+
+        uintptr_t next = current->next.load(std::memory_order_acquire);
+        if (IsMarked(next)) {
+            continue;
+        }
+        if (!current->next.compare_exchange_strong(next, next | 1, std::memory_order_acq_rel,
+                                                   std::memory_order_relaxed)) {
+            continue;
+        }
+
+        count.fetch_sub(1, std::memory_order_relaxed);
+        uintptr_t expected = reinterpret_cast<uintptr_t>(current);
+        if (prevLink->compare_exchange_strong(expected, next, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+            EpochDomain::Global().Retire(current);
+        } else {
+            // Someone changed the predecessor; a fresh search unlinks the node for us.
+            Find(bucket, splitKey, &key, prevLink, current);
+        }
+        return true;
+    }
+}
+
+template<typename TKey, typename TElement>
+void LockFreeHashTable<TKey, TElement>::Update(const TKey &key, const TElement &element) {
+    EpochGuard guard;
+    uint64_t hash = HashFunction(key);
+    std::atomic<uintptr_t> *prevLink;
+    Node *current;
+    if (!Find(GetBucket(hash), RegularKey(hash), &key, prevLink, current)) {
+        throw std::runtime_error("Key not found.");
+    }
+    ReplaceValue(current, new TElement(element));
+}
+
+template<typename TKey, typename TElement>
+LockFreeHashTable<TKey, TElement>::LockFreeHashTableIterator::LockFreeHashTableIterator(
+        const LockFreeHashTable *hashTable)
+        : guard(), hashTable(hashTable), current(nullptr), started(false) {
+}
+
+template<typename TKey, typename TElement>
+bool LockFreeHashTable<TKey, TElement>::LockFreeHashTableIterator::MoveNext() {
+    Node *node = started ? current : hashTable->head;
+    started = true;
+    if (node == nullptr) {
+        return false;
+    }
+
+    // Skip dummy nodes (even split keys) and entries that are being removed.
+    node = Pointer(node->next.load(std::memory_order_acquire));
+    while (node != nullptr &&
+           ((node->splitKey & 1) == 0 || IsMarked(node->next.load(std::memory_order_acquire)))) {
+        node = Pointer(node->next.load(std::memory_order_acquire));
+    }
+    current = node;
+    return current != nullptr;
+}
+
+template<typename TKey, typename TElement>
+void LockFreeHashTable<TKey, TElement>::LockFreeHashTableIterator::Reset() {
+    current = nullptr;
+    started = false;
+}
+
+template<typename TKey, typename TElement>
+TKey LockFreeHashTable<TKey, TElement>::LockFreeHashTableIterator::GetCurrentKey() const {
+    if (!started || current == nullptr)
+        throw std::out_of_range("Iterator out of range");
+
+    return current->key;
+}
+
+template<typename TKey, typename TElement>
+TElement LockFreeHashTable<TKey, TElement>::LockFreeHashTableIterator::GetCurrentValue() const {
+    if (!started || current == nullptr)
+        throw std::out_of_range("Iterator out of range");
+
+    return *current->value.load(std::memory_order_acquire);
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> LockFreeHashTable<TKey, TElement>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new LockFreeHashTableIterator(this));
+}
+
+#endif // LOCKFREEHASHTABLE_H
@@ -0,0 +1,200 @@
+#ifndef LOCKEDDICTIONARY_H
+#define LOCKEDDICTIONARY_H
+
+#include "IDictionary.h"
+#include "HashTable.h"
+#include "DynamicArraySmart.h"
+#include "KeyValue.h"
+#include "UnqPtr.h"
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+// Makes any dictionary thread-safe by serializing every call on one mutex. It is the
+// baseline the concurrent dictionaries are measured against.
+template<typename TKey, typename TElement, typename TDictionary = HashTable<TKey, TElement>>
+class LockedDictionary : public IDictionary<TKey, TElement> {
+public:
+    LockedDictionary();
+
+    virtual ~LockedDictionary();
+
+    virtual size_t GetCount() const override;
+
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    virtual bool TryRemove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    // The iterator works on a copy of the entries taken under the lock.
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    virtual void Reserve(size_t count) override;
+
+private:
+    TDictionary dictionary;
+    mutable std::mutex lock;
+
+    class LockedDictionaryIterator : public IDictionaryIterator<TKey, TElement> {
+    public:
+        LockedDictionaryIterator(const LockedDictionary *lockedDictionary);
+
+        virtual ~LockedDictionaryIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual TKey GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        DynamicArraySmart<KeyValue<TKey, TElement>> entries;
+        int entryIndex;
+    };
+};
+
+template<typename TKey, typename TElement, typename TDictionary>
+LockedDictionary<TKey, TElement, TDictionary>::LockedDictionary() : dictionary(), lock() {
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+LockedDictionary<TKey, TElement, TDictionary>::~LockedDictionary() {
+
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+size_t LockedDictionary<TKey, TElement, TDictionary>::GetCount() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return dictionary.GetCount();
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+size_t LockedDictionary<TKey, TElement, TDictionary>::GetCapacity() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return dictionary.GetCapacity();
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+TElement LockedDictionary<TKey, TElement, TDictionary>::Get(const TKey &key) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return dictionary.Get(key);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+bool LockedDictionary<TKey, TElement, TDictionary>::ContainsKey(const TKey &key) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return dictionary.ContainsKey(key);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void LockedDictionary<TKey, TElement, TDictionary>::Add(const TKey &key, const TElement &element) {
+    std::lock_guard<std::mutex> guard(lock);
+    dictionary.Add(key, element);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void LockedDictionary<TKey, TElement, TDictionary>::Remove(const TKey &key) {
+    std::lock_guard<std::mutex> guard(lock);
+    dictionary.Remove(key);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+bool LockedDictionary<TKey, TElement, TDictionary>::TryRemove(const TKey &key) {
+    std::lock_guard<std::mutex> guard(lock);
+    return dictionary.TryRemove(key);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void LockedDictionary<TKey, TElement, TDictionary>::Update(const TKey &key, const TElement &element) {
+    std::lock_guard<std::mutex> guard(lock);
+    dictionary.Update(key, element);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+std::optional<TElement> LockedDictionary<TKey, TElement, TDictionary>::TryGet(const TKey &key) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return dictionary.TryGet(key);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+TElement LockedDictionary<TKey, TElement, TDictionary>::GetOrDefault(const TKey &key,
+                                                                      const TElement &defaultValue) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return dictionary.GetOrDefault(key, defaultValue);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+bool LockedDictionary<TKey, TElement, TDictionary>::Upsert(const TKey &key, const TElement &element) {
+    std::lock_guard<std::mutex> guard(lock);
+    return dictionary.Upsert(key, element);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void LockedDictionary<TKey, TElement, TDictionary>::Reserve(size_t count) {
+    std::lock_guard<std::mutex> guard(lock);
+    dictionary.Reserve(count);
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+LockedDictionary<TKey, TElement, TDictionary>::LockedDictionaryIterator::LockedDictionaryIterator(
+        const LockedDictionary *lockedDictionary)
+        : entries(), entryIndex(-1) {
+    std::lock_guard<std::mutex> guard(lockedDictionary->lock);
+    auto iterator = lockedDictionary->dictionary.GetIterator();
+    while (iterator->MoveNext()) {
+        entries.Append(KeyValue<TKey, TElement>(iterator->GetCurrentKey(), iterator->GetCurrentValue()));
+    }
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+bool LockedDictionary<TKey, TElement, TDictionary>::LockedDictionaryIterator::MoveNext() {
+    if (entryIndex < entries.GetLength()) {
+        ++entryIndex;
+    }
+    return entryIndex < entries.GetLength();
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+void LockedDictionary<TKey, TElement, TDictionary>::LockedDictionaryIterator::Reset() {
+    entryIndex = -1;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+TKey LockedDictionary<TKey, TElement, TDictionary>::LockedDictionaryIterator::GetCurrentKey() const {
+    if (entryIndex < 0 || entryIndex >= entries.GetLength())
+        throw std::out_of_range("Iterator out of range");
+
+    return entries[entryIndex].key;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+TElement LockedDictionary<TKey, TElement, TDictionary>::LockedDictionaryIterator::GetCurrentValue() const {
+    if (entryIndex < 0 || entryIndex >= entries.GetLength())
+        throw std::out_of_range("Iterator out of range");
+
+    return entries[entryIndex].value;
+}
+
+template<typename TKey, typename TElement, typename TDictionary>
+UnqPtr<IDictionaryIterator<TKey, TElement>> LockedDictionary<TKey, TElement, TDictionary>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new LockedDictionaryIterator(this));
+}
+
+#endif // LOCKEDDICTIONARY_H
@@ -0,0 +1,358 @@
+#ifndef NODEALLOCATOR_H
+#define NODEALLOCATOR_H
+
+#include "Prefetch.h"
+#include "UnqPtr.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Node allocation policies for the linked containers (BTree, LinkedListSmart).
+//
+// A policy provides Allocate(size, alignment) and Deallocate(block, size, alignment), a
+// Share() that returns a handle for another owner of the same nodes (a BTree snapshot),
+// and TryReleaseAll(), which frees every node at once if the policy can and nothing else
+// refers to them. Alignments up to CacheLineSize are supported.
+
+// Every node is its own heap allocation; this is what the containers did before.
+struct HeapNodeAllocator {
+    void *Allocate(size_t size, size_t alignment) {
+        if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            return ::operator new(size);
+        }
+        return ::operator new(size, std::align_val_t(alignment));
+    }
+
+    void Deallocate(void *block, size_t, size_t alignment) {
+        if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(block);
+        } else {
+            ::operator delete(block, std::align_val_t(alignment));
+        }
+    }
+
+    HeapNodeAllocator Share() const {
+        return *this;
+    }
+
+    bool TryReleaseAll() {
+        return false;
+    }
+};
+
+// Carves nodes out of large chunks and keeps freed nodes in per-size free lists, so a
+// container does one malloc per chunk instead of one per node, and destroying it frees
+// the chunks without visiting the nodes.
+//
+// Allocation is not synchronized: like the container's other writes, it happens on one
+// thread at a time. The arena belongs to the handle the container keeps, whose frees go
+// straight to the free lists. Handles made with Share() keep the arena alive and may free
+// nodes from any thread, for example when a snapshot is dropped: their blocks are pushed
+// onto a lock-free list that is drained into the free lists when one runs dry.
+class NodeArena {
+public:
+    static constexpr size_t DefaultChunkSize = 64 * 1024;
+
+    explicit NodeArena(size_t chunkSize = DefaultChunkSize);
+
+    ~NodeArena();
+
+    NodeArena(const NodeArena &) = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+
+    void *Allocate(size_t size, size_t alignment);
+
+    // Called through the owning handle.
+    void Deallocate(void *block, size_t size, size_t alignment);
+
+    // Safe to call from any thread.
+    void DeallocateRemote(void *block, size_t size, size_t alignment);
+
+    // Frees every chunk; blocks handed out before become invalid. Fails, changing nothing,
+    // while a shared handle exists or an oversized block is still allocated.
+    bool TryReleaseAll();
+
+    void AddHandle();
+
+    // Returns true when the caller held the last handle and must delete the arena.
+    bool DropHandle();
+
+    size_t GetChunkCount() const;
+
+private:
+    struct Chunk {
+        Chunk *next;
+    };
+
+    struct FreeBlock {
+        FreeBlock *next;
+        size_t sizeClass;
+    };
+
+    static constexpr size_t Granularity = 16;
+
+    size_t chunkSize;
+    // Blocks larger than this come from the heap one by one.
+    size_t maxBlockSize;
+    Chunk *chunks;
+    size_t chunkCount;
+    char *cursor;
+    char *limit;
+    UnqPtr<FreeBlock *[]> freeLists;
+    std::atomic<FreeBlock *> returned;
+    std::atomic<size_t> oversizedBlocks;
+    std::atomic<size_t> handles;
+
+    // Sizes are rounded up so that a size class also fixes the block alignment: the largest
+    // power of two dividing the rounded size, capped at CacheLineSize.
+    static size_t RoundSize(size_t size, size_t alignment);
+
+    static size_t BlockAlignment(size_t roundedSize);
+
+    void *Carve(size_t roundedSize);
+
+    // Moves the blocks freed through shared handles onto the free lists.
+    void DrainReturned();
+
+    void FreeChunks();
+};
+
+// The policy handle around a NodeArena. Moving keeps ownership; Share() hands out a handle
+// whose frees are safe from any thread and which cannot release the arena.
+class ArenaNodeAllocator {
+public:
+    explicit ArenaNodeAllocator(size_t chunkSize = NodeArena::DefaultChunkSize)
+            : arena(new NodeArena(chunkSize)), owner(true) {}
+
+    ~ArenaNodeAllocator() {
+        if (arena != nullptr && arena->DropHandle()) {
+            delete arena;
+        }
+    }
+
+    ArenaNodeAllocator(ArenaNodeAllocator &&other) noexcept : arena(other.arena), owner(other.owner) {
+        other.arena = nullptr;
+    }
+
+    ArenaNodeAllocator &operator=(ArenaNodeAllocator &&other) noexcept {
+        std::swap(arena, other.arena);
+        std::swap(owner, other.owner);
+        return *this;
+    }
+
+    ArenaNodeAllocator(const ArenaNodeAllocator &) = delete;
+    ArenaNodeAllocator &operator=(const ArenaNodeAllocator &) = delete;
+
+    void *Allocate(size_t size, size_t alignment) {
+        return arena->Allocate(size, alignment);
+    }
+
+    void Deallocate(void *block, size_t size, size_t alignment) {
+        if (owner) {
+            arena->Deallocate(block, size, alignment);
+        } else {
+            arena->DeallocateRemote(block, size, alignment);
+        }
+    }
+
+    ArenaNodeAllocator Share() const {
+        arena->AddHandle();
+        return ArenaNodeAllocator(arena);
+    }
+
+    bool TryReleaseAll() {
+        return owner && arena->TryReleaseAll();
+    }
+
+    const NodeArena &GetArena() const {
+        return *arena;
+    }
+
+private:
+    NodeArena *arena;
+    bool owner;
+
+    explicit ArenaNodeAllocator(NodeArena *shared) : arena(shared), owner(false) {}
+};
+
+// Adapts a node allocation policy to the standard Allocator requirements, for
+// std::allocate_shared. A stateless policy is stored by value and costs nothing; a stateful
+// one is referenced, so the container that owns it must outlive its nodes.
+template<typename T, typename TAllocator>
+class NodeStdAllocator {
+public:
+    using value_type = T;
+
+    explicit NodeStdAllocator(TAllocator &policy) : handle(MakeHandle(policy)) {}
+
+    template<typename U>
+    NodeStdAllocator(const NodeStdAllocator<U, TAllocator> &other) : handle(MakeHandle(other.GetPolicy())) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(GetPolicy().Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *block, size_t n) {
+        GetPolicy().Deallocate(block, n * sizeof(T), alignof(T));
+    }
+
+    TAllocator &GetPolicy() const {
+        if constexpr (Stateless) {
+            return handle;
+        } else {
+            return *handle;
+        }
+    }
+
+    template<typename U>
+    bool operator==(const NodeStdAllocator<U, TAllocator> &other) const {
+        return &GetPolicy() == &other.GetPolicy() || Stateless;
+    }
+
+private:
+    static constexpr bool Stateless = std::is_empty_v<TAllocator>;
+    using Handle = std::conditional_t<Stateless, TAllocator, TAllocator *>;
+
+    [[no_unique_address]] mutable Handle handle;
+
+    static Handle MakeHandle(TAllocator &policy) {
+        if constexpr (Stateless) {
+            return Handle();
+        } else {
+            return &policy;
+        }
+    }
+};
+
+inline NodeArena::NodeArena(size_t chunkSize)
+        : chunkSize(std::max(chunkSize, 4 * CacheLineSize)), maxBlockSize(this->chunkSize / 4), chunks(nullptr),
+          chunkCount(0), cursor(nullptr), limit(nullptr), freeLists(new FreeBlock *[maxBlockSize / Granularity + 1]()),
+          returned(nullptr), oversizedBlocks(0), handles(1) {}
+
+inline NodeArena::~NodeArena() {
+    FreeChunks();
+}
+
+inline size_t NodeArena::RoundSize(size_t size, size_t alignment) {
+    size_t unit = std::max(alignment, Granularity);
+    return (std::max(size, Granularity) + unit - 1) / unit * unit;
+}
+
+inline size_t NodeArena::BlockAlignment(size_t roundedSize) {
+    return std::min(roundedSize & (~roundedSize + 1), CacheLineSize);
+}
+
+inline void *NodeArena::Allocate(size_t size, size_t alignment) {
+    size_t rounded = RoundSize(size, alignment);
+    if (rounded > maxBlockSize) {
+        oversizedBlocks.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(rounded, std::align_val_t(CacheLineSize));
+    }
+
+    size_t sizeClass = rounded / Granularity;
+    if (freeLists[sizeClass] == nullptr && returned.load(std::memory_order_relaxed) != nullptr) {
+        DrainReturned();
+    }
+    FreeBlock *block = freeLists[sizeClass];
+    if (block != nullptr) {
+        freeLists[sizeClass] = block->next;
+        return block;
+    }
+    return Carve(rounded);
+}
+
+inline void *NodeArena::Carve(size_t roundedSize) {
+    size_t alignment = BlockAlignment(roundedSize);
+    char *start = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1));
+    if (cursor == nullptr || start + roundedSize > limit) {
+        // The chunk header takes the first cache line, so blocks start cache-line aligned.
+        char *memory = static_cast<char *>(::operator new(chunkSize, std::align_val_t(CacheLineSize)));
+        Chunk *chunk = reinterpret_cast<Chunk *>(memory);
+        chunk->next = chunks;
+        chunks = chunk;
+        ++chunkCount;
+        cursor = memory + CacheLineSize;
+        limit = memory + chunkSize;
+        start = cursor;
+    }
+    cursor = start + roundedSize;
+    return start;
+}
+
+inline void NodeArena::Deallocate(void *block, size_t size, size_t alignment) {
+    size_t rounded = RoundSize(size, alignment);
+    if (rounded > maxBlockSize) {
+        ::operator delete(block, std::align_val_t(CacheLineSize));
+        oversizedBlocks.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    FreeBlock *freed = static_cast<FreeBlock *>(block);
+    freed->next = freeLists[rounded / Granularity];
+    freeLists[rounded / Granularity] = freed;
+}
+
+inline void NodeArena::DeallocateRemote(void *block, size_t size, size_t alignment) {
+    size_t rounded = RoundSize(size, alignment);
+    if (rounded > maxBlockSize) {
+        ::operator delete(block, std::align_val_t(CacheLineSize));
+        oversizedBlocks.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    // Only the owner pops, and it takes the whole list at once, so there is no ABA problem.
+    FreeBlock *freed = static_cast<FreeBlock *>(block);
+    freed->sizeClass = rounded / Granularity;
+    FreeBlock *head = returned.load(std::memory_order_relaxed);
+    do {
+        freed->next = head;
+    } while (!returned.compare_exchange_weak(head, freed, std::memory_order_release, std::memory_order_relaxed));
+}
+
+inline void NodeArena::DrainReturned() {
+    FreeBlock *block = returned.exchange(nullptr, std::memory_order_acquire);
+    while (block != nullptr) {
+        FreeBlock *next = block->next;
+        block->next = freeLists[block->sizeClass];
+        freeLists[block->sizeClass] = block;
+        block = next;
+    }
+}
+
+inline bool NodeArena::TryReleaseAll() {
+    if (handles.load(std::memory_order_acquire) != 1 || oversizedBlocks.load(std::memory_order_acquire) != 0) {
+        return false;
+    }
+    FreeChunks();
+    std::fill_n(freeLists.get(), maxBlockSize / Granularity + 1, nullptr);
+    returned.store(nullptr, std::memory_order_relaxed);
+    return true;
+}
+
+inline void NodeArena::FreeChunks() {
+    while (chunks != nullptr) {
+        Chunk *next = chunks->next;
+        ::operator delete(chunks, std::align_val_t(CacheLineSize));
+        chunks = next;
+    }
+    chunkCount = 0;
+    cursor = nullptr;
+    limit = nullptr;
+}
+
+inline void NodeArena::AddHandle() {
+    handles.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline bool NodeArena::DropHandle() {
+    // acq_rel: the thread that deletes the arena must see every block freed into it.
+    return handles.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+inline size_t NodeArena::GetChunkCount() const {
+    return chunkCount;
+}
+
+#endif // NODEALLOCATOR_H
@@ -0,0 +1,25 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <cstddef>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <xmmintrin.h>
+#endif
+
+// Cache line size assumed by the node layouts and alignments of the containers.
+constexpr size_t CacheLineSize = 64;
+
+// Hints the CPU to start loading the cache line at address. Batch operations call it for
+// every key of a group before touching any of them, so the misses overlap.
+inline void Prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#elif defined(_MSC_VER)
+    _mm_prefetch(static_cast<const char *>(address), _MM_HINT_T0);
+#else
+    (void) address;
+#endif
+}
+
+#endif // PREFETCH_H
@@ -0,0 +1,537 @@
+#ifndef ROARINGDICTIONARY_H
+#define ROARINGDICTIONARY_H
+
+#include "IDictionary.h"
+#include "UnqPtr.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+// Dictionary over int keys laid out like a roaring bitmap, meant for SparseVector indices.
+// Keys are split into a 16-bit high half, which selects a container from a sorted array,
+// and a 16-bit low half stored in that container. A container holds its low halves either
+// as a sorted array (up to ArrayLimit keys) or as a 65536-bit bitmap, and its elements in
+// one packed array in key order, so the element of a key sits at the key's rank. With
+// bitmaps a membership test is a single bit test, and iteration is sorted by key.
+template<typename TElement>
+class RoaringDictionary : public IDictionary<int, TElement> {
+public:
+    RoaringDictionary();
+
+    virtual ~RoaringDictionary();
+
+    virtual size_t GetCount() const override;
+
+    // Elements that fit into the allocated value arrays.
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const int &key) const override;
+
+    virtual bool ContainsKey(const int &key) const override;
+
+    virtual void Add(const int &key, const TElement &element) override;
+
+    virtual void Remove(const int &key) override;
+
+    virtual bool TryRemove(const int &key) override;
+
+    virtual void Update(const int &key, const TElement &element) override;
+
+    virtual UnqPtr<IDictionaryIterator<int, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const int &key) const override;
+
+    virtual TElement GetOrDefault(const int &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const int &key, const TElement &element) override;
+
+    size_t GetContainerCount() const;
+
+    size_t GetBitmapContainerCount() const;
+
+    // Estimated bytes held by the dictionary: the container directory, the containers and
+    // their key and value arrays.
+    size_t GetMemoryUsage() const;
+
+private:
+    // A container with more keys than this switches to a bitmap, the size at which the
+    // 8 KiB bitmap becomes smaller than an array of 16-bit keys.
+    static constexpr size_t ArrayLimit = 4096;
+    // A bitmap container turns back into an array only at half the limit, so keys added
+    // and removed around the limit do not convert the container every time.
+    static constexpr size_t BitmapToArrayLimit = ArrayLimit / 2;
+    static constexpr size_t BitmapWords = 65536 / 64;
+    static constexpr size_t MinimumCapacity = 4;
+
+    struct Container {
+        uint16_t high;
+        size_t cardinality;
+        // Array form: sorted low halves. Null in bitmap form.
+        UnqPtr<uint16_t[]> lows;
+        size_t lowsCapacity;
+        // Bitmap form: one bit per low half and the number of keys before each word.
+        UnqPtr<uint64_t[]> words;
+        UnqPtr<uint16_t[]> wordRanks;
+        // Elements in key order.
+        UnqPtr<TElement[]> values;
+        size_t valuesCapacity;
+
+        explicit Container(uint16_t high)
+                : high(high), cardinality(0), lows(nullptr), lowsCapacity(0), words(nullptr),
+                  wordRanks(nullptr), values(nullptr), valuesCapacity(0) {}
+
+        bool IsBitmap() const {
+            return static_cast<bool>(words);
+        }
+    };
+
+    // High halves of the containers, kept apart from them so the binary search stays in
+    // one small array.
+    UnqPtr<uint16_t[]> highs;
+    UnqPtr<UnqPtr<Container>[]> containers;
+    size_t containerCount;
+    size_t containerCapacity;
+    size_t count;
+
+    // Flips the sign bit so that unsigned order of the bits matches signed order of keys.
+    static uint32_t ToBits(int key);
+
+    static int ToKey(uint16_t high, uint16_t low);
+
+    // Index of the first container whose high half is not below high.
+    size_t LowerBound(uint16_t high) const;
+
+    // Number of keys in the container below low; found tells whether low itself is there.
+    static size_t Rank(const Container &container, uint16_t low, bool &found);
+
+    // Returns the element stored under key, or nullptr if it is absent.
+    TElement *FindValue(int key) const;
+
+    // Inserts the key or overwrites its element. Returns true if the key was inserted.
+    bool Put(int key, const TElement &element);
+
+    static void InsertLow(Container &container, uint16_t low, size_t rank, const TElement &element);
+
+    static void RemoveLow(Container &container, uint16_t low, size_t rank);
+
+    static void ConvertToBitmap(Container &container);
+
+    static void ConvertToArray(Container &container);
+
+    // Inserts value at index of an array holding length items, doubling it when full.
+    template<typename T>
+    static void InsertAt(UnqPtr<T[]> &data, size_t &capacity, size_t length, size_t index, T value);
+
+    // Removes the item at index and resets the freed last slot.
+    template<typename T>
+    static void RemoveAt(UnqPtr<T[]> &data, size_t length, size_t index);
+
+    class RoaringDictionaryIterator : public IDictionaryIterator<int, TElement> {
+    public:
+        RoaringDictionaryIterator(const RoaringDictionary *dictionary);
+
+        virtual ~RoaringDictionaryIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual int GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        const RoaringDictionary *dictionary;
+        size_t containerIndex;
+        // Rank of the current key inside its container.
+        size_t rank;
+        // Bitmap cursor: the next word to load and the unvisited bits of the last one.
+        size_t nextWord;
+        uint64_t remainingBits;
+        uint16_t currentLow;
+        bool started;
+
+        bool IsValid() const;
+    };
+};
+
+template<typename TElement>
+RoaringDictionary<TElement>::RoaringDictionary()
+        : highs(nullptr), containers(nullptr), containerCount(0), containerCapacity(0), count(0) {
+}
+
+template<typename TElement>
+RoaringDictionary<TElement>::~RoaringDictionary() {
+
+}
+
+template<typename TElement>
+size_t RoaringDictionary<TElement>::GetCount() const {
+    return count;
+}
+
+template<typename TElement>
+size_t RoaringDictionary<TElement>::GetCapacity() const {
+    size_t capacity = 0;
+    for (size_t i = 0; i < containerCount; ++i) {
+        capacity += containers[i]->valuesCapacity;
+    }
+    return capacity;
+}
+
+template<typename TElement>
+size_t RoaringDictionary<TElement>::GetContainerCount() const {
+    return containerCount;
+}
+
+template<typename TElement>
+size_t RoaringDictionary<TElement>::GetBitmapContainerCount() const {
+    size_t bitmaps = 0;
+    for (size_t i = 0; i < containerCount; ++i) {
+        bitmaps += containers[i]->IsBitmap() ? 1 : 0;
+    }
+    return bitmaps;
+}
+
+template<typename TElement>
+size_t RoaringDictionary<TElement>::GetMemoryUsage() const {
+    size_t bytes = sizeof(*this) + containerCapacity * (sizeof(uint16_t) + sizeof(UnqPtr<Container>));
+    for (size_t i = 0; i < containerCount; ++i) {
+        const Container &container = *containers[i];
+        bytes += sizeof(Container) + container.lowsCapacity * sizeof(uint16_t) +
+                 container.valuesCapacity * sizeof(TElement);
+        if (container.IsBitmap()) {
+            bytes += BitmapWords * (sizeof(uint64_t) + sizeof(uint16_t));
+        }
+    }
+    return bytes;
+}
+
+template<typename TElement>
+uint32_t RoaringDictionary<TElement>::ToBits(int key) {
+    return static_cast<uint32_t>(key) ^ 0x80000000U;
+}
+
+template<typename TElement>
+int RoaringDictionary<TElement>::ToKey(uint16_t high, uint16_t low) {
+    return static_cast<int>(((static_cast<uint32_t>(high) << 16) | low) ^ 0x80000000U);
+}
+
+template<typename TElement>
+size_t RoaringDictionary<TElement>::LowerBound(uint16_t high) const {
+    return std::lower_bound(highs.get(), highs.get() + containerCount, high) - highs.get();
+}
+
+template<typename TElement>
+size_t RoaringDictionary<TElement>::Rank(const Container &container, uint16_t low, bool &found) {
+    if (container.IsBitmap()) {
+        size_t word = low >> 6;
+        uint64_t bit = uint64_t(1) << (low & 63);
+        found = (container.words[word] & bit) != 0;
+        return container.wordRanks[word] + std::popcount(container.words[word] & (bit - 1));
+    }
+    const uint16_t *begin = container.lows.get();
+    const uint16_t *position = std::lower_bound(begin, begin + container.cardinality, low);
+    found = position != begin + container.cardinality && *position == low;
+    return position - begin;
+}
+
+template<typename TElement>
+TElement *RoaringDictionary<TElement>::FindValue(int key) const {
+    uint32_t bits = ToBits(key);
+    uint16_t high = static_cast<uint16_t>(bits >> 16);
+    size_t index = LowerBound(high);
+    if (index == containerCount || highs[index] != high) {
+        return nullptr;
+    }
+    const Container &container = *containers[index];
+    bool found;
+    size_t rank = Rank(container, static_cast<uint16_t>(bits), found);
+    return found ? &container.values[rank] : nullptr;
+}
+
+template<typename TElement>
+bool RoaringDictionary<TElement>::Put(int key, const TElement &element) {
+    uint32_t bits = ToBits(key);
+    uint16_t high = static_cast<uint16_t>(bits >> 16);
+    uint16_t low = static_cast<uint16_t>(bits);
+    size_t index = LowerBound(high);
+    if (index == containerCount || highs[index] != high) {
+        // Both arrays grow together, so containerCapacity is the capacity of each.
+        size_t highsCapacity = containerCapacity;
+        InsertAt(highs, highsCapacity, containerCount, index, high);
+        InsertAt(containers, containerCapacity, containerCount, index, UnqPtr<Container>(new Container(high)));
+        ++containerCount;
+    }
+
+    Container &container = *containers[index];
+    bool found;
+    size_t rank = Rank(container, low, found);
+    if (found) {
+        container.values[rank] = element;
+        return false;
+    }
+    InsertLow(container, low, rank, element);
+    ++count;
+    return true;
+}
+
+template<typename TElement>
+void RoaringDictionary<TElement>::InsertLow(Container &container, uint16_t low, size_t rank,
+                                            const TElement &element) {
+    if (!container.IsBitmap() && container.cardinality == ArrayLimit) {
+        ConvertToBitmap(container);
+    }
+    if (container.IsBitmap()) {
+        size_t word = low >> 6;
+        container.words[word] |= uint64_t(1) << (low & 63);
+        for (size_t i = word + 1; i < BitmapWords; ++i) {
+            ++container.wordRanks[i];
+        }
+    } else {
+        InsertAt(container.lows, container.lowsCapacity, container.cardinality, rank, low);
+    }
+    InsertAt(container.values, container.valuesCapacity, container.cardinality, rank, element);
+    ++container.cardinality;
+}
+
+template<typename TElement>
+void RoaringDictionary<TElement>::RemoveLow(Container &container, uint16_t low, size_t rank) {
+    RemoveAt(container.values, container.cardinality, rank);
+    if (container.IsBitmap()) {
+        size_t word = low >> 6;
+        container.words[word] &= ~(uint64_t(1) << (low & 63));
+        for (size_t i = word + 1; i < BitmapWords; ++i) {
+            --container.wordRanks[i];
+        }
+    } else {
+        RemoveAt(container.lows, container.cardinality, rank);
+    }
+    --container.cardinality;
+    if (container.IsBitmap() && container.cardinality <= BitmapToArrayLimit) {
+        ConvertToArray(container);
+    }
+}
+
+template<typename TElement>
+void RoaringDictionary<TElement>::ConvertToBitmap(Container &container) {
+    container.words.reset(new uint64_t[BitmapWords]());
+    container.wordRanks.reset(new uint16_t[BitmapWords]);
+    for (size_t i = 0; i < container.cardinality; ++i) {
+        uint16_t low = container.lows[i];
+        container.words[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+    size_t rank = 0;
+    for (size_t i = 0; i < BitmapWords; ++i) {
+        container.wordRanks[i] = static_cast<uint16_t>(rank);
+        rank += std::popcount(container.words[i]);
+    }
+    container.lows.reset();
+    container.lowsCapacity = 0;
+}
+
+template<typename TElement>
+void RoaringDictionary<TElement>::ConvertToArray(Container &container) {
+    container.lowsCapacity = std::max(MinimumCapacity, std::bit_ceil(container.cardinality));
+    container.lows.reset(new uint16_t[container.lowsCapacity]);
+    size_t position = 0;
+    for (size_t i = 0; i < BitmapWords; ++i) {
+        for (uint64_t word = container.words[i]; word != 0; word &= word - 1) {
+            container.lows[position++] = static_cast<uint16_t>(i * 64 + std::countr_zero(word));
+        }
+    }
+    container.words.reset();
+    container.wordRanks.reset();
+}
+
+template<typename TElement>
+template<typename T>
+void RoaringDictionary<TElement>::InsertAt(UnqPtr<T[]> &data, size_t &capacity, size_t length, size_t index,
+                                           T value) {
+    if (length == capacity) {
+        size_t newCapacity = capacity < MinimumCapacity ? MinimumCapacity : capacity * 2;
+        UnqPtr<T[]> newData(new T[newCapacity]);
+        for (size_t i = 0; i < index; ++i) {
+            newData[i] = std::move(data[i]);
+        }
+        for (size_t i = index; i < length; ++i) {
+            newData[i + 1] = std::move(data[i]);
+        }
+        newData[index] = std::move(value);
+        data = std::move(newData);
+        capacity = newCapacity;
+        return;
+    }
+    for (size_t i = length; i > index; --i) {
+        data[i] = std::move(data[i - 1]);
+    }
+    data[index] = std::move(value);
+}
+
+template<typename TElement>
+template<typename T>
+void RoaringDictionary<TElement>::RemoveAt(UnqPtr<T[]> &data, size_t length, size_t index) {
+    for (size_t i = index; i + 1 < length; ++i) {
+        data[i] = std::move(data[i + 1]);
+    }
+    data[length - 1] = T();
+}
+
+template<typename TElement>
+TElement RoaringDictionary<TElement>::Get(const int &key) const {
+    TElement *value = FindValue(key);
+    if (!value) {
+        throw std::runtime_error("Key not found.");
+    }
+    return *value;
+}
+
+template<typename TElement>
+bool RoaringDictionary<TElement>::ContainsKey(const int &key) const {
+    return FindValue(key) != nullptr;
+}
+
+template<typename TElement>
+std::optional<TElement> RoaringDictionary<TElement>::TryGet(const int &key) const {
+    TElement *value = FindValue(key);
+    if (!value) {
+        return std::nullopt;
+    }
+    return *value;
+}
+
+template<typename TElement>
+TElement RoaringDictionary<TElement>::GetOrDefault(const int &key, const TElement &defaultValue) const {
+    TElement *value = FindValue(key);
+    return value ? *value : defaultValue;
+}
+
+template<typename TElement>
+void RoaringDictionary<TElement>::Add(const int &key, const TElement &element) {
+    Put(key, element);
+}
+
+template<typename TElement>
+bool RoaringDictionary<TElement>::Upsert(const int &key, const TElement &element) {
+    return Put(key, element);
+}
+
+template<typename TElement>
+void RoaringDictionary<TElement>::Update(const int &key, const TElement &element) {
+    TElement *value = FindValue(key);
+    if (!value) {
+        throw std::runtime_error("Key not found.");
+    }
+    *value = element;
+}
+
+template<typename TElement>
+void RoaringDictionary<TElement>::Remove(const int &key) {
+    if (!TryRemove(key)) {
+        throw std::runtime_error("Key not found.");
+    }
+}
+
+template<typename TElement>
+bool RoaringDictionary<TElement>::TryRemove(const int &key) {
+    uint32_t bits = ToBits(key);
+    uint16_t high = static_cast<uint16_t>(bits >> 16);
+    uint16_t low = static_cast<uint16_t>(bits);
+    size_t index = LowerBound(high);
+    if (index == containerCount || highs[index] != high) {
+        return false;
+    }
+
+    Container &container = *containers[index];
+    bool found;
+    size_t rank = Rank(container, low, found);
+    if (!found) {
+        return false;
+    }
+    RemoveLow(container, low, rank);
+    --count;
+
+    if (container.cardinality == 0) {
+        RemoveAt(highs, containerCount, index);
+        RemoveAt(containers, containerCount, index);
+        --containerCount;
+    }
+    return true;
+}
+
+template<typename TElement>
+RoaringDictionary<TElement>::RoaringDictionaryIterator::RoaringDictionaryIterator(const RoaringDictionary *dictionary)
+        : dictionary(dictionary), containerIndex(0), rank(0), nextWord(0), remainingBits(0), currentLow(0),
+          started(false) {
+}
+
+template<typename TElement>
+bool RoaringDictionary<TElement>::RoaringDictionaryIterator::IsValid() const {
+    return containerIndex < dictionary->containerCount;
+}
+
+template<typename TElement>
+bool RoaringDictionary<TElement>::RoaringDictionaryIterator::MoveNext() {
+    if (started) {
+        ++rank;
+    }
+    started = true;
+
+    while (containerIndex < dictionary->containerCount) {
+        const Container &container = *dictionary->containers[containerIndex];
+        if (rank < container.cardinality) {
+            if (container.IsBitmap()) {
+                // rank < cardinality guarantees a set bit further on.
+                while (remainingBits == 0) {
+                    remainingBits = container.words[nextWord++];
+                }
+                currentLow = static_cast<uint16_t>((nextWord - 1) * 64 + std::countr_zero(remainingBits));
+                remainingBits &= remainingBits - 1;
+            } else {
+                currentLow = container.lows[rank];
+            }
+            return true;
+        }
+        ++containerIndex;
+        rank = 0;
+        nextWord = 0;
+        remainingBits = 0;
+    }
+
+    return false;
+}
+
+template<typename TElement>
+void RoaringDictionary<TElement>::RoaringDictionaryIterator::Reset() {
+    containerIndex = 0;
+    rank = 0;
+    nextWord = 0;
+    remainingBits = 0;
+    started = false;
+}
+
+template<typename TElement>
+int RoaringDictionary<TElement>::RoaringDictionaryIterator::GetCurrentKey() const {
+    if (!started || !IsValid())
+        throw std::out_of_range("Iterator out of range");
+
+    return ToKey(dictionary->containers[containerIndex]->high, currentLow);
+}
+
+template<typename TElement>
+TElement RoaringDictionary<TElement>::RoaringDictionaryIterator::GetCurrentValue() const {
+    if (!started || !IsValid())
+        throw std::out_of_range("Iterator out of range");
+
+    return dictionary->containers[containerIndex]->values[rank];
+}
+
+template<typename TElement>
+UnqPtr<IDictionaryIterator<int, TElement>> RoaringDictionary<TElement>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<int, TElement>>(new RoaringDictionaryIterator(this));
+}
+
+#endif // ROARINGDICTIONARY_H
@@ -3,17 +3,63 @@
 #define SPARSEMATRIX_H
 
 #include "IDictionary.h"
+#include "FrozenHashTable.h"
 #include "IndexPair.h"
 #include "ShrdPtr.h"
 #include "DynamicArraySmart.h"
 #include "KeyValue.h"
+#include <stdexcept>
 #include <vector>
 
 template<typename TElement>
 class SparseMatrix {
 public:
-    SparseMatrix(int rows, int columns, UnqPtr<IDictionary<IndexPair, TElement>> dictionary)
-            : rows(rows), columns(columns), elements(std::move(dictionary)) {}
+    // capacityHint is the expected number of non-zero elements; it is passed on to the
+    // dictionary so it can size itself before the first insert.
+    SparseMatrix(int rows, int columns, UnqPtr<IDictionary<IndexPair, TElement>> dictionary,
+                 size_t capacityHint = 0)
+            : rows(rows), columns(columns), elements(std::move(dictionary))
+    {
+        if (capacityHint > 0)
+        {
+            elements->Reserve(capacityHint);
+        }
+    }
+
+    // Builds the matrix from count (position, value) pairs in strictly ascending row-major
+    // order. The non-zero pairs go to the dictionary with one AddSorted call, so an empty
+    // ordered dictionary is bulk-loaded instead of filled key by key.
+    SparseMatrix(int rows, int columns, UnqPtr<IDictionary<IndexPair, TElement>> dictionary,
+                 const IndexPair* positions, const TElement* values, size_t count)
+            : rows(rows), columns(columns), elements(std::move(dictionary))
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (positions[i].row < 0 || positions[i].row >= rows ||
+                positions[i].column < 0 || positions[i].column >= columns)
+            {
+                throw std::out_of_range("Row or column index is out of bounds.");
+            }
+            if (i > 0 && !(positions[i - 1] < positions[i]))
+            {
+                throw std::invalid_argument("Positions must be sorted and unique.");
+            }
+        }
+
+        UnqPtr<IndexPair[]> nonZeroPositions(new IndexPair[count]);
+        UnqPtr<TElement[]> nonZeroValues(new TElement[count]);
+        size_t nonZeroCount = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (values[i] != TElement())
+            {
+                nonZeroPositions[nonZeroCount] = positions[i];
+                nonZeroValues[nonZeroCount] = values[i];
+                ++nonZeroCount;
+            }
+        }
+        elements->AddSorted(nonZeroPositions.get(), nonZeroValues.get(), nonZeroCount);
+    }
 
     ~SparseMatrix(){}
 
@@ -34,40 +80,74 @@ public:
             throw std::out_of_range("Row or column index is out of bounds.");
         }
 
+        return elements->GetOrDefault(IndexPair(row, column), TElement());
+    }
+
+    void SetElement(int row, int column, const TElement& value)
+    {
+        if (row < 0 || row >= rows || column < 0 || column >= columns)
+        {
+            throw std::out_of_range("Row or column index is out of bounds.");
+        }
+
         IndexPair key(row, column);
-        if (elements->ContainsKey(key))
+        if (value != TElement())
         {
-            return elements->Get(key);
+            elements->Upsert(key, value);
         }
         else
         {
-            return TElement();
+            RemoveElement(key.row, key.column);
         }
     }
 
-    void SetElement(int row, int column, const TElement& value)
+    // Bulk SetElement: all positions are checked before anything changes, then non-zero
+    // values go to the dictionary in batches and zeros remove their entries, in order.
+    void SetElements(const IndexPair* positions, const TElement* values, size_t count)
     {
-        if (row < 0 || row >= rows || column < 0 || column >= columns)
+        for (size_t i = 0; i < count; ++i)
         {
-            throw std::out_of_range("Row or column index is out of bounds.");
+            if (positions[i].row < 0 || positions[i].row >= rows ||
+                positions[i].column < 0 || positions[i].column >= columns)
+            {
+                throw std::out_of_range("Row or column index is out of bounds.");
+            }
         }
 
-        IndexPair key(row, column);
-        if (value != TElement())
+        UnqPtr<IndexPair[]> batchKeys(new IndexPair[count]);
+        UnqPtr<TElement[]> batchValues(new TElement[count]);
+        size_t batchSize = 0;
+        for (size_t i = 0; i < count; ++i)
         {
-            if (elements->ContainsKey(key))
+            if (values[i] != TElement())
             {
-                elements->Update(key, value);
+                batchKeys[batchSize] = positions[i];
+                batchValues[batchSize] = values[i];
+                ++batchSize;
             }
             else
             {
-                elements->Add(key, value);
+                elements->AddRange(batchKeys.get(), batchValues.get(), batchSize);
+                batchSize = 0;
+                RemoveElement(positions[i].row, positions[i].column);
             }
         }
-        else
+        elements->AddRange(batchKeys.get(), batchValues.get(), batchSize);
+    }
+
+    // Bulk GetElement: values[i] receives the element at positions[i].
+    void GetElements(const IndexPair* positions, size_t count, TElement* values) const
+    {
+        for (size_t i = 0; i < count; ++i)
         {
-            RemoveElement(key.row, key.column);
+            if (positions[i].row < 0 || positions[i].row >= rows ||
+                positions[i].column < 0 || positions[i].column >= columns)
+            {
+                throw std::out_of_range("Row or column index is out of bounds.");
+            }
         }
+
+        elements->GetMany(positions, count, values, nullptr);
     }
 
     void RemoveElement(int row, int column) {
@@ -75,10 +155,7 @@ public:
             throw std::out_of_range("Row or column index is out of bounds.");
         }
 
-        IndexPair key(row, column);
-        if (elements->ContainsKey(key)) {
-            elements->Remove(key);
-        }
+        elements->TryRemove(IndexPair(row, column));
     }
 
     void ForEach(void (*func)(const IndexPair &, const TElement &)) const {
@@ -91,6 +168,21 @@ public:
         }
     }
 
+    // Calls func for the non-zero elements of one row. An ordered dictionary seeks to the
+    // row and visits its elements in column order, in O(log n + k); others scan everything.
+    void ForEachInRow(int row, void (*func)(const IndexPair &, const TElement &)) const {
+        if (row < 0 || row >= rows) {
+            throw std::out_of_range("Row or column index is out of bounds.");
+        }
+
+        auto iterator = elements->GetRange(IndexPair(row, 0), IndexPair(row + 1, 0));
+        while (iterator->MoveNext()) {
+            IndexPair key = iterator->GetCurrentKey();
+            TElement value = iterator->GetCurrentValue();
+            func(key, value);
+        }
+    }
+
 
 
     void Map(TElement (*func)(TElement))
@@ -129,6 +221,14 @@ public:
         return elements->GetIterator();
     }
 
+    // Replaces the dictionary with a FrozenHashTable copy for read-mostly use. Existing
+    // elements can still be changed afterwards, but setting a new non-zero element or
+    // zeroing one throws.
+    void Freeze()
+    {
+        elements = ::Freeze(*elements);
+    }
+
     const IDictionary<IndexPair, TElement>& GetElements() const {
         return *elements;
     }
@@ -3,6 +3,7 @@
 #define SPARSEVECTOR_H
 
 #include "IDictionary.h"
+#include "FrozenHashTable.h"
 #include "ShrdPtr.h"
 #include "DynamicArraySmart.h"
 #include "KeyValue.h"
@@ -14,8 +15,50 @@ template <typename TElement>
 class SparseVector
 {
 public:
-    SparseVector(int length, UnqPtr<IDictionary<int, TElement>> dictionary)
-            : length(length), elements(std::move(dictionary)) {}
+    // capacityHint is the expected number of non-zero elements; it is passed on to the
+    // dictionary so it can size itself before the first insert.
+    SparseVector(int length, UnqPtr<IDictionary<int, TElement>> dictionary, size_t capacityHint = 0)
+            : length(length), elements(std::move(dictionary))
+    {
+        if (capacityHint > 0)
+        {
+            elements->Reserve(capacityHint);
+        }
+    }
+
+    // Builds the vector from count (index, value) pairs with strictly ascending indices.
+    // The non-zero pairs go to the dictionary with one AddSorted call, so an empty ordered
+    // dictionary is bulk-loaded instead of filled key by key.
+    SparseVector(int length, UnqPtr<IDictionary<int, TElement>> dictionary, const int* indices,
+                 const TElement* values, size_t count)
+            : length(length), elements(std::move(dictionary))
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (indices[i] < 0 || indices[i] >= length)
+            {
+                throw std::out_of_range("Index is out of bounds.");
+            }
+            if (i > 0 && indices[i - 1] >= indices[i])
+            {
+                throw std::invalid_argument("Indices must be sorted and unique.");
+            }
+        }
+
+        UnqPtr<int[]> nonZeroIndices(new int[count]);
+        UnqPtr<TElement[]> nonZeroValues(new TElement[count]);
+        size_t nonZeroCount = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (values[i] != TElement())
+            {
+                nonZeroIndices[nonZeroCount] = indices[i];
+                nonZeroValues[nonZeroCount] = values[i];
+                ++nonZeroCount;
+            }
+        }
+        elements->AddSorted(nonZeroIndices.get(), nonZeroValues.get(), nonZeroCount);
+    }
 
     ~SparseVector(){}
 
@@ -31,38 +74,71 @@ public:
             throw std::out_of_range("Index is out of bounds.");
         }
 
-        if (elements->ContainsKey(index))
+        return elements->GetOrDefault(index, TElement());
+    }
+
+    void SetElement(int index, const TElement& value)
+    {
+        if (index < 0 || index >= length)
         {
-            return elements->Get(index);
+            throw std::out_of_range("Index is out of bounds.");
+        }
+
+        if (value != TElement())
+        {
+            elements->Upsert(index, value);
         }
         else
         {
-            return TElement();
+            RemoveElement(index);
         }
     }
 
-    void SetElement(int index, const TElement& value)
+    // Bulk SetElement: all indices are checked before anything changes, then non-zero
+    // values go to the dictionary in batches and zeros remove their entries, in order.
+    void SetElements(const int* indices, const TElement* values, size_t count)
     {
-        if (index < 0 || index >= length)
+        for (size_t i = 0; i < count; ++i)
         {
-            throw std::out_of_range("Index is out of bounds.");
+            if (indices[i] < 0 || indices[i] >= length)
+            {
+                throw std::out_of_range("Index is out of bounds.");
+            }
         }
 
-        if (value != TElement())
+        UnqPtr<int[]> batchKeys(new int[count]);
+        UnqPtr<TElement[]> batchValues(new TElement[count]);
+        size_t batchSize = 0;
+        for (size_t i = 0; i < count; ++i)
         {
-            if (elements->ContainsKey(index))
+            if (values[i] != TElement())
             {
-                elements->Update(index, value);
+                batchKeys[batchSize] = indices[i];
+                batchValues[batchSize] = values[i];
+                ++batchSize;
             }
             else
             {
-                elements->Add(index, value);
+                elements->AddRange(batchKeys.get(), batchValues.get(), batchSize);
+                batchSize = 0;
+                RemoveElement(indices[i]);
             }
         }
-        else
+        elements->AddRange(batchKeys.get(), batchValues.get(), batchSize);
+    }
+
+    // Bulk GetElement: values[i] receives the element at indices[i].
+    void GetElements(const int* indices, size_t count, TElement* values) const
+    {
+        for (size_t i = 0; i < count; ++i)
         {
-            RemoveElement(index);
+            if (indices[i] < 0 || indices[i] >= length)
+            {
+                throw std::out_of_range("Index is out of bounds.");
+            }
         }
+
+        elements->GetMany(indices, count, values, nullptr);
     }
 
     void RemoveElement(int index) {
@@ -70,9 +146,7 @@ public:
             throw std::out_of_range("Index is out of bounds.");
         }
 
-        if (elements->ContainsKey(index)) {
-            elements->Remove(index);
-        }
+        elements->TryRemove(index);
     }
 
     void ForEach(void (*func)(int, const TElement&)) const
@@ -86,6 +160,24 @@ public:
         }
     }
 
+    // Calls func for the non-zero elements with begin <= index < end. An ordered dictionary
+    // seeks to begin and visits them in index order, in O(log n + k); others scan everything.
+    void ForEachInRange(int begin, int end, void (*func)(int, const TElement&)) const
+    {
+        if (begin < 0 || end > length || begin > end)
+        {
+            throw std::out_of_range("Index is out of bounds.");
+        }
+
+        auto iterator = elements->GetRange(begin, end);
+        while (iterator->MoveNext())
+        {
+            int key = iterator->GetCurrentKey();
+            TElement value = iterator->GetCurrentValue();
+            func(key, value);
+        }
+    }
+
     void Map(TElement (*func)(TElement))
     {
         DynamicArraySmart<KeyValue<int, TElement>> updates;
@@ -122,6 +214,14 @@ public:
     {
         return elements->GetIterator();
     }
+    // Replaces the dictionary with a FrozenHashTable copy for read-mostly use. Existing
+    // elements can still be changed afterwards, but setting a new non-zero element or
+    // zeroing one throws.
+    void Freeze()
+    {
+        elements = ::Freeze(*elements);
+    }
+
     const IDictionary<int, TElement>& GetElements() const {
         return *elements;
     }
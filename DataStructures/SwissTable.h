@@ -0,0 +1,448 @@
+#ifndef SWISSTABLE_H
+#define SWISSTABLE_H
+
+#include "IDictionary.h"
+#include "UnqPtr.h"
+#include "Hashers.h"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SWISSTABLE_GROUP_WIDTH 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SWISSTABLE_GROUP_WIDTH 16
+#else
+#define SWISSTABLE_GROUP_WIDTH 8
+#endif
+
+#define SWISSTABLE_CTRL_EMPTY (-128)
+#define SWISSTABLE_CTRL_DELETED (-2)
+
+// A group of control bytes checked with one compare: 32 slots with AVX2, 16 with SSE2
+// and 8 with the portable scalar loop. Every mask has bit i set when slot i matches.
+class SwissGroup {
+public:
+    static constexpr size_t Width = SWISSTABLE_GROUP_WIDTH;
+
+    explicit SwissGroup(const int8_t *ctrl) {
+#if SWISSTABLE_GROUP_WIDTH == 32
+        bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ctrl));
+#elif SWISSTABLE_GROUP_WIDTH == 16
+        bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+#else
+        std::memcpy(bytes, ctrl, Width);
+#endif
+    }
+
+    uint32_t Match(int8_t h2) const {
+#if SWISSTABLE_GROUP_WIDTH == 32
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2), bytes)));
+#elif SWISSTABLE_GROUP_WIDTH == 16
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), bytes)));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < Width; ++i) {
+            if (bytes[i] == h2) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+#endif
+    }
+
+    uint32_t MatchEmpty() const {
+        return Match(SWISSTABLE_CTRL_EMPTY);
+    }
+
+    // Empty and deleted bytes are the only ones with the sign bit set.
+    uint32_t MatchEmptyOrDeleted() const {
+#if SWISSTABLE_GROUP_WIDTH == 32
+        return static_cast<uint32_t>(_mm256_movemask_epi8(bytes));
+#elif SWISSTABLE_GROUP_WIDTH == 16
+        return static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < Width; ++i) {
+            if (bytes[i] < 0) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+#endif
+    }
+
+private:
+#if SWISSTABLE_GROUP_WIDTH == 32
+    __m256i bytes;
+#elif SWISSTABLE_GROUP_WIDTH == 16
+    __m128i bytes;
+#else
+    int8_t bytes[SWISSTABLE_GROUP_WIDTH];
+#endif
+};
+
+// Open-addressing hash table with a separate control byte per slot holding the low
+// 7 bits of the hash. Lookups filter a whole group of slots with one SIMD compare and
+// only compare keys whose fragment matched.
+template<typename TKey, typename TElement>
+class SwissTable : public IDictionary<TKey, TElement> {
+public:
+    SwissTable(size_t initialCapacity = 16);
+
+    virtual ~SwissTable();
+
+    virtual size_t GetCount() const override;
+
+    virtual size_t GetCapacity() const override;
+
+    virtual TElement Get(const TKey &key) const override;
+
+    virtual bool ContainsKey(const TKey &key) const override;
+
+    virtual void Add(const TKey &key, const TElement &element) override;
+
+    virtual void Remove(const TKey &key) override;
+
+    virtual bool TryRemove(const TKey &key) override;
+
+    virtual void Update(const TKey &key, const TElement &element) override;
+
+    virtual UnqPtr<IDictionaryIterator<TKey, TElement>> GetIterator() const override;
+
+    virtual std::optional<TElement> TryGet(const TKey &key) const override;
+
+    virtual TElement GetOrDefault(const TKey &key, const TElement &defaultValue) const override;
+
+    virtual bool Upsert(const TKey &key, const TElement &element) override;
+
+    virtual void Reserve(size_t count) override;
+
+private:
+    struct Slot {
+        TKey key;
+        TElement value;
+    };
+
+    static constexpr size_t NotFound = static_cast<size_t>(-1);
+
+    UnqPtr<int8_t[]> ctrl;
+    UnqPtr<Slot[]> slots;
+    size_t count;
+    size_t capacity;
+    size_t groupMask;
+    // Number of empty slots that may still be consumed before the table must grow.
+    size_t growthLeft;
+
+    size_t HashFunction(const TKey &key) const;
+
+    size_t FindIndex(const TKey &key, size_t hash) const;
+
+    size_t FindInsertSlot(size_t hash) const;
+
+    void InsertUnique(TKey key, TElement value, size_t hash);
+
+    void Rehash(size_t newCapacity);
+
+    void Allocate(size_t newCapacity);
+
+    static size_t RoundUpToPowerOfTwo(size_t value);
+
+    static size_t H1(size_t hash) {
+        return hash >> 7;
+    }
+
+    static int8_t H2(size_t hash) {
+        return static_cast<int8_t>(hash & 0x7F);
+    }
+
+    class SwissTableIterator : public IDictionaryIterator<TKey, TElement> {
+    public:
+        SwissTableIterator(const SwissTable *hashTable);
+
+        virtual ~SwissTableIterator() {}
+
+        virtual bool MoveNext() override;
+
+        virtual void Reset() override;
+
+        virtual TKey GetCurrentKey() const override;
+
+        virtual TElement GetCurrentValue() const override;
+
+    private:
+        const SwissTable *hashTable;
+        size_t slotIndex;
+        bool started;
+    };
+};
+
+template<typename TKey, typename TElement>
+SwissTable<TKey, TElement>::SwissTable(size_t initialCapacity)
+        : ctrl(nullptr), slots(nullptr), count(0), capacity(0), groupMask(0), growthLeft(0) {
+    size_t minimum = initialCapacity < SwissGroup::Width ? SwissGroup::Width : initialCapacity;
+    Allocate(RoundUpToPowerOfTwo(minimum));
+}
+
+template<typename TKey, typename TElement>
+SwissTable<TKey, TElement>::~SwissTable() {
+
+}
+
+template<typename TKey, typename TElement>
+size_t SwissTable<TKey, TElement>::GetCount() const {
+    return count;
+}
+
+template<typename TKey, typename TElement>
+size_t SwissTable<TKey, TElement>::GetCapacity() const {
+    return capacity;
+}
+
+template<typename TKey, typename TElement>
+size_t SwissTable<TKey, TElement>::RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+template<typename TKey, typename TElement>
+void SwissTable<TKey, TElement>::Allocate(size_t newCapacity) {
+    ctrl.reset(new int8_t[newCapacity]);
+    std::memset(ctrl.get(), SWISSTABLE_CTRL_EMPTY, newCapacity);
+    slots.reset(new Slot[newCapacity]);
+    capacity = newCapacity;
+    groupMask = newCapacity / SwissGroup::Width - 1;
+    growthLeft = newCapacity - newCapacity / 8;
+}
+
+template<typename TKey, typename TElement>
+size_t SwissTable<TKey, TElement>::HashFunction(const TKey &key) const {
+    return DefaultHash<TKey>()(key);
+}
+
+template<typename TKey, typename TElement>
+size_t SwissTable<TKey, TElement>::FindIndex(const TKey &key, size_t hash) const {
+    size_t group = H1(hash) & groupMask;
+    int8_t h2 = H2(hash);
+
+    for (size_t step = 1;; ++step) {
+        size_t base = group * SwissGroup::Width;
+        SwissGroup g(ctrl.get() + base);
+
+        for (uint32_t match = g.Match(h2); match != 0; match &= match - 1) {
+            size_t index = base + std::countr_zero(match);
+            if (slots[index].key == key) {
+                return index;
+            }
+        }
+
+        if (g.MatchEmpty() != 0) {
+            return NotFound;
+        }
+
+        // Triangular probing visits every group when the group count is a power of two.
+        group = (group + step) & groupMask;
+    }
+}
+
+template<typename TKey, typename TElement>
+size_t SwissTable<TKey, TElement>::FindInsertSlot(size_t hash) const {
+    size_t group = H1(hash) & groupMask;
+
+    for (size_t step = 1;; ++step) {
+        size_t base = group * SwissGroup::Width;
+        uint32_t available = SwissGroup(ctrl.get() + base).MatchEmptyOrDeleted();
+        if (available != 0) {
+            return base + std::countr_zero(available);
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
+template<typename TKey, typename TElement>
+void SwissTable<TKey, TElement>::InsertUnique(TKey key, TElement value, size_t hash) {
+    size_t index = FindInsertSlot(hash);
+    if (ctrl[index] == SWISSTABLE_CTRL_EMPTY) {
+        --growthLeft;
+    }
+    ctrl[index] = H2(hash);
+    slots[index].key = std::move(key);
+    slots[index].value = std::move(value);
+}
+
+template<typename TKey, typename TElement>
+void SwissTable<TKey, TElement>::Add(const TKey &key, const TElement &element) {
+    Upsert(key, element);
+}
+
+template<typename TKey, typename TElement>
+bool SwissTable<TKey, TElement>::Upsert(const TKey &key, const TElement &element) {
+    size_t hash = HashFunction(key);
+    size_t index = FindIndex(key, hash);
+    if (index != NotFound) {
+        slots[index].value = element;
+        return false;
+    }
+
+    if (growthLeft == 0) {
+        // Mostly tombstones: rebuild in place, otherwise double.
+        Rehash(count * 2 < capacity ? capacity : capacity * 2);
+    }
+
+    InsertUnique(key, element, hash);
+    ++count;
+    return true;
+}
+
+template<typename TKey, typename TElement>
+void SwissTable<TKey, TElement>::Reserve(size_t count) {
+    // Allocate leaves an eighth of the slots empty.
+    size_t newCapacity = RoundUpToPowerOfTwo(count + count / 7 + 1);
+    if (newCapacity > capacity) {
+        Rehash(newCapacity);
+    }
+}
+
+template<typename TKey, typename TElement>
+void SwissTable<TKey, TElement>::Remove(const TKey &key) {
+    if (!TryRemove(key)) {
+        throw std::runtime_error("Key not found.");
+    }
+}
+
+template<typename TKey, typename TElement>
+bool SwissTable<TKey, TElement>::TryRemove(const TKey &key) {
+    size_t index = FindIndex(key, HashFunction(key));
+    if (index == NotFound) {
+        return false;
+    }
+
+    // A group that still has an empty slot never let a probe pass through it,
+    // so the slot can become empty again instead of a tombstone.
+    size_t base = index & ~(SwissGroup::Width - 1);
+    if (SwissGroup(ctrl.get() + base).MatchEmpty() != 0) {
+        ctrl[index] = SWISSTABLE_CTRL_EMPTY;
+        ++growthLeft;
+    } else {
+        ctrl[index] = SWISSTABLE_CTRL_DELETED;
+    }
+
+    slots[index].key = TKey();
+    slots[index].value = TElement();
+    --count;
+    return true;
+}
+
+template<typename TKey, typename TElement>
+void SwissTable<TKey, TElement>::Update(const TKey &key, const TElement &element) {
+    size_t index = FindIndex(key, HashFunction(key));
+    if (index == NotFound) {
+        throw std::runtime_error("Key not found.");
+    }
+    slots[index].value = element;
+}
+
+template<typename TKey, typename TElement>
+bool SwissTable<TKey, TElement>::ContainsKey(const TKey &key) const {
+    return FindIndex(key, HashFunction(key)) != NotFound;
+}
+
+template<typename TKey, typename TElement>
+TElement SwissTable<TKey, TElement>::Get(const TKey &key) const {
+    size_t index = FindIndex(key, HashFunction(key));
+    if (index == NotFound) {
+        throw std::runtime_error("Key not found.");
+    }
+    return slots[index].value;
+}
+
+template<typename TKey, typename TElement>
+std::optional<TElement> SwissTable<TKey, TElement>::TryGet(const TKey &key) const {
+    size_t index = FindIndex(key, HashFunction(key));
+    if (index == NotFound) {
+        return std::nullopt;
+    }
+    return slots[index].value;
+}
+
+template<typename TKey, typename TElement>
+TElement SwissTable<TKey, TElement>::GetOrDefault(const TKey &key, const TElement &defaultValue) const {
+    size_t index = FindIndex(key, HashFunction(key));
+    return index == NotFound ? defaultValue : slots[index].value;
+}
+
+template<typename TKey, typename TElement>
+void SwissTable<TKey, TElement>::Rehash(size_t newCapacity) {
+    UnqPtr<int8_t[]> oldCtrl(std::move(ctrl));
+    UnqPtr<Slot[]> oldSlots(std::move(slots));
+    size_t oldCapacity = capacity;
+
+    Allocate(newCapacity);
+
+    for (size_t i = 0; i < oldCapacity; ++i) {
+        if (oldCtrl[i] >= 0) {
+            TKey key = std::move(oldSlots[i].key);
+            size_t hash = HashFunction(key);
+            InsertUnique(std::move(key), std::move(oldSlots[i].value), hash);
+        }
+    }
+}
+
+template<typename TKey, typename TElement>
+SwissTable<TKey, TElement>::SwissTableIterator::SwissTableIterator(const SwissTable *hashTable)
+        : hashTable(hashTable), slotIndex(0), started(false) {
+}
+
+template<typename TKey, typename TElement>
+bool SwissTable<TKey, TElement>::SwissTableIterator::MoveNext() {
+    if (started) {
+        ++slotIndex;
+    }
+    started = true;
+
+    while (slotIndex < hashTable->capacity) {
+        if (hashTable->ctrl[slotIndex] >= 0) {
+            return true;
+        }
+        ++slotIndex;
+    }
+
+    return false;
+}
+
+template<typename TKey, typename TElement>
+void SwissTable<TKey, TElement>::SwissTableIterator::Reset() {
+    slotIndex = 0;
+    started = false;
+}
+
+template<typename TKey, typename TElement>
+TKey SwissTable<TKey, TElement>::SwissTableIterator::GetCurrentKey() const {
+    if (!started || slotIndex >= hashTable->capacity)
+        throw std::out_of_range("Iterator out of range");
+
+    return hashTable->slots[slotIndex].key;
+}
+
+template<typename TKey, typename TElement>
+TElement SwissTable<TKey, TElement>::SwissTableIterator::GetCurrentValue() const {
+    if (!started || slotIndex >= hashTable->capacity)
+        throw std::out_of_range("Iterator out of range");
+
+    return hashTable->slots[slotIndex].value;
+}
+
+template<typename TKey, typename TElement>
+UnqPtr<IDictionaryIterator<TKey, TElement>> SwissTable<TKey, TElement>::GetIterator() const {
+    return UnqPtr<IDictionaryIterator<TKey, TElement>>(new SwissTableIterator(this));
+}
+
+#endif // SWISSTABLE_H
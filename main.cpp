@@ -51,7 +51,7 @@ void generate_python_script() {
 }
 
 void TestBTree() {
-    BTree<int, std::string> tree1;
+    BTree<int, std::string> tree1(3);
     tree1.Add(10, "Ten");
     tree1.PrintStructure();
     tree1.Add(20, "Twenty");
@@ -60,7 +60,7 @@ void TestBTree() {
     tree1.PrintStructure();
     tree1.Add(15, "Fifteen");
     tree1.PrintStructure();
-    BTree<int, std::string> tree;
+    BTree<int, std::string> tree(3);
 
     tree.Add(10, "Ten");
     tree.Add(20, "Twenty");
@@ -2,8 +2,22 @@
 #include "DataStructures/SparseVector.h"
 #include "DataStructures/SparseMatrix.h"
 #include "DataStructures/BTree.h"
+#include "DataStructures/BPlusTree.h"
+#include "DataStructures/KeySearch.h"
 #include "DataStructures/UnqPtr.h"
 #include "DataStructures/HashTable.h"
+#include "DataStructures/FlatHashTable.h"
+#include "DataStructures/SwissTable.h"
+#include "DataStructures/ConcurrentHashTable.h"
+#include "DataStructures/ConcurrentBTree.h"
+#include "DataStructures/LockFreeHashTable.h"
+#include "DataStructures/LockedDictionary.h"
+#include "DataStructures/CuckooHashTable.h"
+#include "DataStructures/FrozenHashTable.h"
+#include "DataStructures/FilteredDictionary.h"
+#include "DataStructures/RoaringDictionary.h"
+#include "DataStructures/LinkedListSmart.h"
+#include "DataStructures/NodeAllocator.h"
 #include <iostream>
 #include <fstream>
 #include <chrono>
@@ -11,8 +25,119 @@
 #include <string>
 #include <cstdlib>
 #include <unordered_set>
+#include <map>
+#include <cmath>
 #include <algorithm>
 #include <random>
+#include <optional>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <new>
+
+// Every heap allocation made by the program goes through these, so the allocation
+// benchmark can count how many a single insert costs. The whole family is replaced, with
+// the aligned and nothrow forms, so that every delete frees memory its own new obtained.
+static std::atomic<long long> allocation_count(0);
+
+static void* counted_allocate(std::size_t size, std::size_t alignment) noexcept {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        return std::malloc(size);
+    }
+    // aligned_alloc wants the size to be a multiple of the alignment.
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void* counted_allocate_or_throw(std::size_t size, std::size_t alignment) {
+    if (void* ptr = counted_allocate(size, alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) {
+    return counted_allocate_or_throw(size, 0);
+}
+
+void* operator new[](std::size_t size) {
+    return counted_allocate_or_throw(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return counted_allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return counted_allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size, 0);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
 
 void run_tests() {
     std::cout << "Starting functional tests..." << std::endl;
@@ -27,13 +152,81 @@ void run_tests() {
 void functional_tests() {
     test_dictionary<HashTable<int, std::string>, int, std::string>("HashTable");
 
+    test_dictionary<HashTable<int, std::string, StdHash<int>>, int, std::string>("HashTable(StdHash)");
+
     test_dictionary<BTree<int, std::string>, int, std::string>("BTree");
 
+    test_dictionary<BPlusTree<int, std::string>, int, std::string>("BPlusTree");
+
+    test_dictionary<FlatHashTable<int, std::string>, int, std::string>("FlatHashTable");
+
+    test_dictionary<SwissTable<int, std::string>, int, std::string>("SwissTable");
+
+    test_dictionary<ConcurrentHashTable<int, std::string>, int, std::string>("ConcurrentHashTable");
+
+    test_dictionary<LockFreeHashTable<int, std::string>, int, std::string>("LockFreeHashTable");
+
+    test_dictionary<LockedDictionary<int, std::string>, int, std::string>("LockedDictionary");
+
+    test_dictionary<HashTable<int, std::string, DefaultHash<int>, CountingHashTableStats>, int, std::string>(
+            "HashTable(Telemetry)");
+
+    test_dictionary<CuckooHashTable<int, std::string>, int, std::string>("CuckooHashTable");
+
+    test_dictionary<FilteredDictionary<int, std::string>, int, std::string>("FilteredDictionary");
+
+    test_dictionary<RoaringDictionary<std::string>, int, std::string>("RoaringDictionary");
+
+    test_hash_table_capacity();
+
+    test_hash_table_telemetry();
+
+    test_key_search();
+
+    test_btree_bulk_load();
+
+    test_btree_remove();
+
+    test_btree_snapshot();
+
+    test_node_allocator();
+
+    test_tree_range<BTree<int, int>>("BTree");
+    test_tree_range<BPlusTree<int, int>>("BPlusTree");
+
+    test_concurrent_btree();
+
+    test_concurrent_removal<ConcurrentHashTable<int, double>>("ConcurrentHashTable");
+    test_concurrent_removal<LockFreeHashTable<int, double>>("LockFreeHashTable");
+
+    test_frozen_hash_table();
+
+    test_roaring_dictionary();
+
     test_sparse_vector<HashTable<int, double>>("HashTable", true);
     test_sparse_vector<BTree<int, double>>("BTree", true);
+    test_sparse_vector<BPlusTree<int, double>>("BPlusTree", true);
+    test_sparse_vector<FlatHashTable<int, double>>("FlatHashTable", true);
+    test_sparse_vector<SwissTable<int, double>>("SwissTable", true);
+    test_sparse_vector<ConcurrentHashTable<int, double>>("ConcurrentHashTable", true);
+    test_sparse_vector<ConcurrentBTree<int, double>>("ConcurrentBTree", true);
+    test_sparse_vector<LockFreeHashTable<int, double>>("LockFreeHashTable", true);
+    test_sparse_vector<CuckooHashTable<int, double>>("CuckooHashTable", true);
+    test_sparse_vector<FilteredDictionary<int, double>>("FilteredDictionary(HashTable)", true);
+    test_sparse_vector<FilteredDictionary<int, double, BTree<int, double>>>("FilteredDictionary(BTree)", true);
+    test_sparse_vector<RoaringDictionary<double>>("RoaringDictionary", true);
 
     test_sparse_matrix<HashTable<IndexPair, double>>("HashTable", true);
+    test_sparse_matrix<HashTable<IndexPair, double, StdHash<IndexPair>>>("HashTable(StdHash)", true);
     test_sparse_matrix<BTree<IndexPair, double>>("BTree", true);
+    test_sparse_matrix<BPlusTree<IndexPair, double>>("BPlusTree", true);
+    test_sparse_matrix<FlatHashTable<IndexPair, double>>("FlatHashTable", true);
+    test_sparse_matrix<SwissTable<IndexPair, double>>("SwissTable", true);
+    test_sparse_matrix<ConcurrentHashTable<IndexPair, double>>("ConcurrentHashTable", true);
+    test_sparse_matrix<ConcurrentBTree<IndexPair, double>>("ConcurrentBTree", true);
+    test_sparse_matrix<LockFreeHashTable<IndexPair, double>>("LockFreeHashTable", true);
+    test_sparse_matrix<CuckooHashTable<IndexPair, double>>("CuckooHashTable", true);
+    test_sparse_matrix<FilteredDictionary<IndexPair, double>>("FilteredDictionary(HashTable)", true);
 
     std::cout << "All functional tests completed successfully." << std::endl;
 }
@@ -70,6 +263,34 @@ void test_dictionary(const std::string& dictionary_name) {
         std::cerr << "Exception during Update verification: " << e.what() << std::endl;
     }
 
+    std::optional<ValueType> found = dictionary.TryGet(1);
+    std::optional<ValueType> missing = dictionary.TryGet(42);
+    if (!found || *found != "One" || missing) {
+        std::cerr << "Error in TryGet: unexpected result for keys 1 and 42." << std::endl;
+    } else if (dictionary.GetOrDefault(42, "None") != "None" || dictionary.GetOrDefault(1, "None") != "One") {
+        std::cerr << "Error in GetOrDefault: unexpected result for keys 1 and 42." << std::endl;
+    } else {
+        std::cout << "TryGet and GetOrDefault succeeded." << std::endl;
+    }
+
+    bool inserted = dictionary.Upsert(4, "Four");
+    bool overwritten = !dictionary.Upsert(4, "Fourth");
+    if (!inserted || !overwritten || dictionary.Get(4) != "Fourth" || dictionary.GetCount() != 4) {
+        std::cerr << "Error in Upsert: expected insert then overwrite of key 4." << std::endl;
+    } else {
+        std::cout << "Upsert succeeded, value of Get(4): " << dictionary.Get(4) << std::endl;
+    }
+    dictionary.Remove(4);
+
+    bool removed = dictionary.TryRemove(1);
+    bool removed_again = dictionary.TryRemove(1);
+    if (!removed || removed_again || dictionary.ContainsKey(1) || dictionary.GetCount() != 2) {
+        std::cerr << "Error in TryRemove: expected key 1 to be removed exactly once." << std::endl;
+    } else {
+        std::cout << "TryRemove succeeded, a second TryRemove(1) reported the key missing." << std::endl;
+    }
+    dictionary.Add(1, "One");
+
     dictionary.Remove(3);
     if (dictionary.ContainsKey(3)) {
         std::cerr << "Error: Key 3 should have been removed." << std::endl;
@@ -85,146 +306,935 @@ void test_dictionary(const std::string& dictionary_name) {
     }
 }
 
-template <typename DictionaryType>
-void test_sparse_vector(const std::string& dictionary_name, bool extended) {
-    std::cout << "Testing SparseVector with " << dictionary_name << "..." << std::endl;
-    UnqPtr<IDictionary<int, double>> dictionary(new DictionaryType());
-    SparseVector<double> vector(10, std::move(dictionary));
+void test_hash_table_capacity() {
+    std::cout << "Testing HashTable capacity control..." << std::endl;
+    HashTable<int, int> table;
 
-    vector.SetElement(0, 1.0);
-    vector.SetElement(2, 3.5);
-    vector.SetElement(4, -2.2);
+    table.Reserve(1000);
+    size_t reserved = table.GetCapacity();
+    for (int i = 0; i < 1000; ++i) {
+        table.Add(i, i);
+    }
+    if (reserved < 1000 / table.GetMaxLoadFactor() || table.GetCapacity() != reserved) {
+        std::cerr << "Error in Reserve: table grew after reserving 1000 entries." << std::endl;
+    } else {
+        std::cout << "Reserve succeeded, capacity: " << reserved << std::endl;
+    }
+
+    size_t full_memory = table.GetMemoryUsage();
+    for (int i = 10; i < 1000; ++i) {
+        table.Remove(i);
+    }
+    table.ShrinkToFit();
+    bool intact = table.GetCount() == 10;
+    for (int i = 0; i < 10; ++i) {
+        intact = intact && table.Get(i) == i;
+    }
+    if (!intact || table.GetCapacity() > 16 || table.GetMemoryUsage() >= full_memory) {
+        std::cerr << "Error in ShrinkToFit: expected 10 entries in at most 16 buckets." << std::endl;
+    } else {
+        std::cout << "ShrinkToFit succeeded, capacity: " << table.GetCapacity()
+                  << ", memory: " << full_memory << " -> " << table.GetMemoryUsage() << " bytes" << std::endl;
+    }
+
+    table.SetMaxLoadFactor(0.25);
+    if (table.GetCapacity() < 40) {
+        std::cerr << "Error in SetMaxLoadFactor: table did not grow to the lower load factor." << std::endl;
+    } else {
+        std::cout << "SetMaxLoadFactor succeeded, capacity: " << table.GetCapacity() << std::endl;
+    }
 
     try {
-        double value = vector.GetElement(2);
-        if (value != 3.5) {
-            std::cerr << "Error: expected 3.5, got " << value << std::endl;
-        } else {
-            std::cout << "GetElement(2) succeeded, value: " << value << std::endl;
+        table.SetMaxLoadFactor(0);
+        std::cerr << "Error: SetMaxLoadFactor(0) should have thrown." << std::endl;
+    } catch (const std::invalid_argument&) {
+        std::cout << "SetMaxLoadFactor(0) rejected as expected." << std::endl;
+    }
+}
+
+void test_hash_table_telemetry() {
+    std::cout << "Testing HashTable telemetry..." << std::endl;
+    HashTable<int, int, DefaultHash<int>, CountingHashTableStats> table;
+    for (int i = 0; i < 100; ++i) {
+        table.Add(i, i);
+    }
+    // Inserts, overwrites and updates are writes, not lookups.
+    table.Upsert(0, 1);
+    table.Update(1, 2);
+    const CountingHashTableStats &telemetry = table.GetTelemetry();
+    if (telemetry.GetRehashCount() == 0 || telemetry.GetMissCount() != 0 || telemetry.GetHitCount() != 0) {
+        std::cerr << "Error in telemetry: expected no lookups and at least one rehash while inserting."
+                  << std::endl;
+    } else {
+        std::cout << "Insertion counted " << telemetry.GetRehashCount() << " rehashes in "
+                  << telemetry.GetRehashNanoseconds() << " ns." << std::endl;
+    }
+
+    table.ResetTelemetry();
+    for (int i = 0; i < 100; ++i) {
+        table.Get(i);
+    }
+    for (int i = 100; i < 150; ++i) {
+        table.ContainsKey(i);
+    }
+    size_t histogram_total = 0;
+    for (size_t length = 0; length < CountingHashTableStats::HistogramSize; ++length) {
+        histogram_total += telemetry.GetProbeHistogram(length);
+    }
+    if (telemetry.GetHitCount() != 100 || telemetry.GetMissCount() != 50 || telemetry.GetRehashCount() != 0 ||
+        histogram_total != 150 || telemetry.GetAverageHitProbes() < 1.0) {
+        std::cerr << "Error in telemetry: expected 100 hits and 50 misses after ResetTelemetry." << std::endl;
+    } else {
+        std::cout << "Lookups counted, average probes per hit: " << telemetry.GetAverageHitProbes()
+                  << ", per miss: " << telemetry.GetAverageMissProbes() << std::endl;
+    }
+
+    CollisionStats stats = table.GetCollisionStats();
+    size_t bucket_total = 0;
+    for (size_t length = 0; length < CollisionStats::HistogramSize; ++length) {
+        bucket_total += stats.chainLengthHistogram[length];
+    }
+    if (bucket_total != stats.bucketCount || stats.loadFactor != 100.0 / stats.bucketCount) {
+        std::cerr << "Error in GetCollisionStats: chain histogram does not cover every bucket." << std::endl;
+    } else {
+        std::cout << "Chain histogram covers " << bucket_total << " buckets, load factor " << stats.loadFactor
+                  << std::endl;
+    }
+}
+
+void test_key_search() {
+    std::cout << "Testing KeySearch..." << std::endl;
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<> dis(-100, 100);
+    bool correct = true;
+    // Every length up to two AVX2 blocks plus a tail, with keys inside and outside the range.
+    for (int count = 0; count <= 20 && correct; ++count) {
+        std::vector<int> keys(count);
+        std::vector<IndexPair> pairs(count);
+        for (int i = 0; i < count; ++i) {
+            keys[i] = dis(gen);
+            pairs[i] = IndexPair(dis(gen) % 3, dis(gen));
+        }
+        std::sort(keys.begin(), keys.end());
+        std::sort(pairs.begin(), pairs.end());
+        for (int probe = -110; probe <= 110; ++probe) {
+            int expected = static_cast<int>(std::lower_bound(keys.begin(), keys.end(), probe) - keys.begin());
+            IndexPair pair(probe % 3, probe);
+            int expected_pair = static_cast<int>(std::lower_bound(pairs.begin(), pairs.end(), pair) - pairs.begin());
+            correct = correct && KeySearch<int>::Rank(keys.data(), count, probe) == expected &&
+                      BranchlessRank(keys.data(), count, probe) == expected &&
+                      KeySearch<IndexPair>::Rank(pairs.data(), count, pair) == expected_pair;
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Exception during element retrieval: " << e.what() << std::endl;
     }
+    if (!correct) {
+        std::cerr << "Error in KeySearch: rank differs from std::lower_bound." << std::endl;
+    } else {
+        std::cout << "Rank matches std::lower_bound for int and IndexPair keys." << std::endl;
+    }
+}
 
-    vector.Map([](double x) { return x * 2; });
+void test_btree_bulk_load() {
+    std::cout << "Testing BTree::BuildFromSorted..." << std::endl;
+    bool correct = true;
+    // Sizes around the leaf and internal node capacities, at the smallest and the default
+    // order and at several fill factors.
+    for (int order : {2, 3, 32}) {
+        for (double fill_factor : {0.1, 0.5, 0.7, 1.0}) {
+            for (int count : {0, 1, 2, 3, 5, 63, 64, 65, 1000, 4097}) {
+                std::vector<int> keys(count);
+                std::vector<int> values(count);
+                for (int i = 0; i < count; ++i) {
+                    keys[i] = i * 2;
+                    values[i] = -i;
+                }
+                BTree<int, int> tree(order);
+                tree.Add(-1, 0);
+                tree.BuildFromSorted(keys.begin(), keys.end(), values.begin(), fill_factor);
+                correct = correct && tree.GetCount() == static_cast<size_t>(count) && !tree.ContainsKey(-1);
+                UnqPtr<IDictionaryIterator<int, int>> iterator = tree.GetIterator();
+                int visited = 0;
+                while (iterator->MoveNext()) {
+                    correct = correct && iterator->GetCurrentKey() == visited * 2 &&
+                              iterator->GetCurrentValue() == -visited;
+                    ++visited;
+                }
+                correct = correct && visited == count;
+                // Inserts between the loaded keys exercise splits of the packed nodes.
+                for (int i = 0; i < count; ++i) {
+                    tree.Add(i * 2 + 1, i);
+                }
+                for (int i = 0; i < count; ++i) {
+                    correct = correct && tree.Get(i * 2) == -i && tree.Get(i * 2 + 1) == i;
+                }
+                correct = correct && tree.GetCount() == static_cast<size_t>(2 * count);
+            }
+        }
+    }
+    if (!correct) {
+        std::cerr << "Error in BTree::BuildFromSorted: the loaded tree differs from the input." << std::endl;
+    } else {
+        std::cout << "Bulk-loaded trees match their input and accept further inserts." << std::endl;
+    }
 
+    int unsorted_keys[] = {1, 3, 2};
+    int unsorted_values[] = {1, 2, 3};
+    BTree<int, int> tree;
+    tree.Add(5, 5);
     try {
-        double value = vector.GetElement(2);
-        if (value != 7.0) {
-            std::cerr << "Error in Map: expected 7.0, got " << value << std::endl;
+        tree.BuildFromSorted(unsorted_keys, unsorted_keys + 3, unsorted_values);
+        std::cerr << "Error in BTree::BuildFromSorted: unsorted keys were accepted." << std::endl;
+    } catch (const std::invalid_argument&) {
+        if (tree.GetCount() != 1 || tree.Get(5) != 5) {
+            std::cerr << "Error in BTree::BuildFromSorted: rejected input changed the tree." << std::endl;
         } else {
-            std::cout << "Map succeeded, new value of GetElement(2): " << value << std::endl;
+            std::cout << "Unsorted keys were rejected and the tree kept its contents." << std::endl;
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Exception during Map verification: " << e.what() << std::endl;
     }
 
-    double sum = vector.Reduce([](double acc, double x) { return acc + x; }, 0.0);
-    double expected_sum = 2.0 + 0.0 + 7.0 + 0.0 + (-4.4);
-    if (sum != expected_sum) {
-        std::cerr << "Error in Reduce: expected " << expected_sum << ", got " << sum << std::endl;
+    int indices[] = {0, 3, 4, 9};
+    double vector_values[] = {1.5, 0.0, -2.0, 4.0};
+    SparseVector<double> vector(10, UnqPtr<IDictionary<int, double>>(new BTree<int, double>()), indices,
+                                vector_values, 4);
+    IndexPair positions[] = {IndexPair(0, 1), IndexPair(0, 4), IndexPair(2, 0), IndexPair(3, 3)};
+    double matrix_values[] = {1.0, 2.0, 0.0, 3.0};
+    SparseMatrix<double> matrix(4, 5, UnqPtr<IDictionary<IndexPair, double>>(new BTree<IndexPair, double>()),
+                                positions, matrix_values, 4);
+    if (vector.GetElements().GetCount() != 3 || vector.GetElement(0) != 1.5 || vector.GetElement(3) != 0.0 ||
+        vector.GetElement(9) != 4.0 || matrix.GetElements().GetCount() != 3 || matrix.GetElement(0, 4) != 2.0 ||
+        matrix.GetElement(2, 0) != 0.0 || matrix.GetElement(3, 3) != 3.0) {
+        std::cerr << "Error in SparseVector/SparseMatrix: construction from sorted input lost elements." << std::endl;
     } else {
-        std::cout << "Reduce succeeded, sum: " << sum << std::endl;
+        std::cout << "SparseVector and SparseMatrix were built from sorted input." << std::endl;
     }
+}
 
-    if (extended) {
-        std::cout << "Extended Testing SparseVector with " << dictionary_name << "..." << std::endl;
-
-        vector.SetElement(3, 3.3);
-        vector.SetElement(5, 5.5);
-        vector.SetElement(7, 7.7);
-        vector.SetElement(9, 9.9);
-
-        for (int i = 0; i < vector.GetLength(); ++i) {
-            double value = vector.GetElement(i);
-            std::cout << "Element at index " << i << ": " << value << std::endl;
+void test_btree_remove() {
+    std::cout << "Testing BTree removal..." << std::endl;
+    std::mt19937 gen(11);
+    bool correct = true;
+    // Small orders make nearly every removal borrow, merge or replace an internal key.
+    for (int order : {2, 3, 32}) {
+        BTree<int, int> tree(order);
+        std::map<int, int> expected;
+        std::uniform_int_distribution<> dis(0, 2000);
+        for (int step = 0; step < 20000 && correct; ++step) {
+            int key = dis(gen);
+            if (step % 3 == 0) {
+                correct = tree.TryRemove(key) == (expected.erase(key) == 1);
+            } else {
+                tree.Add(key, step);
+                expected[key] = step;
+            }
         }
+        UnqPtr<IDictionaryIterator<int, int>> iterator = tree.GetIterator();
+        auto next = expected.begin();
+        while (correct && iterator->MoveNext()) {
+            correct = next != expected.end() && iterator->GetCurrentKey() == next->first &&
+                      iterator->GetCurrentValue() == next->second;
+            ++next;
+        }
+        correct = correct && next == expected.end() && tree.GetCount() == expected.size();
+    }
+    if (!correct) {
+        std::cerr << "Error in BTree removal: contents differ from std::map." << std::endl;
+    } else {
+        std::cout << "Random inserts and removals kept every key with its own element." << std::endl;
+    }
+}
 
-        vector.Map([](double x) { return x * -1; });
+void test_btree_snapshot() {
+    std::cout << "Testing BTree snapshots..." << std::endl;
+    std::mt19937 gen(13);
+    bool correct = true;
+    for (int order : {2, 3, 32}) {
+        BTree<int, int> tree(order);
+        std::map<int, int> expected;
+        std::uniform_int_distribution<> dis(0, 2000);
+        for (int i = 0; i < 3000; ++i) {
+            int key = dis(gen);
+            tree.Add(key, i);
+            expected[key] = i;
+        }
 
-        try {
-            double value = vector.GetElement(5);
-            if (value != -5.5) {
-                std::cerr << "Error in Map: expected -5.5, got " << value << std::endl;
+        // Every write after the snapshot must leave it as it was, and the tree must still
+        // see its own writes.
+        UnqPtr<const BTree<int, int>> snapshot = tree.Snapshot();
+        std::map<int, int> frozen = expected;
+        for (int step = 0; step < 20000 && correct; ++step) {
+            int key = dis(gen);
+            if (step % 3 == 0) {
+                correct = tree.TryRemove(key) == (expected.erase(key) == 1);
+            } else if (step % 3 == 1 && expected.count(key)) {
+                tree.Update(key, -step);
+                expected[key] = -step;
             } else {
-                std::cout << "Map succeeded, new value of GetElement(5): " << value << std::endl;
+                tree.Add(key, step);
+                expected[key] = step;
             }
-        } catch (const std::exception& e) {
-            std::cerr << "Exception during Map verification: " << e.what() << std::endl;
         }
 
-        double sum_extended = vector.Reduce([](double acc, double x) { return acc + x; }, 0.0);
-        std::cout << "Reduce result (sum): " << sum_extended << std::endl;
-
-        std::cout << "SparseVector elements after Map:" << std::endl;
-        vector.ForEach([](int index, const double& value) {
-            std::cout << "Index: " << index << ", Value: " << value << std::endl;
-        });
+        for (const std::map<int, int>* contents : {&frozen, &expected}) {
+            const BTree<int, int>& version = contents == &frozen ? *snapshot : tree;
+            UnqPtr<IDictionaryIterator<int, int>> iterator = version.GetIterator();
+            auto next = contents->begin();
+            while (correct && iterator->MoveNext()) {
+                correct = next != contents->end() && iterator->GetCurrentKey() == next->first &&
+                          iterator->GetCurrentValue() == next->second;
+                ++next;
+            }
+            correct = correct && next == contents->end() && version.GetCount() == contents->size();
+        }
+    }
 
-        vector.RemoveElement(5);
-        if (vector.GetElement(5) != 0.0) {
-            std::cerr << "Error: Element at index 5 should have been removed." << std::endl;
+    // A reader walks a snapshot while the writer keeps changing the tree.
+    BTree<int, int> tree;
+    for (int i = 0; i < 20000; ++i) {
+        tree.Add(i, i);
+    }
+    UnqPtr<const BTree<int, int>> snapshot = tree.Snapshot();
+    std::atomic<bool> reader_correct(true);
+    std::thread reader([&]() {
+        for (int pass = 0; pass < 5; ++pass) {
+            long long sum = 0;
+            UnqPtr<IDictionaryIterator<int, int>> iterator = snapshot->GetIterator();
+            while (iterator->MoveNext()) {
+                sum += iterator->GetCurrentValue();
+            }
+            if (sum != 19999LL * 20000 / 2) {
+                reader_correct = false;
+            }
+        }
+    });
+    for (int i = 0; i < 20000; ++i) {
+        if (i % 2 == 0) {
+            tree.Remove(i);
         } else {
-            std::cout << "RemoveElement succeeded, element at index 5 is now zero." << std::endl;
+            tree.Update(i, -i);
         }
+        tree.Add(20000 + i, i);
+    }
+    reader.join();
+    correct = correct && reader_correct && snapshot->GetCount() == 20000 && tree.GetCount() == 30000;
+
+    if (!correct) {
+        std::cerr << "Error in BTree snapshots: a snapshot or the tree changed unexpectedly." << std::endl;
+    } else {
+        std::cout << "Snapshots kept their contents while the tree was written." << std::endl;
     }
 }
 
-template <typename DictionaryType>
-void test_sparse_matrix(const std::string& dictionary_name, bool extended) {
-    std::cout << "Testing SparseMatrix with " << dictionary_name << "..." << std::endl;
-    UnqPtr<IDictionary<IndexPair, double>> dictionary(new DictionaryType());
-    SparseMatrix<double> matrix(4, 4, std::move(dictionary));
+// An arena policy that counts the nodes freed one by one, to tell a bulk release from a walk.
+struct CountingArenaAllocator {
+    ArenaNodeAllocator arena;
+    size_t* deallocations;
 
-    matrix.SetElement(0, 0, 1.0);
-    matrix.SetElement(1, 1, 2.0);
-    matrix.SetElement(2, 2, 3.0);
+    void* Allocate(size_t size, size_t alignment) {
+        return arena.Allocate(size, alignment);
+    }
 
-    matrix.Map([](double x) { return x + 1; });
+    void Deallocate(void* block, size_t size, size_t alignment) {
+        ++*deallocations;
+        arena.Deallocate(block, size, alignment);
+    }
 
-    try {
-        double value = matrix.GetElement(1, 1);
-        if (value != 3.0) {
-            std::cerr << "Error in Map: expected 3.0, got " << value << std::endl;
-        } else {
-            std::cout << "Map succeeded, new value of GetElement(1,1): " << value << std::endl;
+    bool TryReleaseAll() {
+        return arena.TryReleaseAll();
+    }
+};
+
+void test_node_allocator() {
+    std::cout << "Testing arena node allocation..." << std::endl;
+    std::mt19937 gen(17);
+    std::uniform_int_distribution<> dis(0, 2000);
+    bool correct = true;
+    // Small chunks make the arena start new ones often; strings exercise Clear's slow path.
+    BTree<int, std::string, ArenaNodeAllocator> tree(3, ArenaNodeAllocator(1024));
+    BTree<int, int, ArenaNodeAllocator> numbers(3, ArenaNodeAllocator(1024));
+    std::map<int, std::string> expected;
+    for (int round = 0; round < 3 && correct; ++round) {
+        UnqPtr<const BTree<int, std::string, ArenaNodeAllocator>> snapshot;
+        for (int step = 0; step < 20000 && correct; ++step) {
+            int key = dis(gen);
+            if (step % 3 == 0) {
+                bool present = expected.erase(key) == 1;
+                correct = tree.TryRemove(key) == present && numbers.TryRemove(key) == present;
+            } else {
+                tree.Add(key, std::to_string(step));
+                numbers.Add(key, step);
+                expected[key] = std::to_string(step);
+            }
+            // Nodes released by the snapshot go back to the arena through a shared handle.
+            if (step == 10000) {
+                snapshot = tree.Snapshot();
+            }
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Exception during Map verification: " << e.what() << std::endl;
+        snapshot = UnqPtr<const BTree<int, std::string, ArenaNodeAllocator>>();
+
+        UnqPtr<IDictionaryIterator<int, std::string>> iterator = tree.GetIterator();
+        auto next = expected.begin();
+        while (correct && iterator->MoveNext()) {
+            correct = next != expected.end() && iterator->GetCurrentKey() == next->first &&
+                      iterator->GetCurrentValue() == next->second &&
+                      numbers.Get(next->first) == std::stoi(next->second);
+            ++next;
+        }
+        correct = correct && next == expected.end() && tree.GetCount() == expected.size() &&
+                  numbers.GetCount() == expected.size();
+
+        tree.Clear();
+        numbers.Clear();
+        expected.clear();
+        correct = correct && tree.GetCount() == 0 && !numbers.ContainsKey(1);
     }
 
-    double sum = matrix.Reduce([](double acc, double x) { return acc + x; }, 0.0);
-    if (sum != 9.0) {
-        std::cerr << "Error in Reduce: expected 9.0, got " << sum << std::endl;
+    LinkedListSmart<int, ArenaNodeAllocator> list;
+    for (int i = 0; i < 100000; ++i) {
+        list.Prepend(i);
+    }
+    list.RemoveAt(0);
+    long long sum = 0;
+    for (auto iterator = list.begin(); iterator != list.end(); ++iterator) {
+        sum += *iterator;
+    }
+    correct = correct && sum == 99998LL * 99999 / 2 && list.GetLength() == 99999;
+    list.Clear();
+    list.Append(5);
+    correct = correct && list.GetLength() == 1 && list.GetFirst() == 5;
+
+    // Clearing a list of ints drops its chunks without a free per node; strings still need
+    // their destructors, so that list is walked.
+    size_t number_frees = 0;
+    size_t string_frees = 0;
+    LinkedListSmart<int, CountingArenaAllocator> numbers_list(
+            CountingArenaAllocator{ArenaNodeAllocator(), &number_frees});
+    LinkedListSmart<std::string, CountingArenaAllocator> strings_list(
+            CountingArenaAllocator{ArenaNodeAllocator(), &string_frees});
+    for (int i = 0; i < 10000; ++i) {
+        numbers_list.Prepend(i);
+        strings_list.Prepend(std::to_string(i));
+    }
+    numbers_list.Clear();
+    strings_list.Clear();
+    numbers_list.Append(7);
+    correct = correct && number_frees == 0 && string_frees == 10000 && numbers_list.GetLength() == 1 &&
+              numbers_list.GetFirst() == 7 && strings_list.GetLength() == 0;
+
+    if (!correct) {
+        std::cerr << "Error in arena node allocation: contents differ from std::map." << std::endl;
     } else {
-        std::cout << "Reduce succeeded, sum: " << sum << std::endl;
+        std::cout << "Arena-backed BTree and LinkedListSmart match the heap-backed behaviour." << std::endl;
     }
+}
 
-    if (extended) {
-        std::cout << "Extended Testing SparseMatrix with " << dictionary_name << "..." << std::endl;
-
-        matrix.SetElement(3, 3, 4.0);
-        matrix.SetElement(0, 3, 5.0);
-        matrix.SetElement(3, 0, 6.0);
+template <typename TDictionary>
+void test_tree_range(const std::string& dictionary_name) {
+    std::cout << "Testing range queries on " << dictionary_name << "..." << std::endl;
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<> dis(0, 3000);
+    TDictionary tree;
+    std::map<int, int> expected;
+    for (int i = 0; i < 2000; ++i) {
+        int key = dis(gen);
+        tree.Add(key, i);
+        expected[key] = i;
+    }
 
-        for (int i = 0; i < matrix.GetRows(); ++i) {
-            for (int j = 0; j < matrix.GetColumns(); ++j) {
-                double value = matrix.GetElement(i, j);
-                std::cout << "Element at (" << i << ", " << j << "): " << value << std::endl;
+    bool correct = true;
+    for (int probe = 0; probe < 300 && correct; ++probe) {
+        int lower = dis(gen) - 10;
+        int upper = lower + dis(gen) % 200;
+        auto first = expected.lower_bound(lower);
+        std::optional<int> bound = tree.LowerBound(lower);
+        correct = first == expected.end() ? !bound : bound && *bound == first->first;
+
+        UnqPtr<IDictionaryIterator<int, int>> range = tree.GetRange(lower, upper);
+        auto next = first;
+        for (int pass = 0; pass < 2 && correct; ++pass) {
+            next = first;
+            while (correct && range->MoveNext()) {
+                correct = next != expected.end() && next->first < upper && range->GetCurrentKey() == next->first &&
+                          range->GetCurrentValue() == next->second;
+                ++next;
             }
+            correct = correct && (next == expected.end() || next->first >= upper);
+            range->Reset();
         }
 
-        matrix.Map([](double x) { return x + 10; });
+        UnqPtr<IDictionaryIterator<int, int>> seek = tree.SeekIterator(lower);
+        next = first;
+        while (correct && seek->MoveNext()) {
+            correct = next != expected.end() && seek->GetCurrentKey() == next->first;
+            ++next;
+        }
+        correct = correct && next == expected.end();
+    }
+    if (!correct) {
+        std::cerr << "Error in " << dictionary_name << " range queries: results differ from std::map." << std::endl;
+    } else {
+        std::cout << "LowerBound, GetRange and SeekIterator match std::map." << std::endl;
+    }
+}
 
-        try {
-            double value = matrix.GetElement(2, 2);
-            if (value != 14.0) {
-                std::cerr << "Error in Map: expected 14.0, got " << value << std::endl;
+void test_concurrent_btree() {
+    std::cout << "Testing ConcurrentBTree..." << std::endl;
+    {
+        ConcurrentBTree<int, int> tree;
+        std::map<int, int> expected;
+        std::mt19937 gen(3);
+        std::uniform_int_distribution<> dis(0, 5000);
+        bool correct = true;
+        for (int step = 0; step < 30000 && correct; ++step) {
+            int key = dis(gen);
+            if (step % 4 == 0) {
+                correct = tree.TryRemove(key) == (expected.erase(key) == 1);
             } else {
-                std::cout << "Map succeeded, new value of GetElement(2,2): " << value << std::endl;
+                tree.Add(key, step);
+                expected[key] = step;
             }
-        } catch (const std::exception& e) {
-            std::cerr << "Exception during Map verification: " << e.what() << std::endl;
+        }
+        UnqPtr<IDictionaryIterator<int, int>> iterator = tree.GetIterator();
+        auto next = expected.begin();
+        while (correct && iterator->MoveNext()) {
+            correct = next != expected.end() && iterator->GetCurrentKey() == next->first &&
+                      iterator->GetCurrentValue() == next->second;
+            ++next;
+        }
+        correct = correct && next == expected.end() && tree.GetCount() == expected.size();
+        if (!correct) {
+            std::cerr << "Error in ConcurrentBTree: single-threaded contents differ from std::map." << std::endl;
+        } else {
+            std::cout << "Single-threaded inserts and removals match std::map." << std::endl;
+        }
+    }
+
+    // Writers insert disjoint keys with element 2 * key while readers look up random keys;
+    // a reader that finds a key must see its own element.
+    ConcurrentBTree<int, int> tree;
+    const int num_writers = 4;
+    const int num_readers = 4;
+    const int keys_per_writer = 20000;
+    std::atomic<int> writers_done(0);
+    std::atomic<long long> wrong_reads(0);
+    std::vector<std::thread> threads;
+    for (int w = 0; w < num_writers; ++w) {
+        threads.emplace_back([&, w]() {
+            for (int i = 0; i < keys_per_writer; ++i) {
+                int key = i * num_writers + w;
+                tree.Add(key, 2 * key);
+            }
+            writers_done.fetch_add(1);
+        });
+    }
+    for (int r = 0; r < num_readers; ++r) {
+        threads.emplace_back([&, r]() {
+            std::mt19937 gen(static_cast<unsigned>(r + 1));
+            std::uniform_int_distribution<> dis(0, num_writers * keys_per_writer - 1);
+            while (writers_done.load() < num_writers) {
+                int key = dis(gen);
+                std::optional<int> value = tree.TryGet(key);
+                if (value && *value != 2 * key) {
+                    wrong_reads.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool complete = tree.GetCount() == static_cast<size_t>(num_writers * keys_per_writer);
+    for (int key = 0; key < num_writers * keys_per_writer && complete; ++key) {
+        complete = tree.GetOrDefault(key, -1) == 2 * key;
+    }
+    UnqPtr<IDictionaryIterator<int, int>> iterator = tree.GetIterator();
+    int visited = 0;
+    while (complete && iterator->MoveNext()) {
+        complete = iterator->GetCurrentKey() == visited;
+        ++visited;
+    }
+    complete = complete && visited == num_writers * keys_per_writer;
+    if (wrong_reads.load() != 0 || !complete) {
+        std::cerr << "Error in ConcurrentBTree: " << wrong_reads.load()
+                  << " wrong concurrent reads, complete: " << complete << std::endl;
+    } else {
+        std::cout << "Concurrent writers and readers left every key with its own element." << std::endl;
+    }
+
+    // Removers empty the tree, retiring its leaves, while readers iterate it; every pass
+    // must come out in ascending order with each key's own element.
+    ConcurrentBTree<int, int> shrinking;
+    const int num_removers = 4;
+    const int num_iterators = 4;
+    const int num_keys = 80000;
+    for (int key = 0; key < num_keys; ++key) {
+        shrinking.Add(key, 2 * key);
+    }
+    std::atomic<int> removers_done(0);
+    std::atomic<long long> wrong_passes(0);
+    std::vector<std::thread> shrinking_threads;
+    for (int w = 0; w < num_removers; ++w) {
+        shrinking_threads.emplace_back([&, w]() {
+            for (int key = w; key < num_keys; key += num_removers) {
+                if (!shrinking.TryRemove(key)) {
+                    wrong_passes.fetch_add(1);
+                }
+            }
+            removers_done.fetch_add(1);
+        });
+    }
+    for (int r = 0; r < num_iterators; ++r) {
+        shrinking_threads.emplace_back([&, r]() {
+            while (removers_done.load() < num_removers) {
+                UnqPtr<IDictionaryIterator<int, int>> iterator =
+                        r % 2 == 0 ? shrinking.GetIterator() : shrinking.GetRange(num_keys / 4, num_keys / 2);
+                int previous = -1;
+                bool ordered = true;
+                while (ordered && iterator->MoveNext()) {
+                    int key = iterator->GetCurrentKey();
+                    ordered = key > previous && iterator->GetCurrentValue() == 2 * key;
+                    previous = key;
+                }
+                if (!ordered) {
+                    wrong_passes.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& thread : shrinking_threads) {
+        thread.join();
+    }
+
+    bool emptied = shrinking.GetCount() == 0 && !shrinking.GetIterator()->MoveNext();
+    for (int key = 0; key < num_keys && emptied; key += 7) {
+        shrinking.Add(key, key);
+    }
+    UnqPtr<IDictionaryIterator<int, int>> refilled = shrinking.GetIterator();
+    for (int key = 0; key < num_keys && emptied; key += 7) {
+        emptied = refilled->MoveNext() && refilled->GetCurrentKey() == key && refilled->GetCurrentValue() == key;
+    }
+    emptied = emptied && !refilled->MoveNext();
+    if (wrong_passes.load() != 0 || !emptied) {
+        std::cerr << "Error in ConcurrentBTree: " << wrong_passes.load()
+                  << " wrong passes while removing, emptied and refilled: " << emptied << std::endl;
+    } else {
+        std::cout << "Removals under concurrent iteration kept every pass ordered and consistent." << std::endl;
+    }
+}
+
+// Threads set and zero the same elements of a SparseVector at once, so removals race for
+// the same keys; zeroing an element another thread already zeroed must not throw.
+template<typename TDictionary>
+void test_concurrent_removal(const std::string& dictionary_name) {
+    std::cout << "Testing concurrent removal with " << dictionary_name << "..." << std::endl;
+    const int num_threads = 4;
+    const int length = 1000;
+    SparseVector<double> vector(length, UnqPtr<IDictionary<int, double>>(new TDictionary()));
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&]() {
+            for (int round = 0; round < 50; ++round) {
+                for (int i = 0; i < length; ++i) {
+                    try {
+                        vector.SetElement(i, 1.0);
+                        vector.SetElement(i, 0.0);
+                    } catch (const std::exception&) {
+                        failures.fetch_add(1);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool zeroed = true;
+    for (int i = 0; i < length && zeroed; ++i) {
+        zeroed = vector.GetElement(i) == 0.0;
+    }
+    if (failures.load() != 0 || !zeroed) {
+        std::cerr << "Error in " << dictionary_name << ": " << failures.load()
+                  << " concurrent removals threw, all zeroed: " << zeroed << std::endl;
+    } else {
+        std::cout << "Concurrent removals of the same keys never threw." << std::endl;
+    }
+}
+
+void test_roaring_dictionary() {
+    std::cout << "Testing RoaringDictionary..." << std::endl;
+    RoaringDictionary<int> dictionary;
+    // 20000 keys below 65536 share one container, which has to become a bitmap.
+    for (int i = 0; i < 20000; ++i) {
+        dictionary.Add(i * 3, i);
+    }
+    dictionary.Add(-70000, -1);
+    dictionary.Add(-5, -2);
+    dictionary.Add(1 << 30, -3);
+
+    bool found_all = dictionary.GetCount() == 20003 && dictionary.GetBitmapContainerCount() == 1 &&
+                     dictionary.Get(-70000) == -1 && dictionary.Get(-5) == -2 && dictionary.Get(1 << 30) == -3;
+    for (int i = 0; i < 20000; ++i) {
+        found_all = found_all && dictionary.Get(i * 3) == i && !dictionary.ContainsKey(i * 3 + 1);
+    }
+    if (!found_all) {
+        std::cerr << "Error in RoaringDictionary: lookups differ from the inserted keys." << std::endl;
+    } else {
+        std::cout << "Lookups succeeded, " << dictionary.GetContainerCount() << " containers, "
+                  << dictionary.GetBitmapContainerCount() << " of them bitmaps." << std::endl;
+    }
+
+    UnqPtr<IDictionaryIterator<int, int>> iterator = dictionary.GetIterator();
+    size_t visited = 0;
+    bool sorted = true;
+    int previous = std::numeric_limits<int>::min();
+    while (iterator->MoveNext()) {
+        sorted = sorted && (visited == 0 || iterator->GetCurrentKey() > previous);
+        previous = iterator->GetCurrentKey();
+        ++visited;
+    }
+    if (!sorted || visited != dictionary.GetCount()) {
+        std::cerr << "Error in RoaringDictionary: iteration is not sorted or misses keys." << std::endl;
+    } else {
+        std::cout << "Iteration visited " << visited << " keys in ascending order." << std::endl;
+    }
+
+    for (int i = 0; i < 20000; ++i) {
+        if (i % 10 != 0) {
+            dictionary.Remove(i * 3);
+        }
+    }
+    bool intact = dictionary.GetCount() == 2003 && dictionary.GetBitmapContainerCount() == 0;
+    for (int i = 0; i < 20000; ++i) {
+        intact = intact && dictionary.ContainsKey(i * 3) == (i % 10 == 0);
+        intact = intact && (i % 10 != 0 || dictionary.Get(i * 3) == i);
+    }
+    if (!intact) {
+        std::cerr << "Error in RoaringDictionary: removing keys broke the array container." << std::endl;
+    } else {
+        std::cout << "Remove succeeded, the bitmap turned back into an array." << std::endl;
+    }
+}
+
+void test_frozen_hash_table() {
+    std::cout << "Testing FrozenHashTable..." << std::endl;
+    BTree<int, std::string> source;
+    for (int i = 0; i < 1000; ++i) {
+        source.Add(i * 7, std::to_string(i));
+    }
+
+    FrozenHashTable<int, std::string> frozen(source);
+    bool found_all = frozen.GetCount() == 1000;
+    for (int i = 0; i < 1000; ++i) {
+        found_all = found_all && frozen.Get(i * 7) == std::to_string(i) && !frozen.ContainsKey(i * 7 + 1);
+    }
+    if (!found_all) {
+        std::cerr << "Error in FrozenHashTable: lookups differ from the source dictionary." << std::endl;
+    } else {
+        std::cout << "Lookups succeeded, " << frozen.GetBitsPerKey() << " bits per key." << std::endl;
+    }
+
+    frozen.Update(7, "Seven");
+    bool add_rejected = false;
+    try {
+        frozen.Add(1, "One");
+    } catch (const std::runtime_error&) {
+        add_rejected = true;
+    }
+    if (frozen.Get(7) != "Seven" || !add_rejected) {
+        std::cerr << "Error in FrozenHashTable: expected Update to work and Add of a new key to throw." << std::endl;
+    } else {
+        std::cout << "Update succeeded and Add of a new key was rejected." << std::endl;
+    }
+
+    SparseMatrix<double> matrix(100, 100, UnqPtr<IDictionary<IndexPair, double>>(new HashTable<IndexPair, double>()));
+    for (int i = 0; i < 100; ++i) {
+        matrix.SetElement(i, (i * 37) % 100, i + 1.0);
+    }
+    matrix.Freeze();
+    bool matrix_intact = matrix.GetElements().GetCount() == 100;
+    for (int i = 0; i < 100; ++i) {
+        matrix_intact = matrix_intact && matrix.GetElement(i, (i * 37) % 100) == i + 1.0 &&
+                        matrix.GetElement(i, (i * 37 + 1) % 100) == 0.0;
+    }
+    if (!matrix_intact) {
+        std::cerr << "Error in SparseMatrix::Freeze: elements changed." << std::endl;
+    } else {
+        std::cout << "SparseMatrix::Freeze succeeded." << std::endl;
+    }
+}
+
+template <typename DictionaryType>
+void test_sparse_vector(const std::string& dictionary_name, bool extended) {
+    std::cout << "Testing SparseVector with " << dictionary_name << "..." << std::endl;
+    UnqPtr<IDictionary<int, double>> dictionary(new DictionaryType());
+    SparseVector<double> vector(10, std::move(dictionary));
+
+    vector.SetElement(0, 1.0);
+    vector.SetElement(2, 3.5);
+    vector.SetElement(4, -2.2);
+
+    try {
+        double value = vector.GetElement(2);
+        if (value != 3.5) {
+            std::cerr << "Error: expected 3.5, got " << value << std::endl;
+        } else {
+            std::cout << "GetElement(2) succeeded, value: " << value << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception during element retrieval: " << e.what() << std::endl;
+    }
+
+    vector.Map([](double x) { return x * 2; });
+
+    try {
+        double value = vector.GetElement(2);
+        if (value != 7.0) {
+            std::cerr << "Error in Map: expected 7.0, got " << value << std::endl;
+        } else {
+            std::cout << "Map succeeded, new value of GetElement(2): " << value << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception during Map verification: " << e.what() << std::endl;
+    }
+
+    double sum = vector.Reduce([](double acc, double x) { return acc + x; }, 0.0);
+    double expected_sum = 2.0 + 0.0 + 7.0 + 0.0 + (-4.4);
+    if (sum != expected_sum) {
+        std::cerr << "Error in Reduce: expected " << expected_sum << ", got " << sum << std::endl;
+    } else {
+        std::cout << "Reduce succeeded, sum: " << sum << std::endl;
+    }
+
+    if (extended) {
+        std::cout << "Extended Testing SparseVector with " << dictionary_name << "..." << std::endl;
+
+        vector.SetElement(3, 3.3);
+        vector.SetElement(5, 5.5);
+        vector.SetElement(7, 7.7);
+        vector.SetElement(9, 9.9);
+
+        for (int i = 0; i < vector.GetLength(); ++i) {
+            double value = vector.GetElement(i);
+            std::cout << "Element at index " << i << ": " << value << std::endl;
+        }
+
+        vector.Map([](double x) { return x * -1; });
+
+        try {
+            double value = vector.GetElement(5);
+            if (value != -5.5) {
+                std::cerr << "Error in Map: expected -5.5, got " << value << std::endl;
+            } else {
+                std::cout << "Map succeeded, new value of GetElement(5): " << value << std::endl;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Exception during Map verification: " << e.what() << std::endl;
+        }
+
+        double sum_extended = vector.Reduce([](double acc, double x) { return acc + x; }, 0.0);
+        std::cout << "Reduce result (sum): " << sum_extended << std::endl;
+
+        std::cout << "SparseVector elements after Map:" << std::endl;
+        vector.ForEach([](int index, const double& value) {
+            std::cout << "Index: " << index << ", Value: " << value << std::endl;
+        });
+
+        vector.RemoveElement(5);
+        if (vector.GetElement(5) != 0.0) {
+            std::cerr << "Error: Element at index 5 should have been removed." << std::endl;
+        } else {
+            std::cout << "RemoveElement succeeded, element at index 5 is now zero." << std::endl;
+        }
+
+        int indices[] = {1, 6, 8, 1, 3};
+        double values[] = {1.5, 6.5, 8.5, 2.5, 0.0};
+        vector.SetElements(indices, values, 5);
+
+        double results[5];
+        vector.GetElements(indices, 5, results);
+        if (results[0] != 2.5 || results[1] != 6.5 || results[2] != 8.5 || results[4] != 0.0) {
+            std::cerr << "Error in SetElements/GetElements: unexpected batch values." << std::endl;
+        } else {
+            std::cout << "SetElements/GetElements succeeded." << std::endl;
+        }
+
+        static double range_sum;
+        static int range_outside;
+        range_sum = 0;
+        range_outside = 0;
+        vector.ForEachInRange(2, 8, [](int index, const double& value) {
+            range_sum += value;
+            range_outside += (index < 2 || index >= 8) ? 1 : 0;
+        });
+        double expected_range_sum = 0;
+        for (int i = 2; i < 8; ++i) {
+            expected_range_sum += vector.GetElement(i);
+        }
+        if (range_outside != 0 || std::abs(range_sum - expected_range_sum) > 1e-9) {
+            std::cerr << "Error in ForEachInRange: expected sum " << expected_range_sum << ", got " << range_sum
+                      << std::endl;
+        } else {
+            std::cout << "ForEachInRange succeeded, sum of indices [2, 8): " << range_sum << std::endl;
+        }
+    }
+}
+
+template <typename DictionaryType>
+void test_sparse_matrix(const std::string& dictionary_name, bool extended) {
+    std::cout << "Testing SparseMatrix with " << dictionary_name << "..." << std::endl;
+    UnqPtr<IDictionary<IndexPair, double>> dictionary(new DictionaryType());
+    SparseMatrix<double> matrix(4, 4, std::move(dictionary));
+
+    matrix.SetElement(0, 0, 1.0);
+    matrix.SetElement(1, 1, 2.0);
+    matrix.SetElement(2, 2, 3.0);
+
+    matrix.Map([](double x) { return x + 1; });
+
+    try {
+        double value = matrix.GetElement(1, 1);
+        if (value != 3.0) {
+            std::cerr << "Error in Map: expected 3.0, got " << value << std::endl;
+        } else {
+            std::cout << "Map succeeded, new value of GetElement(1,1): " << value << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception during Map verification: " << e.what() << std::endl;
+    }
+
+    double sum = matrix.Reduce([](double acc, double x) { return acc + x; }, 0.0);
+    if (sum != 9.0) {
+        std::cerr << "Error in Reduce: expected 9.0, got " << sum << std::endl;
+    } else {
+        std::cout << "Reduce succeeded, sum: " << sum << std::endl;
+    }
+
+    if (extended) {
+        std::cout << "Extended Testing SparseMatrix with " << dictionary_name << "..." << std::endl;
+
+        matrix.SetElement(3, 3, 4.0);
+        matrix.SetElement(0, 3, 5.0);
+        matrix.SetElement(3, 0, 6.0);
+
+        for (int i = 0; i < matrix.GetRows(); ++i) {
+            for (int j = 0; j < matrix.GetColumns(); ++j) {
+                double value = matrix.GetElement(i, j);
+                std::cout << "Element at (" << i << ", " << j << "): " << value << std::endl;
+            }
+        }
+
+        matrix.Map([](double x) { return x + 10; });
+
+        try {
+            double value = matrix.GetElement(2, 2);
+            if (value != 14.0) {
+                std::cerr << "Error in Map: expected 14.0, got " << value << std::endl;
+            } else {
+                std::cout << "Map succeeded, new value of GetElement(2,2): " << value << std::endl;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Exception during Map verification: " << e.what() << std::endl;
         }
 
         double sum_extended = matrix.Reduce([](double acc, double x) { return acc + x; }, 0.0);
@@ -241,6 +1251,37 @@ void test_sparse_matrix(const std::string& dictionary_name, bool extended) {
         } else {
             std::cout << "RemoveElement succeeded, element at (1,1) is now zero." << std::endl;
         }
+
+        IndexPair positions[] = {IndexPair(1, 2), IndexPair(2, 1), IndexPair(3, 3)};
+        double values[] = {7.0, 8.0, 0.0};
+        matrix.SetElements(positions, values, 3);
+
+        double results[3];
+        matrix.GetElements(positions, 3, results);
+        if (results[0] != 7.0 || results[1] != 8.0 || results[2] != 0.0) {
+            std::cerr << "Error in SetElements/GetElements: unexpected batch values." << std::endl;
+        } else {
+            std::cout << "SetElements/GetElements succeeded." << std::endl;
+        }
+
+        static double row_sum;
+        static int row_outside;
+        row_sum = 0;
+        row_outside = 0;
+        matrix.ForEachInRow(3, [](const IndexPair& index, const double& value) {
+            row_sum += value;
+            row_outside += index.row != 3 ? 1 : 0;
+        });
+        double expected_row_sum = 0;
+        for (int j = 0; j < matrix.GetColumns(); ++j) {
+            expected_row_sum += matrix.GetElement(3, j);
+        }
+        if (row_outside != 0 || std::abs(row_sum - expected_row_sum) > 1e-9) {
+            std::cerr << "Error in ForEachInRow: expected sum " << expected_row_sum << ", got " << row_sum
+                      << std::endl;
+        } else {
+            std::cout << "ForEachInRow succeeded, sum of row 3: " << row_sum << std::endl;
+        }
     }
 }
 
@@ -374,19 +1415,708 @@ void performance_test_matrix(int size, const std::string& dict_name, std::ostrea
                << reduce_time << "," << update_time << "," << iteration_time << "\n";
 }
 
-std::vector<int> read_test_sizes(const std::string& filename) {
-    std::vector<int> sizes;
-    std::ifstream file(filename);
-    if (!file) {
-        std::cerr << "Failed to open configuration file: " << filename << std::endl;
-        return sizes;
+template<typename TKey, typename THash, typename KeyGenerator>
+void performance_test_collisions(int num_elements, KeyGenerator make_key, const std::string& hash_name,
+                                 const std::string& pattern_name, std::ostream& log_stream) {
+    HashTable<TKey, double, THash> table;
+
+    long long insertion_time = measure_time([&]() {
+        for (int i = 0; i < num_elements; ++i) {
+            table.Add(make_key(i), static_cast<double>(i));
+        }
+    });
+
+    long long search_time = measure_time([&]() {
+        for (int i = 0; i < num_elements; ++i) {
+            volatile bool found = table.ContainsKey(make_key(i));
+            (void)found;
+        }
+    });
+
+    CollisionStats stats = table.GetCollisionStats();
+    log_stream << hash_name << "," << pattern_name << "," << stats.count << "," << stats.bucketCount << ","
+               << stats.usedBuckets << "," << stats.maxChainLength << "," << stats.averageChainLength << ","
+               << stats.averageProbeLength << "," << insertion_time << "," << search_time << "\n";
+}
+
+template<typename TKey, typename THash, typename KeyGenerator>
+void performance_test_hash_table_stats(int num_elements, KeyGenerator make_key, const std::string& hash_name,
+                                       const std::string& pattern_name, bool incremental_rehash,
+                                       std::ostream& stats_stream, std::ostream& histogram_stream) {
+    HashTable<TKey, double, THash, CountingHashTableStats> table(16, incremental_rehash);
+    for (int i = 0; i < num_elements; ++i) {
+        table.Add(make_key(i), static_cast<double>(i));
+    }
+    // The inserts' own lookups are dropped so that hits and misses below come from
+    // the search phase alone; rehashes all happen during the inserts.
+    CountingHashTableStats build = table.GetTelemetry();
+    table.ResetTelemetry();
+
+    for (int i = 0; i < num_elements; ++i) {
+        volatile bool found = table.ContainsKey(make_key(i));
+        (void)found;
+    }
+    for (int i = num_elements; i < 2 * num_elements; ++i) {
+        volatile bool found = table.ContainsKey(make_key(i));
+        (void)found;
     }
 
-    int size;
-    while (file >> size) {
-        sizes.push_back(size);
+    const CountingHashTableStats& lookups = table.GetTelemetry();
+    CollisionStats stats = table.GetCollisionStats();
+    std::string name = hash_name + "," + pattern_name + "," + (incremental_rehash ? "Incremental" : "Full");
+    stats_stream << name << "," << stats.count << "," << stats.bucketCount << "," << stats.loadFactor << ","
+                 << stats.maxChainLength << "," << lookups.GetHitCount() << "," << lookups.GetMissCount() << ","
+                 << lookups.GetAverageHitProbes() << "," << lookups.GetAverageMissProbes() << ","
+                 << build.GetRehashCount() << "," << build.GetRehashNanoseconds() / 1000 << "\n";
+    for (size_t length = 0; length < CollisionStats::HistogramSize; ++length) {
+        histogram_stream << name << "," << length << "," << stats.chainLengthHistogram[length] << ","
+                         << lookups.GetProbeHistogram(length) << "\n";
     }
-    return sizes;
+}
+
+template<typename TDictionary>
+void performance_test_batch(int num_elements, const std::string& dict_name, std::ostream& log_stream) {
+    std::vector<int> keys(num_elements);
+    std::vector<double> values(num_elements);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> dis(0, std::numeric_limits<int>::max());
+    for (int i = 0; i < num_elements; ++i) {
+        keys[i] = dis(gen);
+        values[i] = static_cast<double>(i + 1);
+    }
+
+    std::vector<int> lookups(keys);
+    std::shuffle(lookups.begin(), lookups.end(), gen);
+    UnqPtr<bool[]> found(new bool[num_elements]);
+    std::vector<double> results(num_elements);
+
+    // The first dictionary is destroyed before the second one is built, so both start
+    // from the same heap state.
+    long long single_insert_time = 0;
+    long long single_lookup_time = 0;
+    {
+        TDictionary single;
+        single_insert_time = measure_time([&]() {
+            for (int i = 0; i < num_elements; ++i) {
+                single.Add(keys[i], values[i]);
+            }
+        });
+
+        single_lookup_time = measure_time([&]() {
+            for (int i = 0; i < num_elements; ++i) {
+                found[i] = single.ContainsKey(lookups[i]);
+            }
+        });
+    }
+
+    TDictionary batched;
+    long long batch_insert_time = measure_time([&]() {
+        batched.AddRange(keys.data(), values.data(), keys.size());
+    });
+
+    long long batch_lookup_time = measure_time([&]() {
+        batched.ContainsMany(lookups.data(), lookups.size(), found.get());
+    });
+
+    long long batch_get_time = measure_time([&]() {
+        batched.GetMany(lookups.data(), lookups.size(), results.data(), nullptr);
+    });
+
+    log_stream << dict_name << "," << num_elements << "," << single_insert_time << "," << batch_insert_time << ","
+               << single_lookup_time << "," << batch_lookup_time << "," << batch_get_time << "\n";
+}
+
+template<typename TDictionary>
+void performance_test_allocations(int num_elements, const std::string& dict_name, std::ostream& log_stream) {
+    // Long enough to stay out of the small-string buffer, so every string copy allocates.
+    const size_t value_length = 64;
+
+    auto run = [&](const std::string& method, auto insert) {
+        TDictionary dictionary;
+        long long allocations_before = allocation_count.load();
+        long long insert_time = measure_time([&]() {
+            for (int i = 0; i < num_elements; ++i) {
+                insert(dictionary, i);
+            }
+        });
+        long long allocations = allocation_count.load() - allocations_before;
+
+        log_stream << dict_name << "," << num_elements << "," << method << "," << allocations << ","
+                   << static_cast<double>(allocations) / num_elements << "," << insert_time << "\n";
+    };
+
+    run("Add(copy)", [&](TDictionary& dictionary, int key) {
+        std::string value(value_length, 'x');
+        dictionary.Add(key, value);
+    });
+    run("Add(move)", [&](TDictionary& dictionary, int key) {
+        std::string value(value_length, 'x');
+        dictionary.Add(key, std::move(value));
+    });
+    run("Emplace", [&](TDictionary& dictionary, int key) {
+        dictionary.Emplace(key, value_length, 'x');
+    });
+}
+
+void performance_test_capacity(int num_elements, std::ostream& log_stream) {
+    std::vector<int> keys(num_elements);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> dis(0, std::numeric_limits<int>::max());
+    for (int i = 0; i < num_elements; ++i) {
+        keys[i] = dis(gen);
+    }
+
+    long long growing_time = 0;
+    {
+        HashTable<int, double> growing;
+        growing_time = measure_time([&]() {
+            for (int i = 0; i < num_elements; ++i) {
+                growing.Add(keys[i], static_cast<double>(i + 1));
+            }
+        });
+    }
+
+    HashTable<int, double> reserved;
+    long long reserved_time = measure_time([&]() {
+        reserved.Reserve(num_elements);
+        for (int i = 0; i < num_elements; ++i) {
+            reserved.Add(keys[i], static_cast<double>(i + 1));
+        }
+    });
+    size_t full_memory = reserved.GetMemoryUsage();
+
+    // Drop nine entries in ten, as after clearing most of a sparse structure.
+    for (int i = 0; i < num_elements; ++i) {
+        if (i % 10 != 0 && reserved.ContainsKey(keys[i])) {
+            reserved.Remove(keys[i]);
+        }
+    }
+    size_t after_remove_memory = reserved.GetMemoryUsage();
+
+    long long shrink_time = measure_time([&]() {
+        reserved.ShrinkToFit();
+    });
+    size_t after_shrink_memory = reserved.GetMemoryUsage();
+
+    log_stream << num_elements << "," << growing_time << "," << reserved_time << "," << full_memory << ","
+               << after_remove_memory << "," << after_shrink_memory << "," << shrink_time << "\n";
+}
+
+void performance_test_iteration(int num_elements, double max_load_factor, std::ostream& log_stream) {
+    HashTable<int, int> table;
+    table.SetMaxLoadFactor(max_load_factor);
+    table.Reserve(num_elements);
+    for (int i = 0; i < num_elements; ++i) {
+        table.Add(i, i);
+    }
+
+    long long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    UnqPtr<IDictionaryIterator<int, int>> iterator = table.GetIterator();
+    while (iterator->MoveNext()) {
+        sum += iterator->GetCurrentValue();
+    }
+    auto finish = std::chrono::steady_clock::now();
+    long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+
+    volatile long long checksum = sum;
+    (void)checksum;
+
+    log_stream << num_elements << "," << max_load_factor << "," << elapsed / 1000000 << ","
+               << static_cast<double>(elapsed) / num_elements << "\n";
+}
+
+void performance_test_frozen(int num_elements, std::ostream& log_stream) {
+    std::vector<IndexPair> keys;
+    keys.reserve(num_elements);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> dis(0, std::max(1, num_elements * 10));
+
+    HashTable<IndexPair, double> table;
+    while (table.GetCount() < static_cast<size_t>(num_elements)) {
+        IndexPair key(dis(gen), dis(gen));
+        if (!table.ContainsKey(key)) {
+            table.Add(key, static_cast<double>(keys.size() + 1));
+            keys.push_back(key);
+        }
+    }
+    std::shuffle(keys.begin(), keys.end(), gen);
+
+    double sum = 0;
+    long long table_lookup_time = measure_time([&]() {
+        for (const IndexPair& key : keys) {
+            sum += table.GetOrDefault(key, 0.0);
+        }
+    });
+
+    UnqPtr<FrozenHashTable<IndexPair, double>> frozen;
+    long long freeze_time = measure_time([&]() {
+        frozen = UnqPtr<FrozenHashTable<IndexPair, double>>(new FrozenHashTable<IndexPair, double>(table));
+    });
+
+    long long frozen_lookup_time = measure_time([&]() {
+        for (const IndexPair& key : keys) {
+            sum += frozen->GetOrDefault(key, 0.0);
+        }
+    });
+
+    volatile double checksum = sum;
+    (void)checksum;
+
+    log_stream << num_elements << "," << freeze_time << "," << table_lookup_time << "," << frozen_lookup_time << ","
+               << table.GetMemoryUsage() << "," << frozen->GetMemoryUsage() << "," << frozen->GetBitsPerKey() << "\n";
+}
+
+void performance_test_roaring(int num_elements, std::ostream& log_stream) {
+    // One index in ten is set, as in the sparse vector benchmark.
+    int length = num_elements * 10;
+    std::vector<int> indices(length);
+    for (int i = 0; i < length; ++i) {
+        indices[i] = i;
+    }
+    std::mt19937 gen(42);
+    std::shuffle(indices.begin(), indices.end(), gen);
+    indices.resize(num_elements);
+
+    auto measure = [&](IDictionary<int, double>& dictionary, long long& insertion_time, long long& lookup_time,
+                       long long& iteration_time) {
+        insertion_time = measure_time([&]() {
+            for (int i = 0; i < num_elements; ++i) {
+                dictionary.Add(indices[i], static_cast<double>(i + 1));
+            }
+        });
+        double sum = 0;
+        lookup_time = measure_time([&]() {
+            for (int i = 0; i < length; ++i) {
+                sum += dictionary.GetOrDefault(i, 0.0);
+            }
+        });
+        iteration_time = measure_time([&]() {
+            UnqPtr<IDictionaryIterator<int, double>> iterator = dictionary.GetIterator();
+            while (iterator->MoveNext()) {
+                sum += iterator->GetCurrentValue();
+            }
+        });
+        volatile double checksum = sum;
+        (void)checksum;
+    };
+
+    HashTable<int, double> table;
+    RoaringDictionary<double> roaring;
+    long long table_insertion, table_lookup, table_iteration;
+    long long roaring_insertion, roaring_lookup, roaring_iteration;
+    measure(table, table_insertion, table_lookup, table_iteration);
+    measure(roaring, roaring_insertion, roaring_lookup, roaring_iteration);
+
+    log_stream << num_elements << "," << length << "," << table.GetMemoryUsage() << "," << roaring.GetMemoryUsage()
+               << "," << table_insertion << "," << roaring_insertion << "," << table_lookup << "," << roaring_lookup
+               << "," << table_iteration << "," << roaring_iteration << "\n";
+}
+
+void performance_test_bulk_load(int num_elements, std::ostream& log_stream) {
+    std::vector<int> keys(num_elements);
+    std::vector<double> values(num_elements);
+    for (int i = 0; i < num_elements; ++i) {
+        keys[i] = i * 10;
+        values[i] = static_cast<double>(i + 1);
+    }
+
+    BTree<int, double> added;
+    long long add_time = measure_time([&]() {
+        for (int i = 0; i < num_elements; ++i) {
+            added.Add(keys[i], values[i]);
+        }
+    });
+
+    BTree<int, double> packed;
+    long long build_time = measure_time([&]() {
+        packed.BuildFromSorted(keys.begin(), keys.end(), values.begin());
+    });
+
+    // A partly filled tree takes the next round of inserts with fewer splits.
+    BTree<int, double> loose;
+    long long loose_build_time = measure_time([&]() {
+        loose.BuildFromSorted(keys.begin(), keys.end(), values.begin(), 0.7);
+    });
+
+    double sum = 0;
+    long long search_time = measure_time([&]() {
+        for (int i = 0; i < num_elements; ++i) {
+            sum += packed.Get(keys[i]);
+        }
+    });
+    long long packed_insert_time = measure_time([&]() {
+        for (int i = 0; i < num_elements; ++i) {
+            packed.Add(keys[i] + 5, values[i]);
+        }
+    });
+    long long loose_insert_time = measure_time([&]() {
+        for (int i = 0; i < num_elements; ++i) {
+            loose.Add(keys[i] + 5, values[i]);
+        }
+    });
+    volatile double checksum = sum;
+    (void)checksum;
+
+    log_stream << num_elements << "," << add_time << "," << build_time << "," << loose_build_time << ","
+               << search_time << "," << packed_insert_time << "," << loose_insert_time << "\n";
+}
+
+template<typename TDictionary>
+void performance_test_remove(int num_elements, const std::string& dict_name, std::ostream& log_stream) {
+    std::vector<int> keys(num_elements);
+    for (int i = 0; i < num_elements; ++i) {
+        keys[i] = i * 2;
+    }
+    std::mt19937 gen(42);
+    std::shuffle(keys.begin(), keys.end(), gen);
+
+    auto fill = [&](TDictionary& dictionary) {
+        return measure_time([&]() {
+            for (int i = 0; i < num_elements; ++i) {
+                dictionary.Add(keys[i], static_cast<double>(i));
+            }
+        });
+    };
+
+    // The pattern SparseVector::RemoveElement used before TryRemove: a lookup, then a
+    // removal that looks the key up again.
+    TDictionary checked;
+    long long insertion_time = fill(checked);
+    long long checked_time = measure_time([&]() {
+        for (int i = 0; i < num_elements; ++i) {
+            if (checked.ContainsKey(keys[i])) {
+                checked.Remove(keys[i]);
+            }
+        }
+    });
+
+    TDictionary single;
+    fill(single);
+    long long try_remove_time = measure_time([&]() {
+        for (int i = 0; i < num_elements; ++i) {
+            single.TryRemove(keys[i]);
+        }
+    });
+
+    // Odd keys were never inserted: every removal misses.
+    TDictionary missing;
+    fill(missing);
+    long long miss_time = measure_time([&]() {
+        for (int i = 0; i < num_elements; ++i) {
+            missing.TryRemove(keys[i] + 1);
+        }
+    });
+
+    log_stream << dict_name << "," << num_elements << "," << insertion_time << "," << checked_time << ","
+               << try_remove_time << "," << miss_time << "\n";
+}
+
+template<typename TAllocator>
+void performance_test_node_allocator(int num_elements, const std::string& allocator_name, std::ostream& log_stream) {
+    std::vector<int> keys(num_elements);
+    for (int i = 0; i < num_elements; ++i) {
+        keys[i] = i;
+    }
+    std::mt19937 gen(42);
+    std::shuffle(keys.begin(), keys.end(), gen);
+
+    // Build, Clear, build again into the memory Clear kept or returned, then destroy. Keys
+    // and elements are numbers, so every counted allocation is a node or an arena chunk.
+    auto run = [&](const std::string& structure, auto container, auto fill) {
+        long long allocations_before = allocation_count.load();
+        long long build_time = measure_time([&]() {
+            fill(*container);
+        });
+        long long allocations = allocation_count.load() - allocations_before;
+        long long clear_time = measure_time([&]() {
+            container->Clear();
+        });
+        long long rebuild_time = measure_time([&]() {
+            fill(*container);
+        });
+        long long destroy_time = measure_time([&]() {
+            container.reset();
+        });
+        log_stream << structure << "," << allocator_name << "," << num_elements << "," << allocations << ","
+                   << build_time << "," << clear_time << "," << rebuild_time << "," << destroy_time << "\n";
+    };
+
+    run("BTree", UnqPtr<BTree<int, double, TAllocator>>(new BTree<int, double, TAllocator>()),
+        [&](BTree<int, double, TAllocator>& tree) {
+            for (int i = 0; i < num_elements; ++i) {
+                tree.Add(keys[i], static_cast<double>(i));
+            }
+        });
+    run("LinkedListSmart", UnqPtr<LinkedListSmart<int, TAllocator>>(new LinkedListSmart<int, TAllocator>()),
+        [&](LinkedListSmart<int, TAllocator>& list) {
+            for (int i = 0; i < num_elements; ++i) {
+                list.Prepend(keys[i]);
+            }
+        });
+}
+
+void performance_test_snapshot(int num_elements, std::ostream& log_stream) {
+    BTree<int, double> tree;
+    for (int i = 0; i < num_elements; ++i) {
+        tree.Add(i * 2, static_cast<double>(i));
+    }
+    size_t tree_bytes = tree.GetMemoryUsage();
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> dis(0, num_elements - 1);
+    // Memory a snapshot costs once k random writes have copied their paths: the nodes
+    // it no longer shares with the tree.
+    for (int writes : {0, 1, 10, 100, 1000, 10000}) {
+        UnqPtr<const BTree<int, double>> snapshot;
+        long long snapshot_time = measure_time([&]() {
+            snapshot = tree.Snapshot();
+        });
+        long long write_time = measure_time([&]() {
+            for (int i = 0; i < writes; ++i) {
+                tree.Update(dis(gen) * 2, static_cast<double>(i));
+            }
+        });
+        size_t own_bytes = snapshot->GetMemoryUsage() - snapshot->GetSharedMemoryUsage();
+        log_stream << num_elements << "," << writes << "," << tree_bytes << "," << own_bytes << ","
+                   << static_cast<double>(own_bytes) / tree_bytes * 100 << "," << snapshot_time << ","
+                   << write_time << "\n";
+    }
+}
+
+static double range_checksum = 0;
+
+template<typename TDictionary>
+void performance_test_range(int num_elements, const std::string& dict_name, std::ostream& log_stream) {
+    // One index in ten is set; each query covers 1000 indices, about 100 elements.
+    int length = num_elements * 10;
+    int width = 1000;
+    int num_queries = 1000;
+    std::vector<int> indices(num_elements);
+    std::vector<double> values(num_elements);
+    for (int i = 0; i < num_elements; ++i) {
+        indices[i] = i * 10;
+        values[i] = static_cast<double>(i + 1);
+    }
+    SparseVector<double> vector(length, UnqPtr<IDictionary<int, double>>(new TDictionary()), indices.data(),
+                                values.data(), num_elements);
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> dis(0, length - width);
+    std::vector<int> starts(num_queries);
+    for (int i = 0; i < num_queries; ++i) {
+        starts[i] = dis(gen);
+    }
+
+    long long range_time = measure_time([&]() {
+        for (int start : starts) {
+            vector.ForEachInRange(start, start + width, [](int, const double& value) { range_checksum += value; });
+        }
+    });
+
+    // What slicing cost before GetRange: a full scan that skips the indices outside.
+    int scanned_queries = std::min(num_queries, 20);
+    long long scan_time = measure_time([&]() {
+        for (int i = 0; i < scanned_queries; ++i) {
+            RangeFilterIterator<int, double> iterator(vector.GetIterator(), starts[i], starts[i] + width);
+            while (iterator.MoveNext()) {
+                range_checksum += iterator.GetCurrentValue();
+            }
+        }
+    });
+
+    log_stream << dict_name << "," << num_elements << "," << num_queries << "," << range_time << ","
+               << scanned_queries << "," << scan_time << "\n";
+}
+
+template<typename TDictionary>
+void performance_test_filter(int num_elements, const std::string& dict_name, std::ostream& log_stream) {
+    // One element in ten is non-zero, so nine lookups in ten miss.
+    int length = num_elements * 10;
+    std::vector<int> indices(num_elements);
+    std::vector<int> lookups(num_elements);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> dis(0, length - 1);
+    for (int i = 0; i < num_elements; ++i) {
+        indices[i] = dis(gen);
+        lookups[i] = dis(gen);
+    }
+
+    double sum = 0;
+    long long plain_time = 0;
+    {
+        SparseVector<double> vector(length, UnqPtr<IDictionary<int, double>>(new TDictionary()));
+        for (int i = 0; i < num_elements; ++i) {
+            vector.SetElement(indices[i], static_cast<double>(i + 1));
+        }
+        plain_time = measure_time([&]() {
+            for (int index : lookups) {
+                sum += vector.GetElement(index);
+            }
+        });
+    }
+
+    FilteredDictionary<int, double, TDictionary>* filtered = new FilteredDictionary<int, double, TDictionary>();
+    SparseVector<double> vector(length, UnqPtr<IDictionary<int, double>>(filtered));
+    for (int i = 0; i < num_elements; ++i) {
+        vector.SetElement(indices[i], static_cast<double>(i + 1));
+    }
+    size_t false_positives_before = filtered->GetFalsePositiveCount();
+    long long filtered_time = measure_time([&]() {
+        for (int index : lookups) {
+            sum += vector.GetElement(index);
+        }
+    });
+
+    volatile double checksum = sum;
+    (void)checksum;
+
+    std::unordered_set<int> stored(indices.begin(), indices.end());
+    size_t misses = 0;
+    for (int index : lookups) {
+        if (stored.count(index) == 0) {
+            ++misses;
+        }
+    }
+    size_t false_positives = filtered->GetFalsePositiveCount() - false_positives_before;
+    double false_positive_rate = misses == 0 ? 0.0 : static_cast<double>(false_positives) / misses;
+    size_t filter_memory = filtered->GetFilter().GetMemoryUsage();
+    double bits_per_key = 8.0 * filter_memory / filtered->GetCount();
+
+    log_stream << dict_name << "," << num_elements << "," << plain_time << "," << filtered_time << ","
+               << misses << "," << false_positive_rate << ","
+               << filter_memory << "," << bits_per_key << "\n";
+}
+
+long long percentile(std::vector<long long>& samples, double fraction) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+void performance_test_insert_latency(UnqPtr<IDictionary<int, double>> dictionary, int num_elements,
+                                     const std::string& dict_name, std::ostream& log_stream) {
+    SparseVector<double> vector(num_elements, std::move(dictionary));
+
+    std::vector<long long> latencies;
+    latencies.reserve(num_elements);
+
+    for (int i = 0; i < num_elements; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        vector.SetElement(i, static_cast<double>(i + 1));
+        auto finish = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count());
+    }
+
+    long long max_latency = *std::max_element(latencies.begin(), latencies.end());
+    long long p50 = percentile(latencies, 0.50);
+    long long p99 = percentile(latencies, 0.99);
+    long long p999 = percentile(latencies, 0.999);
+
+    log_stream << dict_name << "," << num_elements << "," << p50 << "," << p99 << "," << p999 << ","
+               << max_latency << "\n";
+}
+
+void performance_test_lookup_latency(UnqPtr<IDictionary<int, double>> dictionary, int num_elements,
+                                    const std::string& dict_name, std::ostream& log_stream) {
+    // One element in ten is non-zero, so most lookups miss like they do in a sparse vector.
+    int length = num_elements * 10;
+    SparseVector<double> vector(length, std::move(dictionary));
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> dis(0, length - 1);
+    for (int i = 0; i < num_elements; ++i) {
+        vector.SetElement(dis(gen), static_cast<double>(i + 1));
+    }
+
+    std::vector<long long> latencies;
+    latencies.reserve(num_elements);
+
+    double sum = 0;
+    for (int i = 0; i < num_elements; ++i) {
+        int index = dis(gen);
+        auto start = std::chrono::steady_clock::now();
+        sum += vector.GetElement(index);
+        auto finish = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count());
+    }
+
+    volatile double checksum = sum;
+    (void)checksum;
+
+    long long max_latency = *std::max_element(latencies.begin(), latencies.end());
+    long long p50 = percentile(latencies, 0.50);
+    long long p99 = percentile(latencies, 0.99);
+    long long p999 = percentile(latencies, 0.999);
+
+    log_stream << dict_name << "," << num_elements << "," << p50 << "," << p99 << "," << p999 << ","
+               << max_latency << "\n";
+}
+
+void performance_test_concurrent(UnqPtr<IDictionary<int, double>> dictionary, int num_threads, int key_range,
+                                 int operations_per_thread, int read_percent,
+                                 const std::string& dict_name, std::ostream& log_stream) {
+    SparseVector<double> vector(key_range, std::move(dictionary));
+    for (int i = 0; i < key_range; i += 2) {
+        vector.SetElement(i, 1.0);
+    }
+
+    std::atomic<bool> start_flag(false);
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 gen(static_cast<unsigned>(t + 1));
+            std::uniform_int_distribution<> dis_key(0, key_range - 1);
+            std::uniform_int_distribution<> dis_op(0, 99);
+
+            while (!start_flag.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+
+            for (int i = 0; i < operations_per_thread; ++i) {
+                int key = dis_key(gen);
+                if (dis_op(gen) < read_percent) {
+                    volatile double value = vector.GetElement(key);
+                    (void)value;
+                } else {
+                    vector.SetElement(key, static_cast<double>(i + 1));
+                }
+            }
+        });
+    }
+
+    long long elapsed_time = measure_time([&]() {
+        start_flag.store(true, std::memory_order_release);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    });
+
+    long long total_operations = (long long)num_threads * operations_per_thread;
+    long long throughput = total_operations / std::max(1LL, elapsed_time);
+
+    log_stream << dict_name << "," << num_threads << "," << read_percent << "," << total_operations << ","
+               << elapsed_time << "," << throughput << "\n";
+}
+
+std::vector<int> read_test_sizes(const std::string& filename) {
+    std::vector<int> sizes;
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Failed to open configuration file: " << filename << std::endl;
+        return sizes;
+    }
+
+    int size;
+    while (file >> size) {
+        sizes.push_back(size);
+    }
+    return sizes;
 }
 
 void performance_tests() {
@@ -411,12 +2141,346 @@ void performance_tests() {
         if (i % 2 == 0) {
             performance_test_vector<HashTable<int, double>>(size, "HashTable", log_file);
             performance_test_vector<BTree<int, double>>(size, "BTree", log_file);
+            performance_test_vector<BPlusTree<int, double>>(size, "BPlusTree", log_file);
+            performance_test_vector<FlatHashTable<int, double>>(size, "FlatHashTable", log_file);
+            performance_test_vector<SwissTable<int, double>>(size, "SwissTable", log_file);
+            performance_test_vector<RoaringDictionary<double>>(size, "RoaringDictionary", log_file);
         } else {
             performance_test_matrix<HashTable<IndexPair, double>>(size, "HashTable", log_file);
             performance_test_matrix<BTree<IndexPair, double>>(size, "BTree", log_file);
+            performance_test_matrix<BPlusTree<IndexPair, double>>(size, "BPlusTree", log_file);
+            performance_test_matrix<FlatHashTable<IndexPair, double>>(size, "FlatHashTable", log_file);
+            performance_test_matrix<SwissTable<IndexPair, double>>(size, "SwissTable", log_file);
         }
     }
 
     log_file.close();
     std::cout << "Performance tests completed. Results saved in performance_results.csv" << std::endl;
+
+    std::ofstream latency_file("latency_results.csv");
+    if (!latency_file.is_open()) {
+        std::cerr << "Cannot open the file latency_results.csv for writing." << std::endl;
+        return;
+    }
+
+    latency_file << "Dictionary,NumElements,P50(ns),P99(ns),P999(ns),Max(ns)\n";
+
+    for (int size : sizes) {
+        int num_elements = size * 10;
+        performance_test_insert_latency(UnqPtr<IDictionary<int, double>>(new HashTable<int, double>()),
+                                        num_elements, "HashTable", latency_file);
+        performance_test_insert_latency(UnqPtr<IDictionary<int, double>>(new HashTable<int, double>(16, true)),
+                                        num_elements, "HashTable(incremental)", latency_file);
+    }
+
+    latency_file.close();
+    std::cout << "Insert latency results saved in latency_results.csv" << std::endl;
+
+    std::ofstream lookup_file("lookup_latency_results.csv");
+    if (!lookup_file.is_open()) {
+        std::cerr << "Cannot open the file lookup_latency_results.csv for writing." << std::endl;
+        return;
+    }
+
+    lookup_file << "Dictionary,NumElements,P50(ns),P99(ns),P999(ns),Max(ns)\n";
+
+    for (int size : sizes) {
+        int num_elements = size * 10;
+        performance_test_lookup_latency(UnqPtr<IDictionary<int, double>>(new HashTable<int, double>()),
+                                        num_elements, "HashTable", lookup_file);
+        performance_test_lookup_latency(UnqPtr<IDictionary<int, double>>(new CuckooHashTable<int, double>()),
+                                        num_elements, "CuckooHashTable", lookup_file);
+    }
+
+    lookup_file.close();
+    std::cout << "Lookup latency results saved in lookup_latency_results.csv" << std::endl;
+
+    std::ofstream batch_file("batch_results.csv");
+    if (!batch_file.is_open()) {
+        std::cerr << "Cannot open the file batch_results.csv for writing." << std::endl;
+        return;
+    }
+
+    batch_file << "Dictionary,NumElements,Add(ms),AddRange(ms),ContainsKey(ms),ContainsMany(ms),GetMany(ms)\n";
+
+    for (int size : sizes) {
+        performance_test_batch<HashTable<int, double>>(size * 10, "HashTable", batch_file);
+        performance_test_batch<BTree<int, double>>(size * 10, "BTree", batch_file);
+    }
+
+    batch_file.close();
+    std::cout << "Batch results saved in batch_results.csv" << std::endl;
+
+    std::ofstream capacity_file("capacity_results.csv");
+    if (!capacity_file.is_open()) {
+        std::cerr << "Cannot open the file capacity_results.csv for writing." << std::endl;
+        return;
+    }
+
+    capacity_file << "NumElements,Growing(ms),Reserved(ms),Memory(bytes),AfterRemove(bytes),AfterShrink(bytes),Shrink(ms)\n";
+
+    for (int size : sizes) {
+        performance_test_capacity(size * 10, capacity_file);
+    }
+
+    capacity_file.close();
+    std::cout << "Capacity results saved in capacity_results.csv" << std::endl;
+
+    // Entry counts come from their own file so the scan can be pushed to 10^8 entries
+    // on a machine with enough memory (about 6 GB at that size).
+    std::vector<int> iteration_sizes = read_test_sizes("iteration_config.txt");
+
+    std::ofstream iteration_file("iteration_results.csv");
+    if (!iteration_file.is_open()) {
+        std::cerr << "Cannot open the file iteration_results.csv for writing." << std::endl;
+        return;
+    }
+
+    iteration_file << "NumElements,MaxLoadFactor,Time(ms),PerEntry(ns)\n";
+
+    for (int num_elements : iteration_sizes) {
+        performance_test_iteration(num_elements, 0.75, iteration_file);
+        performance_test_iteration(num_elements, 8.0, iteration_file);
+    }
+
+    iteration_file.close();
+    std::cout << "Iteration results saved in iteration_results.csv" << std::endl;
+
+    std::ofstream filter_file("filter_results.csv");
+    if (!filter_file.is_open()) {
+        std::cerr << "Cannot open the file filter_results.csv for writing." << std::endl;
+        return;
+    }
+
+    filter_file << "Dictionary,NumElements,Plain(ms),Filtered(ms),Misses,FalsePositiveRate,FilterMemory(bytes),FilterBitsPerKey\n";
+
+    for (int size : sizes) {
+        performance_test_filter<HashTable<int, double>>(size * 10, "HashTable", filter_file);
+        performance_test_filter<BTree<int, double>>(size * 10, "BTree", filter_file);
+    }
+
+    filter_file.close();
+    std::cout << "Filter results saved in filter_results.csv" << std::endl;
+
+    std::ofstream frozen_file("frozen_results.csv");
+    if (!frozen_file.is_open()) {
+        std::cerr << "Cannot open the file frozen_results.csv for writing." << std::endl;
+        return;
+    }
+
+    frozen_file << "NumElements,Freeze(ms),HashTableLookup(ms),FrozenLookup(ms),HashTableMemory(bytes),FrozenMemory(bytes),BitsPerKey\n";
+
+    for (int size : sizes) {
+        performance_test_frozen(size * 10, frozen_file);
+    }
+
+    frozen_file.close();
+    std::cout << "Frozen dictionary results saved in frozen_results.csv" << std::endl;
+
+    std::ofstream roaring_file("roaring_results.csv");
+    if (!roaring_file.is_open()) {
+        std::cerr << "Cannot open the file roaring_results.csv for writing." << std::endl;
+        return;
+    }
+
+    roaring_file << "NumElements,Length,HashTableMemory(bytes),RoaringMemory(bytes),HashTableInsertion(ms),"
+                    "RoaringInsertion(ms),HashTableLookup(ms),RoaringLookup(ms),HashTableIteration(ms),"
+                    "RoaringIteration(ms)\n";
+
+    for (int size : sizes) {
+        performance_test_roaring(size * 10, roaring_file);
+    }
+
+    roaring_file.close();
+    std::cout << "Roaring dictionary results saved in roaring_results.csv" << std::endl;
+
+    std::ofstream bulk_load_file("bulk_load_results.csv");
+    if (!bulk_load_file.is_open()) {
+        std::cerr << "Cannot open the file bulk_load_results.csv for writing." << std::endl;
+        return;
+    }
+
+    bulk_load_file << "NumElements,AddTime(ms),BuildFromSortedTime(ms),BuildFromSorted70Time(ms),SearchTime(ms),"
+                      "InsertAfterBuildTime(ms),InsertAfterBuild70Time(ms)\n";
+
+    for (int size : sizes) {
+        performance_test_bulk_load(size * 10, bulk_load_file);
+    }
+
+    bulk_load_file.close();
+    std::cout << "BTree bulk load results saved in bulk_load_results.csv" << std::endl;
+
+    std::ofstream remove_file("remove_results.csv");
+    if (!remove_file.is_open()) {
+        std::cerr << "Cannot open the file remove_results.csv for writing." << std::endl;
+        return;
+    }
+
+    remove_file << "Dictionary,NumElements,InsertionTime(ms),ContainsKeyRemoveTime(ms),TryRemoveTime(ms),"
+                   "TryRemoveMissTime(ms)\n";
+
+    for (int size : sizes) {
+        performance_test_remove<BTree<int, double>>(size * 10, "BTree", remove_file);
+        performance_test_remove<BPlusTree<int, double>>(size * 10, "BPlusTree", remove_file);
+        performance_test_remove<HashTable<int, double>>(size * 10, "HashTable", remove_file);
+    }
+
+    remove_file.close();
+    std::cout << "Remove results saved in remove_results.csv" << std::endl;
+
+    std::ofstream node_allocator_file("node_allocator_results.csv");
+    if (!node_allocator_file.is_open()) {
+        std::cerr << "Cannot open the file node_allocator_results.csv for writing." << std::endl;
+        return;
+    }
+
+    node_allocator_file << "Structure,Allocator,NumElements,BuildAllocations,BuildTime(ms),ClearTime(ms),"
+                           "RebuildTime(ms),DestroyTime(ms)\n";
+
+    for (int size : sizes) {
+        performance_test_node_allocator<HeapNodeAllocator>(size * 10, "Heap", node_allocator_file);
+        performance_test_node_allocator<ArenaNodeAllocator>(size * 10, "Arena", node_allocator_file);
+    }
+
+    node_allocator_file.close();
+    std::cout << "Node allocator results saved in node_allocator_results.csv" << std::endl;
+
+    std::ofstream snapshot_file("snapshot_results.csv");
+    if (!snapshot_file.is_open()) {
+        std::cerr << "Cannot open the file snapshot_results.csv for writing." << std::endl;
+        return;
+    }
+
+    snapshot_file << "NumElements,Writes,TreeBytes,SnapshotOwnBytes,SnapshotOverhead(%),SnapshotTime(ms),"
+                     "WriteTime(ms)\n";
+
+    for (int size : sizes) {
+        performance_test_snapshot(size * 10, snapshot_file);
+    }
+
+    snapshot_file.close();
+    std::cout << "BTree snapshot results saved in snapshot_results.csv" << std::endl;
+
+    std::ofstream range_file("range_results.csv");
+    if (!range_file.is_open()) {
+        std::cerr << "Cannot open the file range_results.csv for writing." << std::endl;
+        return;
+    }
+
+    range_file << "Dictionary,NumElements,RangeQueries,RangeTime(ms),ScanQueries,ScanTime(ms)\n";
+
+    for (int size : sizes) {
+        performance_test_range<BTree<int, double>>(size * 10, "BTree", range_file);
+        performance_test_range<BPlusTree<int, double>>(size * 10, "BPlusTree", range_file);
+    }
+
+    range_file.close();
+    std::cout << "Range query results saved in range_results.csv" << std::endl;
+
+    std::ofstream allocation_file("allocation_results.csv");
+    if (!allocation_file.is_open()) {
+        std::cerr << "Cannot open the file allocation_results.csv for writing." << std::endl;
+        return;
+    }
+
+    allocation_file << "Dictionary,NumElements,Method,Allocations,AllocationsPerInsert,Time(ms)\n";
+
+    for (int size : sizes) {
+        performance_test_allocations<HashTable<int, std::string>>(size, "HashTable", allocation_file);
+        performance_test_allocations<BTree<int, std::string>>(size, "BTree", allocation_file);
+        // Aligned node allocations are counted too, so the two BTree rows differ by the
+        // per-node allocations the arena replaces with one per chunk.
+        performance_test_allocations<BTree<int, std::string, ArenaNodeAllocator>>(size, "ArenaBTree",
+                                                                                  allocation_file);
+    }
+
+    allocation_file.close();
+    std::cout << "Allocation counts saved in allocation_results.csv" << std::endl;
+
+    std::ofstream collision_file("collision_results.csv");
+    if (!collision_file.is_open()) {
+        std::cerr << "Cannot open the file collision_results.csv for writing." << std::endl;
+        return;
+    }
+
+    collision_file << "Hash,Pattern,Count,Buckets,UsedBuckets,MaxChain,AvgChain,AvgProbes,Insertion(ms),Search(ms)\n";
+
+    int num_keys = sizes.back();
+    auto sequential = [](int i) { return i; };
+    auto strided = [num_keys](int i) { return static_cast<int>((static_cast<long long>(i) * 31) % num_keys); };
+    auto aligned = [](int i) { return i * 1024; };
+    auto grid = [](int i) { return IndexPair(i / 64 * 64, i % 64 * 64); };
+
+    performance_test_collisions<int, DefaultHash<int>>(num_keys, sequential, "DefaultHash", "Sequential", collision_file);
+    performance_test_collisions<int, StdHash<int>>(num_keys, sequential, "StdHash", "Sequential", collision_file);
+    performance_test_collisions<int, DefaultHash<int>>(num_keys, strided, "DefaultHash", "Strided31", collision_file);
+    performance_test_collisions<int, StdHash<int>>(num_keys, strided, "StdHash", "Strided31", collision_file);
+    performance_test_collisions<int, DefaultHash<int>>(num_keys, aligned, "DefaultHash", "Stride1024", collision_file);
+    performance_test_collisions<int, StdHash<int>>(num_keys, aligned, "StdHash", "Stride1024", collision_file);
+    performance_test_collisions<IndexPair, DefaultHash<IndexPair>>(num_keys, grid, "DefaultHash", "Grid64", collision_file);
+    performance_test_collisions<IndexPair, StdHash<IndexPair>>(num_keys, grid, "StdHash", "Grid64", collision_file);
+
+    collision_file.close();
+    std::cout << "Collision statistics saved in collision_results.csv" << std::endl;
+
+    std::ofstream stats_file("hashtable_stats.csv");
+    std::ofstream histogram_file("hashtable_histogram.csv");
+    if (!stats_file.is_open() || !histogram_file.is_open()) {
+        std::cerr << "Cannot open the files hashtable_stats.csv and hashtable_histogram.csv for writing." << std::endl;
+        return;
+    }
+
+    stats_file << "Hash,Pattern,Rehash,Count,Buckets,LoadFactor,MaxChain,Hits,Misses,AvgHitProbes,AvgMissProbes,"
+                  "Rehashes,RehashTime(us)\n";
+    // Length is a chain length for Buckets and a number of key comparisons for Lookups;
+    // the last row of each table also counts everything longer.
+    histogram_file << "Hash,Pattern,Rehash,Length,Buckets,Lookups\n";
+
+    for (bool incremental : {false, true}) {
+        performance_test_hash_table_stats<int, DefaultHash<int>>(num_keys, sequential, "DefaultHash", "Sequential",
+                                                                 incremental, stats_file, histogram_file);
+        performance_test_hash_table_stats<int, StdHash<int>>(num_keys, aligned, "StdHash", "Stride1024",
+                                                             incremental, stats_file, histogram_file);
+        performance_test_hash_table_stats<int, DefaultHash<int>>(num_keys, aligned, "DefaultHash", "Stride1024",
+                                                                 incremental, stats_file, histogram_file);
+        performance_test_hash_table_stats<IndexPair, DefaultHash<IndexPair>>(num_keys, grid, "DefaultHash", "Grid64",
+                                                                             incremental, stats_file, histogram_file);
+    }
+
+    stats_file.close();
+    histogram_file.close();
+    std::cout << "HashTable telemetry saved in hashtable_stats.csv and hashtable_histogram.csv" << std::endl;
+
+    std::ofstream concurrency_file("concurrency_results.csv");
+    if (!concurrency_file.is_open()) {
+        std::cerr << "Cannot open the file concurrency_results.csv for writing." << std::endl;
+        return;
+    }
+
+    concurrency_file << "Dictionary,Threads,ReadPercent,Operations,Time(ms),Throughput(ops/ms)\n";
+
+    int max_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    int key_range = sizes.back() * 10;
+    for (int read_percent : {90, 50}) {
+        for (int threads = 1; threads <= max_threads; threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1) {
+            performance_test_concurrent(UnqPtr<IDictionary<int, double>>(new LockedDictionary<int, double>()),
+                                        threads, key_range, 200000, read_percent, "LockedHashTable",
+                                        concurrency_file);
+            performance_test_concurrent(UnqPtr<IDictionary<int, double>>(new ConcurrentHashTable<int, double>()),
+                                        threads, key_range, 200000, read_percent, "ConcurrentHashTable",
+                                        concurrency_file);
+            performance_test_concurrent(UnqPtr<IDictionary<int, double>>(new LockFreeHashTable<int, double>()),
+                                        threads, key_range, 200000, read_percent, "LockFreeHashTable",
+                                        concurrency_file);
+            performance_test_concurrent(
+                    UnqPtr<IDictionary<int, double>>(new LockedDictionary<int, double, BTree<int, double>>()),
+                    threads, key_range, 200000, read_percent, "LockedBTree", concurrency_file);
+            performance_test_concurrent(UnqPtr<IDictionary<int, double>>(new ConcurrentBTree<int, double>()),
+                                        threads, key_range, 200000, read_percent, "ConcurrentBTree",
+                                        concurrency_file);
+        }
+    }
+
+    concurrency_file.close();
+    std::cout << "Concurrency results saved in concurrency_results.csv" << std::endl;
 }
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <ostream>
+#include "DataStructures/IDictionary.h"
+#include "DataStructures/UnqPtr.h"
 
 void run_tests();
 void functional_tests();
@@ -14,6 +16,32 @@ template <typename DictionaryType, typename KeyType, typename ValueType>
 void test_dictionary(const std::string& dictionary_name);
 
 
+void test_hash_table_capacity();
+
+void test_hash_table_telemetry();
+
+void test_key_search();
+
+void test_btree_bulk_load();
+
+void test_btree_remove();
+
+void test_btree_snapshot();
+
+void test_node_allocator();
+
+template <typename TDictionary>
+void test_tree_range(const std::string& dictionary_name);
+
+void test_concurrent_btree();
+
+template <typename TDictionary>
+void test_concurrent_removal(const std::string& dictionary_name);
+
+void test_frozen_hash_table();
+
+void test_roaring_dictionary();
+
 template <typename DictionaryType>
 void test_sparse_vector(const std::string& dictionary_name, bool extended = false);
 
@@ -31,4 +59,55 @@ void performance_test_vector(int size, const std::string& dict_name, std::ostrea
 template<typename TDictionary>
 void performance_test_matrix(int size, const std::string& dict_name, std::ostream& log_stream);
 
+template<typename TKey, typename THash, typename KeyGenerator>
+void performance_test_collisions(int num_elements, KeyGenerator make_key, const std::string& hash_name,
+                                 const std::string& pattern_name, std::ostream& log_stream);
+
+template<typename TKey, typename THash, typename KeyGenerator>
+void performance_test_hash_table_stats(int num_elements, KeyGenerator make_key, const std::string& hash_name,
+                                       const std::string& pattern_name, bool incremental_rehash,
+                                       std::ostream& stats_stream, std::ostream& histogram_stream);
+
+template<typename TDictionary>
+void performance_test_batch(int num_elements, const std::string& dict_name, std::ostream& log_stream);
+
+template<typename TDictionary>
+void performance_test_allocations(int num_elements, const std::string& dict_name, std::ostream& log_stream);
+
+void performance_test_capacity(int num_elements, std::ostream& log_stream);
+
+void performance_test_iteration(int num_elements, double max_load_factor, std::ostream& log_stream);
+
+void performance_test_frozen(int num_elements, std::ostream& log_stream);
+
+void performance_test_roaring(int num_elements, std::ostream& log_stream);
+
+void performance_test_bulk_load(int num_elements, std::ostream& log_stream);
+
+void performance_test_snapshot(int num_elements, std::ostream& log_stream);
+
+template<typename TAllocator>
+void performance_test_node_allocator(int num_elements, const std::string& allocator_name, std::ostream& log_stream);
+
+template<typename TDictionary>
+void performance_test_range(int num_elements, const std::string& dict_name, std::ostream& log_stream);
+
+template<typename TDictionary>
+void performance_test_remove(int num_elements, const std::string& dict_name, std::ostream& log_stream);
+
+template<typename TDictionary>
+void performance_test_filter(int num_elements, const std::string& dict_name, std::ostream& log_stream);
+
+long long percentile(std::vector<long long>& samples, double fraction);
+
+void performance_test_insert_latency(UnqPtr<IDictionary<int, double>> dictionary, int num_elements,
+                                     const std::string& dict_name, std::ostream& log_stream);
+
+void performance_test_lookup_latency(UnqPtr<IDictionary<int, double>> dictionary, int num_elements,
+                                    const std::string& dict_name, std::ostream& log_stream);
+
+void performance_test_concurrent(UnqPtr<IDictionary<int, double>> dictionary, int num_threads, int key_range,
+                                 int operations_per_thread, int read_percent,
+                                 const std::string& dict_name, std::ostream& log_stream);
+
 #endif // TEST_H
@@ -59,7 +59,7 @@ void BTreeTest::Visualize(const std::string& filename) {
 
     int nodeCount = 0;
     int nullCount = 0;
-    Traverse(btree.root.get(), nodeCount, dotFile, -1, -1, nullCount);
+    Traverse(btree.root, nodeCount, dotFile, -1, -1, nullCount);
 
     dotFile << "}\n";
     dotFile.close();
@@ -84,10 +84,10 @@ void BTreeTest::Traverse(const BTree<int, std::string>::Node* node, int& nodeCou
 
     for (int i = 0; i < node->numKeys; ++i) {
         if (i == node->numKeys -1){
-            nodeLabel << "<k" << i + 1 << "> " << node->keys[i] << " | <c" << i + 1 << "> ";
+            nodeLabel << "<k" << i + 1 << "> " << btree.Keys(node)[i] << " | <c" << i + 1 << "> ";
         }
         else{
-            nodeLabel << "<k" << i + 1 << "> " << node->keys[i] << " | <c" << i + 1 << "> |";
+            nodeLabel << "<k" << i + 1 << "> " << btree.Keys(node)[i] << " | <c" << i + 1 << "> |";
         }
 
     }
@@ -101,8 +101,8 @@ void BTreeTest::Traverse(const BTree<int, std::string>::Node* node, int& nodeCou
 
     if (!node->isLeaf) {
         for (int i = 0; i <= node->numKeys; ++i) {
-            if (node->children[i]) {
-                Traverse(node->children[i].get(), nodeCount, out, currentNodeId, i, nullCount);
+            if (btree.Children(node)[i]) {
+                Traverse(btree.Children(node)[i], nodeCount, out, currentNodeId, i, nullCount);
             }
             else {
                 int nullId = nullCount++;
@@ -130,7 +130,7 @@ bool BTreeTest::CheckBalance() {
 
     int leafDepth = -1;
     std::queue<std::pair<const BTree<int, std::string>::Node*, int>> q;
-    q.push({ btree.root.get(), 0 });
+    q.push({ btree.root, 0 });
 
     while (!q.empty()) {
         auto [current, depth] = q.front();
@@ -148,8 +148,8 @@ bool BTreeTest::CheckBalance() {
 
         if (!current->isLeaf) {
             for (int i = 0; i <= current->numKeys; ++i) {
-                if (current->children[i])
-                    q.push({ current->children[i].get(), depth + 1 });
+                if (btree.Children(current)[i])
+                    q.push({ btree.Children(current)[i], depth + 1 });
             }
         }
     }
@@ -161,5 +161,5 @@ bool BTreeTest::CheckBalance() {
 int BTreeTest::GetDepth(const BTree<int, std::string>::Node* node) const {
     if (node->isLeaf)
         return 0;
-    return 1 + GetDepth(node->children[0].get());
+    return 1 + GetDepth(btree.Children(node)[0]);
 }